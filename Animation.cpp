@@ -0,0 +1,211 @@
+#include "Animation.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ANIMATION_SSE2
+#include <emmintrin.h>
+#endif
+
+void AnimationSampler::play(Scene::Clip const &clip, bool loop, float speed, float time) {
+	uint32_t instance = uint32_t(instances.size());
+	instances.emplace_back(Instance{time, speed, std::max(0.0f, clip.duration), loop});
+
+	for (auto const &track : clip.tracks) {
+		if (track.times.empty()) continue;
+		if (track.times.size() != track.values.size()) {
+			throw std::runtime_error("Animation track has " + std::to_string(track.times.size()) + " key times but " + std::to_string(track.values.size()) + " key values.");
+		}
+
+		uint32_t key_begin = uint32_t(keys.time.size());
+		for (size_t k = 0; k < track.times.size(); ++k) {
+			glm::vec4 value = track.values[k];
+			//keep consecutive rotation keys in the same hemisphere so interpolation takes the short way:
+			if (track.channel == Scene::Clip::Track::Rotation && k > 0) {
+				glm::vec4 prev = glm::vec4(keys.x.back(), keys.y.back(), keys.z.back(), keys.w.back());
+				if (glm::dot(prev, value) < 0.0f) value = -value;
+			}
+			keys.time.emplace_back(track.times[k]);
+			keys.x.emplace_back(value.x);
+			keys.y.emplace_back(value.y);
+			keys.z.emplace_back(value.z);
+			keys.w.emplace_back(value.w);
+		}
+		uint32_t key_end = uint32_t(keys.time.size());
+
+		Track t{track.transform, track.channel, instance, key_begin, key_end, key_begin};
+		if (track.channel == Scene::Clip::Track::Rotation) quat_tracks.emplace_back(t);
+		else vec3_tracks.emplace_back(t);
+	}
+}
+
+void AnimationSampler::clear() {
+	instances.clear();
+	keys = Keys();
+	vec3_tracks.clear();
+	quat_tracks.clear();
+}
+
+void AnimationSampler::Lanes::resize(size_t size) {
+	for (std::vector< float > *v : {&ax, &ay, &az, &aw, &bx, &by, &bz, &bw, &t}) {
+		v->resize(size);
+	}
+}
+
+//find each track's key segment and copy its end keys into lanes:
+void AnimationSampler::gather(std::vector< Track > &tracks, Lanes *lanes_) {
+	Lanes &lanes = *lanes_;
+	lanes.resize(tracks.size());
+
+	float const *time = keys.time.data();
+	for (size_t i = 0; i < tracks.size(); ++i) {
+		Track &track = tracks[i];
+		float at = instances[track.instance].time;
+
+		//scan forward from the cached segment (restarting if time went backward, e.g. a loop wrapped):
+		uint32_t k = track.cursor;
+		if (at < time[k]) k = track.key_begin;
+		while (k + 1 < track.key_end && time[k + 1] <= at) ++k;
+		track.cursor = k;
+
+		uint32_t k1 = std::min(k + 1, track.key_end - 1);
+		float span = time[k1] - time[k];
+		float t = (span > 0.0f ? (at - time[k]) / span : 0.0f);
+
+		lanes.ax[i] = keys.x[k]; lanes.ay[i] = keys.y[k]; lanes.az[i] = keys.z[k]; lanes.aw[i] = keys.w[k];
+		lanes.bx[i] = keys.x[k1]; lanes.by[i] = keys.y[k1]; lanes.bz[i] = keys.z[k1]; lanes.bw[i] = keys.w[k1];
+		lanes.t[i] = std::max(0.0f, std::min(1.0f, t));
+	}
+}
+
+namespace {
+	//a + (b - a) * t for xyz lanes [begin,end):
+	void lerp_lanes(AnimationSampler::Lanes &l, size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			float t = l.t[i];
+			l.ax[i] += (l.bx[i] - l.ax[i]) * t;
+			l.ay[i] += (l.by[i] - l.ay[i]) * t;
+			l.az[i] += (l.bz[i] - l.az[i]) * t;
+		}
+	}
+
+	//Slerp is approximated by normalized lerp with a corrected blend factor
+	// (cubic in t, with coefficients fit as a function of the angle between the keys),
+	// which stays within ~1e-3 radians of true slerp and needs no trig or branches:
+	void slerp_lanes(AnimationSampler::Lanes &l, size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			float t = l.t[i];
+			float d = l.ax[i] * l.bx[i] + l.ay[i] * l.by[i] + l.az[i] * l.bz[i] + l.aw[i] * l.bw[i];
+			float ad = std::abs(d);
+			float A = 1.0904f + ad * (-3.2452f + ad * (3.55645f - ad * 1.43519f));
+			float B = 0.848013f + ad * (-1.06021f + ad * 0.215638f);
+			float k = A * (t - 0.5f) * (t - 0.5f) + B;
+			float ot = t + t * (t - 0.5f) * (t - 1.0f) * k;
+
+			float la = 1.0f - ot;
+			float lb = (d < 0.0f ? -ot : ot);
+			float x = la * l.ax[i] + lb * l.bx[i];
+			float y = la * l.ay[i] + lb * l.by[i];
+			float z = la * l.az[i] + lb * l.bz[i];
+			float w = la * l.aw[i] + lb * l.bw[i];
+			float inv = 1.0f / std::sqrt(x*x + y*y + z*z + w*w);
+			l.ax[i] = x * inv;
+			l.ay[i] = y * inv;
+			l.az[i] = z * inv;
+			l.aw[i] = w * inv;
+		}
+	}
+
+#ifdef ANIMATION_SSE2
+	void lerp_lanes_sse2(AnimationSampler::Lanes &l, size_t end) {
+		for (size_t i = 0; i < end; i += 4) {
+			__m128 t = _mm_loadu_ps(&l.t[i]);
+			__m128 ax = _mm_loadu_ps(&l.ax[i]), bx = _mm_loadu_ps(&l.bx[i]);
+			__m128 ay = _mm_loadu_ps(&l.ay[i]), by = _mm_loadu_ps(&l.by[i]);
+			__m128 az = _mm_loadu_ps(&l.az[i]), bz = _mm_loadu_ps(&l.bz[i]);
+			_mm_storeu_ps(&l.ax[i], _mm_add_ps(ax, _mm_mul_ps(_mm_sub_ps(bx, ax), t)));
+			_mm_storeu_ps(&l.ay[i], _mm_add_ps(ay, _mm_mul_ps(_mm_sub_ps(by, ay), t)));
+			_mm_storeu_ps(&l.az[i], _mm_add_ps(az, _mm_mul_ps(_mm_sub_ps(bz, az), t)));
+		}
+	}
+
+	void slerp_lanes_sse2(AnimationSampler::Lanes &l, size_t end) {
+		__m128 const sign_bit = _mm_set1_ps(-0.0f);
+		__m128 const one = _mm_set1_ps(1.0f);
+		__m128 const half = _mm_set1_ps(0.5f);
+		for (size_t i = 0; i < end; i += 4) {
+			__m128 t = _mm_loadu_ps(&l.t[i]);
+			__m128 ax = _mm_loadu_ps(&l.ax[i]), bx = _mm_loadu_ps(&l.bx[i]);
+			__m128 ay = _mm_loadu_ps(&l.ay[i]), by = _mm_loadu_ps(&l.by[i]);
+			__m128 az = _mm_loadu_ps(&l.az[i]), bz = _mm_loadu_ps(&l.bz[i]);
+			__m128 aw = _mm_loadu_ps(&l.aw[i]), bw = _mm_loadu_ps(&l.bw[i]);
+
+			__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_add_ps(_mm_mul_ps(az, bz), _mm_mul_ps(aw, bw)));
+			__m128 sign = _mm_and_ps(d, sign_bit);
+			__m128 ad = _mm_andnot_ps(sign_bit, d);
+
+			__m128 A = _mm_add_ps(_mm_set1_ps(1.0904f), _mm_mul_ps(ad,
+				_mm_add_ps(_mm_set1_ps(-3.2452f), _mm_mul_ps(ad,
+				_mm_sub_ps(_mm_set1_ps(3.55645f), _mm_mul_ps(ad, _mm_set1_ps(1.43519f))))))
+			);
+			__m128 B = _mm_add_ps(_mm_set1_ps(0.848013f), _mm_mul_ps(ad,
+				_mm_add_ps(_mm_set1_ps(-1.06021f), _mm_mul_ps(ad, _mm_set1_ps(0.215638f))))
+			);
+			__m128 th = _mm_sub_ps(t, half);
+			__m128 k = _mm_add_ps(_mm_mul_ps(A, _mm_mul_ps(th, th)), B);
+			__m128 ot = _mm_add_ps(t, _mm_mul_ps(_mm_mul_ps(t, th), _mm_mul_ps(_mm_sub_ps(t, one), k)));
+
+			__m128 la = _mm_sub_ps(one, ot);
+			__m128 lb = _mm_xor_ps(ot, sign);
+			__m128 x = _mm_add_ps(_mm_mul_ps(la, ax), _mm_mul_ps(lb, bx));
+			__m128 y = _mm_add_ps(_mm_mul_ps(la, ay), _mm_mul_ps(lb, by));
+			__m128 z = _mm_add_ps(_mm_mul_ps(la, az), _mm_mul_ps(lb, bz));
+			__m128 w = _mm_add_ps(_mm_mul_ps(la, aw), _mm_mul_ps(lb, bw));
+			__m128 len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_add_ps(_mm_mul_ps(z, z), _mm_mul_ps(w, w)));
+			__m128 inv = _mm_div_ps(one, _mm_sqrt_ps(len2));
+			_mm_storeu_ps(&l.ax[i], _mm_mul_ps(x, inv));
+			_mm_storeu_ps(&l.ay[i], _mm_mul_ps(y, inv));
+			_mm_storeu_ps(&l.az[i], _mm_mul_ps(z, inv));
+			_mm_storeu_ps(&l.aw[i], _mm_mul_ps(w, inv));
+		}
+	}
+#endif
+}
+
+void AnimationSampler::update(float elapsed) {
+	//advance clocks:
+	for (auto &instance : instances) {
+		instance.time += elapsed * instance.speed;
+		if (instance.loop && instance.duration > 0.0f) {
+			instance.time -= std::floor(instance.time / instance.duration) * instance.duration;
+		} else {
+			instance.time = std::max(0.0f, std::min(instance.duration, instance.time));
+		}
+	}
+
+	gather(vec3_tracks, &vec3_lanes);
+	gather(quat_tracks, &quat_lanes);
+
+	//interpolate (four lanes at a time, then any remainder):
+	size_t vec3_wide = 0, quat_wide = 0;
+#ifdef ANIMATION_SSE2
+	vec3_wide = vec3_tracks.size() & ~size_t(3);
+	quat_wide = quat_tracks.size() & ~size_t(3);
+	lerp_lanes_sse2(vec3_lanes, vec3_wide);
+	slerp_lanes_sse2(quat_lanes, quat_wide);
+#endif
+	lerp_lanes(vec3_lanes, vec3_wide, vec3_tracks.size());
+	slerp_lanes(quat_lanes, quat_wide, quat_tracks.size());
+
+	//write results:
+	for (size_t i = 0; i < vec3_tracks.size(); ++i) {
+		glm::vec3 value = glm::vec3(vec3_lanes.ax[i], vec3_lanes.ay[i], vec3_lanes.az[i]);
+		if (vec3_tracks[i].channel == Scene::Clip::Track::Position) vec3_tracks[i].transform->position = value;
+		else vec3_tracks[i].transform->scale = value;
+	}
+	for (size_t i = 0; i < quat_tracks.size(); ++i) {
+		quat_tracks[i].transform->rotation = glm::quat(quat_lanes.aw[i], quat_lanes.ax[i], quat_lanes.ay[i], quat_lanes.az[i]); //n.b. wxyz init order
+	}
+}
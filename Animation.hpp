@@ -0,0 +1,69 @@
+#pragma once
+
+/*
+ * AnimationSampler plays Scene::Clip keyframe animations, writing sampled
+ *  values straight into the position/rotation/scale of the clips' transforms.
+ *
+ * It is built to evaluate many tracks per frame:
+ *  - keys of all playing tracks are copied into shared structure-of-arrays storage;
+ *  - each track caches the key segment it last sampled, so playing forward
+ *    costs a step or two of linear scan instead of a binary search;
+ *  - all tracks are interpolated together, four at a time with SSE2 (where
+ *    available), in two batches: lerp for position/scale and an (approximate,
+ *    but branch-free) slerp for rotation.
+ *
+ * When several playing clips animate the same channel of the same transform,
+ *  the most recently played clip wins.
+ *
+ */
+
+#include "Scene.hpp"
+
+#include <vector>
+
+struct AnimationSampler {
+	//start playing a clip (the clip's tracks must outlive this sampler or the next clear()):
+	// 'speed' scales elapsed time; 'time' is the starting position in the clip (seconds)
+	void play(Scene::Clip const &clip, bool loop = true, float speed = 1.0f, float time = 0.0f);
+
+	//stop playing everything:
+	void clear();
+
+	//advance all playing clips and write sampled values to their transforms:
+	void update(float elapsed);
+
+	//-- internals ---
+	struct Instance {
+		float time;
+		float speed;
+		float duration;
+		bool loop;
+	};
+	std::vector< Instance > instances;
+
+	//keys of all tracks, structure-of-arrays (rotations use all of xyzw; position/scale ignore w):
+	struct Keys {
+		std::vector< float > time, x, y, z, w;
+	} keys;
+
+	struct Track {
+		Scene::Transform *transform;
+		Scene::Clip::Track::Channel channel;
+		uint32_t instance;
+		uint32_t key_begin, key_end; //range in 'keys'
+		uint32_t cursor; //key at the start of the segment sampled last update
+	};
+	std::vector< Track > vec3_tracks; //position and scale
+	std::vector< Track > quat_tracks; //rotation
+
+	//per-update scratch: one lane per track; a is the key before the sample time, b the key after, t the blend:
+	// (blended results are written back into the 'a' arrays)
+	struct Lanes {
+		std::vector< float > ax, ay, az, aw;
+		std::vector< float > bx, by, bz, bw;
+		std::vector< float > t;
+		void resize(size_t size);
+	} vec3_lanes, quat_lanes;
+
+	void gather(std::vector< Track > &tracks, Lanes *lanes);
+};
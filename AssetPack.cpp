@@ -0,0 +1,43 @@
+#include "AssetPack.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+AssetPack::AssetPack(std::string const &filename) : mapped(filename), file(mapped.data, mapped.size, filename) {
+	file.view("str0", &names);
+	file.view("pkd0", &directory);
+
+	auto name_of = [this](PackEntry const &entry) {
+		return std::string(names.data() + entry.name_begin, names.data() + entry.name_end);
+	};
+
+	for (size_t i = 0; i < directory.size(); ++i) {
+		PackEntry const &entry = directory[i];
+		if (!(entry.name_begin <= entry.name_end && entry.name_end <= names.size())) {
+			throw std::runtime_error("Pack '" + filename + "' has an entry with an out-of-range name.");
+		}
+		if (entry.chunk >= file.entries.size()) {
+			throw std::runtime_error("Pack '" + filename + "' has an entry with an out-of-range chunk.");
+		}
+		ChunkFile::Entry const &contents = file.entries[entry.chunk];
+		if (std::memcmp(contents.magic, "file", 4) != 0 || contents.codec != ChunkFile::Stored) {
+			throw std::runtime_error("Pack '" + filename + "' has an entry that isn't a stored file chunk.");
+		}
+		//(find() relies on the directory being sorted)
+		if (i > 0 && !(name_of(directory[i-1]) < name_of(entry))) {
+			throw std::runtime_error("Pack '" + filename + "' has an unsorted directory.");
+		}
+	}
+}
+
+ChunkFile::Entry const *AssetPack::find(std::string const &name) const {
+	auto compare = [this](PackEntry const &entry, std::string const &name) {
+		size_t length = entry.name_end - entry.name_begin;
+		int result = std::memcmp(names.data() + entry.name_begin, name.data(), std::min(length, name.size()));
+		return result < 0 || (result == 0 && length < name.size());
+	};
+	PackEntry const *found = std::lower_bound(directory.begin(), directory.end(), name, compare);
+	if (found == directory.end()) return nullptr;
+	if (std::string(names.data() + found->name_begin, names.data() + found->name_end) != name) return nullptr;
+	return &file.entries[found->chunk];
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+/*
+ * An AssetPack is a directory of files packed into one (v2, see ChunkFile.hpp) chunk file,
+ *  as built by pack-assets (see pack-assets.cpp):
+ *  str0 < char > * -- file names (relative to the packed directory, '/'-separated)
+ *  pkd0 < PackEntry > * -- name and contents chunk of each file, sorted by name
+ *  file < char > * -- contents of files, one chunk per distinct contents (files with identical
+ *    contents share a chunk), each aligned to PageSize
+ *
+ * The pack is mapped once (see MappedFile.hpp); files are found by binary search of the
+ *  directory, and their contents are slices of the mapping.
+ * DataFile (DataFile.hpp) serves the game's data files out of its pack.
+ *
+ */
+
+#include "ChunkFile.hpp"
+
+#include <string>
+#include <cstdint>
+
+struct AssetPack {
+	//open (and map) a pack:
+	// note: will throw if the file fails to open or isn't a well-formed pack.
+	AssetPack(std::string const &filename);
+
+	struct PackEntry {
+		uint32_t name_begin, name_end; //in str0
+		uint32_t chunk; //index of contents in file.entries
+		uint32_t reserved; //(zero)
+	};
+	static_assert(sizeof(PackEntry) == 4 + 4 + 4 + 4, "PackEntry is packed.");
+
+	static constexpr uint32_t PageSize = 4096;
+
+	//contents of a file, by name (nullptr if the pack doesn't have it):
+	ChunkFile::Entry const *find(std::string const &name) const;
+
+	//-- internals ---
+	MappedFile mapped;
+	ChunkFile file; //(over 'mapped')
+	ChunkView< char > names;
+	ChunkView< PackEntry > directory;
+};
@@ -0,0 +1,263 @@
+#include "ChunkFile.hpp"
+
+#include "lz4_block.hpp"
+
+#include <ostream>
+#include <algorithm>
+#include <future>
+#include <limits>
+
+namespace {
+	char const V2Magic[4] = {'c', 'h', 'k', '2'};
+
+	struct V2Header {
+		char magic[4];
+		uint32_t count;
+	};
+	static_assert(sizeof(V2Header) == 8, "V2Header is packed.");
+
+	//(same as read_write_chunk.hpp)
+	struct SequentialHeader {
+		char magic[4];
+		uint32_t size;
+	};
+	static_assert(sizeof(SequentialHeader) == 8, "SequentialHeader is packed.");
+
+	//byte shuffle: byte b of element i goes to b * count + i (any bytes after the last whole element stay put):
+	void shuffle_bytes(char const *from, size_t size, size_t element, char *to) {
+		size_t count = size / element;
+		for (size_t b = 0; b < element; ++b) {
+			for (size_t i = 0; i < count; ++i) {
+				to[b * count + i] = from[i * element + b];
+			}
+		}
+		std::memcpy(to + count * element, from + count * element, size - count * element);
+	}
+	void unshuffle_bytes(char const *from, size_t size, size_t element, char *to) {
+		size_t count = size / element;
+		for (size_t i = 0; i < count; ++i) {
+			for (size_t b = 0; b < element; ++b) {
+				to[i * element + b] = from[b * count + i];
+			}
+		}
+		std::memcpy(to + count * element, from + count * element, size - count * element);
+	}
+
+	//chunks smaller than this are decoded on the calling thread by decode_parallel:
+	constexpr uint64_t ParallelDecodeSize = 64 * 1024;
+}
+
+ChunkFile::ChunkFile(std::string const &filename) : opened(std::make_unique< DataFile >(filename)), name(filename) {
+	data = opened->data;
+	size = opened->size;
+	parse_contents();
+}
+
+ChunkFile::ChunkFile(char const *data_, size_t size_, std::string const &name_) : data(data_), size(size_), name(name_) {
+	parse_contents();
+}
+
+void ChunkFile::parse_contents() {
+	entries.clear();
+	trailing = 0;
+
+	if (size >= sizeof(V2Header) && std::memcmp(data, V2Magic, 4) == 0) {
+		sequential = false;
+
+		V2Header header;
+		std::memcpy(&header, data, sizeof(header));
+		if (header.count > (size - sizeof(V2Header)) / sizeof(Entry)) {
+			throw std::runtime_error("Chunk file '" + name + "' has a truncated table of contents.");
+		}
+		entries.resize(header.count);
+		if (header.count) std::memcpy(entries.data(), data + sizeof(V2Header), header.count * sizeof(Entry));
+
+		for (Entry const &entry : entries) {
+			if (entry.alignment < MinAlignment || (entry.alignment & (entry.alignment - 1)) != 0 || entry.offset % entry.alignment != 0) {
+				throw std::runtime_error("Chunk '" + std::string(entry.magic, 4) + "' in '" + name + "' has a bad alignment.");
+			}
+			if (entry.offset > size || entry.size > size - entry.offset) {
+				throw std::runtime_error("Chunk '" + std::string(entry.magic, 4) + "' in '" + name + "' extends past the end of the file.");
+			}
+			if (entry.codec == Stored ? (entry.raw_size != entry.size || entry.shuffle != 0) : entry.codec != LZ4) {
+				throw std::runtime_error("Chunk '" + std::string(entry.magic, 4) + "' in '" + name + "' has an unknown encoding.");
+			}
+			if (entry.raw_size > std::numeric_limits< size_t >::max()) {
+				throw std::runtime_error("Chunk '" + std::string(entry.magic, 4) + "' in '" + name + "' is too large to decode.");
+			}
+		}
+	} else {
+		sequential = true;
+
+		//walk chunk headers, skipping payloads:
+		size_t at = 0;
+		while (size - at >= sizeof(SequentialHeader)) {
+			SequentialHeader header;
+			std::memcpy(&header, data + at, sizeof(header));
+			if (header.size > size - at - sizeof(SequentialHeader)) break; //(not a whole chunk)
+
+			Entry entry;
+			std::memcpy(entry.magic, header.magic, 4);
+			entry.alignment = 1;
+			entry.offset = at + sizeof(SequentialHeader);
+			entry.size = header.size;
+			entry.raw_size = header.size;
+			entry.codec = Stored;
+			entry.shuffle = 0;
+			entry.reserved = 0;
+			entries.emplace_back(entry);
+
+			at += sizeof(SequentialHeader) + header.size;
+		}
+		trailing = size - at;
+	}
+}
+
+ChunkFile::Entry const *ChunkFile::find(std::string const &magic) const {
+	if (magic.size() != 4) return nullptr;
+	for (Entry const &entry : entries) {
+		if (std::memcmp(entry.magic, magic.data(), 4) == 0) return &entry;
+	}
+	return nullptr;
+}
+
+ChunkFile::Entry const &ChunkFile::require(std::string const &magic) const {
+	Entry const *entry = find(magic);
+	if (!entry) throw std::runtime_error("Missing chunk '" + magic + "' in '" + name + "'.");
+	return *entry;
+}
+
+void ChunkFile::decode(Entry const &entry, void *to) const {
+	if (entry.raw_size == 0) return;
+	assert(to);
+
+	if (entry.codec == Stored) {
+		std::memcpy(to, payload(entry), size_t(entry.size));
+		return;
+	}
+
+	assert(entry.codec == LZ4); //(checked by parse_contents)
+	bool ok;
+	if (entry.shuffle > 1) {
+		std::vector< char > shuffled(size_t(entry.raw_size));
+		ok = lz4_decompress(payload(entry), size_t(entry.size), shuffled.data(), shuffled.size());
+		if (ok) unshuffle_bytes(shuffled.data(), shuffled.size(), entry.shuffle, reinterpret_cast< char * >(to));
+	} else {
+		ok = lz4_decompress(payload(entry), size_t(entry.size), to, size_t(entry.raw_size));
+	}
+	if (!ok) {
+		throw std::runtime_error("Chunk '" + std::string(entry.magic, 4) + "' in '" + name + "' is corrupt (failed to decompress).");
+	}
+}
+
+void ChunkFile::decode_parallel(std::vector< Decode > const &decodes) const {
+	//large chunks go to other threads; small ones aren't worth a thread:
+	std::vector< std::future< void > > pending;
+	for (Decode const &d : decodes) {
+		assert(d.entry);
+		if (d.entry->raw_size < ParallelDecodeSize) continue;
+		pending.emplace_back(std::async(std::launch::async, [this, d]() {
+			decode(*d.entry, d.to);
+		}));
+	}
+	for (Decode const &d : decodes) {
+		if (d.entry->raw_size < ParallelDecodeSize) decode(*d.entry, d.to);
+	}
+	//(get() re-throws any exception from a decode; every future is waited on, even after the first throws)
+	std::exception_ptr error;
+	for (auto &p : pending) {
+		try {
+			p.get();
+		} catch (...) {
+			if (!error) error = std::current_exception();
+		}
+	}
+	if (error) std::rethrow_exception(error);
+}
+
+//-------------------------
+
+void ChunkFileWriter::add(std::string const &magic, void const *data, size_t size, uint32_t alignment) {
+	assert(magic.size() == 4);
+	if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+		throw std::runtime_error("Chunk '" + magic + "' has an alignment that isn't a power of two.");
+	}
+
+	chunks.emplace_back();
+	Chunk &chunk = chunks.back();
+	std::memcpy(chunk.entry.magic, magic.data(), 4);
+	chunk.entry.alignment = std::max(alignment, ChunkFile::MinAlignment);
+	chunk.entry.offset = 0;
+	chunk.entry.size = size;
+	chunk.entry.raw_size = size;
+	chunk.entry.codec = ChunkFile::Stored;
+	chunk.entry.shuffle = 0;
+	chunk.entry.reserved = 0;
+	chunk.data.assign(reinterpret_cast< char const * >(data), reinterpret_cast< char const * >(data) + size);
+}
+
+void ChunkFileWriter::add_compressed(std::string const &magic, void const *data, size_t size, uint16_t shuffle, uint32_t alignment) {
+	char const *from = reinterpret_cast< char const * >(data);
+
+	std::vector< char > shuffled;
+	if (shuffle > 1) {
+		shuffled.resize(size);
+		shuffle_bytes(from, size, shuffle, shuffled.data());
+		from = shuffled.data();
+	}
+
+	std::vector< char > compressed(lz4_compress_bound(size));
+	size_t compressed_size = lz4_compress(from, size, compressed.data());
+
+	//too big to compress, or doesn't get smaller? store as-is:
+	if (compressed_size == 0 || compressed_size >= size) {
+		add(magic, data, size, alignment);
+		return;
+	}
+
+	compressed.resize(compressed_size);
+	add(magic, compressed.data(), compressed.size(), alignment);
+	Chunk &chunk = chunks.back();
+	chunk.entry.raw_size = size;
+	chunk.entry.codec = ChunkFile::LZ4;
+	chunk.entry.shuffle = (shuffle > 1 ? shuffle : 0);
+}
+
+void ChunkFileWriter::write(std::ostream *to_) const {
+	assert(to_);
+	auto &to = *to_;
+
+	if (chunks.size() > std::numeric_limits< uint32_t >::max()) {
+		throw std::runtime_error("Too many chunks for a chunk file.");
+	}
+
+	//lay out payloads after the table of contents:
+	std::vector< ChunkFile::Entry > entries;
+	entries.reserve(chunks.size());
+	uint64_t at = sizeof(V2Header) + chunks.size() * sizeof(ChunkFile::Entry);
+	for (Chunk const &chunk : chunks) {
+		entries.emplace_back(chunk.entry);
+		ChunkFile::Entry &entry = entries.back();
+		at = (at + entry.alignment - 1) / entry.alignment * entry.alignment;
+		entry.offset = at;
+		at += entry.size;
+	}
+
+	V2Header header;
+	std::memcpy(header.magic, V2Magic, 4);
+	header.count = uint32_t(chunks.size());
+	to.write(reinterpret_cast< char const * >(&header), sizeof(header));
+	to.write(reinterpret_cast< char const * >(entries.data()), entries.size() * sizeof(ChunkFile::Entry));
+
+	at = sizeof(V2Header) + chunks.size() * sizeof(ChunkFile::Entry);
+	static char const zeros[4096] = {};
+	for (size_t i = 0; i < chunks.size(); ++i) {
+		while (at < entries[i].offset) {
+			uint64_t pad = std::min< uint64_t >(sizeof(zeros), entries[i].offset - at);
+			to.write(zeros, std::streamsize(pad));
+			at += pad;
+		}
+		to.write(chunks[i].data.data(), std::streamsize(chunks[i].data.size()));
+		at += chunks[i].data.size();
+	}
+}
@@ -0,0 +1,274 @@
+#pragma once
+
+/*
+ * ChunkFile reads chunk files by tag, in any order, without reading chunks it isn't asked for.
+ *
+ * Two formats are understood:
+ *  - sequential (read_write_chunk.hpp): chunks one after another, each an 8-byte header and payload;
+ *    the table of contents is built by walking the headers (payloads are skipped, not read).
+ *  - v2 (written by ChunkFileWriter): a table of contents up front, then payloads:
+ *    |c|h|k|2|            <-- four byte magic number
+ *    |count  |            <-- (uint32) number of chunks
+ *    Entry * count        <-- magic, alignment, offset, size, and encoding of each chunk (see ChunkFile::Entry)
+ *    ...payloads...       <-- each at its offset (from the start of the file), zero padded in between
+ *    Offsets are multiples of their chunk's alignment (a power of two, at least 16), so (uncompressed)
+ *    payloads in mapped files can be used in place as arrays of any type with that alignment or less.
+ *
+ * Chunks in v2 files may be compressed (ChunkFileWriter::add_compressed), as LZ4 blocks (lz4_block.hpp),
+ * optionally byte-shuffled first (byte k of every element stored together, which makes arrays of floats
+ * or integers far more compressible). read() and decode() undo this; decode_parallel() decodes several
+ * chunks at once, each on its own thread, straight into caller-provided memory (e.g., a mapped GL buffer).
+ *
+ * Files are memory mapped -- or, if they are in the asset pack, sliced from its mapping (see DataFile.hpp) --
+ * so only the pages of chunks that are used get read; view() gives a typed view of a chunk straight out
+ * of the mapping (no copy), and read() copies one into an array the caller owns.
+ * Tags may repeat; find() returns the first chunk with a tag, and 'entries' lists them all in file order.
+ *
+ */
+
+#include "DataFile.hpp"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+#include <iosfwd>
+#include <type_traits>
+#include <utility>
+
+//Allocator that default-initializes elements (so, for trivial types, leaves them uninitialized);
+// a vector using it can be resize()d to be filled by a decode without first being zero-filled:
+template< typename T >
+struct UninitializedAllocator : std::allocator< T > {
+	template< typename U >
+	struct rebind { using other = UninitializedAllocator< U >; };
+
+	UninitializedAllocator() = default;
+	template< typename U >
+	UninitializedAllocator(UninitializedAllocator< U > const &) noexcept { }
+
+	template< typename U >
+	void construct(U *at) noexcept(std::is_nothrow_default_constructible< U >::value) {
+		::new (static_cast< void * >(at)) U;
+	}
+	template< typename U, typename... Args >
+	void construct(U *at, Args&&... args) {
+		::new (static_cast< void * >(at)) U(std::forward< Args >(args)...);
+	}
+};
+
+//Read-only typed view of a chunk (what std::span< T const > would be, in C++20), from ChunkFile::view:
+// points into the file's mapping if the chunk can be used in place; otherwise the chunk is decoded into 'owned'.
+// (views into the mapping are only valid while their ChunkFile is)
+template< typename T >
+struct ChunkView {
+	static_assert(std::is_trivially_copyable< T >::value, "Chunks can only be viewed as arrays of trivially copyable types.");
+
+	ChunkView() = default;
+	ChunkView(ChunkView const &) = delete;
+	ChunkView &operator=(ChunkView const &) = delete;
+	ChunkView(ChunkView &&) = default;
+	ChunkView &operator=(ChunkView &&) = default;
+
+	T const *data() const { return first; }
+	size_t size() const { return count; }
+	size_t size_bytes() const { return count * sizeof(T); }
+	bool empty() const { return count == 0; }
+	T const *begin() const { return first; }
+	T const *end() const { return first + count; }
+	T const &operator[](size_t i) const { return first[i]; }
+
+	//view 'size' bytes of memory (copied into 'owned' if misaligned for T):
+	// note: will throw if size isn't divisible by sizeof(T)
+	void view_bytes(char const *bytes, size_t size) {
+		if (size % sizeof(T) != 0) {
+			throw std::runtime_error("Size of chunk not divisible by element size");
+		}
+		count = size / sizeof(T);
+		if (reinterpret_cast< uintptr_t >(bytes) % alignof(T) == 0) {
+			owned.clear();
+			first = reinterpret_cast< T const * >(bytes);
+		} else {
+			owned.resize(count);
+			if (size) std::memcpy(owned.data(), bytes, size);
+			first = owned.data();
+		}
+	}
+
+	//-- internals ---
+	T const *first = nullptr;
+	size_t count = 0;
+	std::vector< T, UninitializedAllocator< T > > owned;
+};
+
+struct ChunkFile {
+	//open (and map, or find in the asset pack) a file in either format:
+	// note: will throw if the file fails to open or its table of contents is malformed.
+	ChunkFile(std::string const &filename);
+
+	//read chunks from memory that stays valid (and unchanged) for the life of this ChunkFile:
+	// ('name' is used in error messages)
+	ChunkFile(char const *data, size_t size, std::string const &name);
+
+	ChunkFile(ChunkFile const &) = delete;
+	ChunkFile &operator=(ChunkFile const &) = delete;
+
+	//how a chunk's payload is stored:
+	enum Codec : uint16_t {
+		Stored = 0, //payload is the chunk
+		LZ4 = 1, //payload is an LZ4 block (of the chunk, byte-shuffled if 'shuffle' is set)
+	};
+
+	//table of contents entry (as stored in v2 files):
+	struct Entry {
+		char magic[4];
+		uint32_t alignment; //payload offset is a multiple of this (1 in sequential files)
+		uint64_t offset; //from start of file
+		uint64_t size; //of payload, in bytes
+		uint64_t raw_size; //of chunk (once decoded), in bytes; same as size for Stored chunks
+		uint16_t codec; //Codec
+		uint16_t shuffle; //(LZ4 only) element size bytes were shuffled by before compressing, or 0 if not shuffled
+		uint32_t reserved; //(zero)
+	};
+	static_assert(sizeof(Entry) == 4 + 4 + 8 + 8 + 8 + 2 + 2 + 4, "ChunkFile::Entry is packed.");
+
+	static constexpr uint32_t MinAlignment = 16; //(for v2 files)
+
+	std::vector< Entry > entries; //every chunk, in file order
+	bool sequential = false; //is the file in the old (read_write_chunk.hpp) format?
+	size_t trailing = 0; //(sequential files only) bytes after the last whole chunk
+
+	//find the first chunk with a tag:
+	// returns nullptr if there is no such chunk
+	Entry const *find(std::string const &magic) const;
+	//(same, but throws if there is no such chunk)
+	Entry const &require(std::string const &magic) const;
+
+	//payload of a chunk (as stored -- only the chunk itself if entry.codec is Stored):
+	char const *payload(Entry const &entry) const { return data + entry.offset; }
+
+	//decode a chunk into entry.raw_size bytes at 'to':
+	// note: will throw if a compressed chunk is corrupt
+	void decode(Entry const &entry, void *to) const;
+
+	//decode several chunks at once (larger ones each on their own thread):
+	struct Decode {
+		Entry const *entry;
+		void *to; //room for entry->raw_size bytes
+	};
+	void decode_parallel(std::vector< Decode > const &decodes) const;
+
+	//view a chunk as a read-only array of structures, in place in the file when possible:
+	// (compressed chunks -- and chunks misaligned for T, which only happens in sequential files -- are decoded into the view)
+	// note: will throw if the chunk is missing, corrupt, or its size isn't divisible by sizeof(T)
+	template< typename T >
+	void view(std::string const &magic, ChunkView< T > *to) const {
+		view(require(magic), to);
+	}
+	template< typename T >
+	void view(Entry const &entry, ChunkView< T > *to) const {
+		std::vector< Decode > decodes;
+		prepare(entry, to, &decodes);
+		for (Decode const &d : decodes) decode(*d.entry, d.to);
+	}
+
+	//copy a chunk into an array of structures (like read_chunk in read_write_chunk.hpp, but without zero-filling first):
+	// note: will throw if the chunk is missing, corrupt, or its size isn't divisible by sizeof(T)
+	template< typename T, typename A >
+	void read(std::string const &magic, std::vector< T, A > *to) const {
+		read(require(magic), to);
+	}
+	template< typename T, typename A >
+	void read(Entry const &entry, std::vector< T, A > *to) const {
+		std::vector< Decode > decodes;
+		prepare(entry, to, &decodes);
+		for (Decode const &d : decodes) decode(*d.entry, d.to);
+	}
+
+	//set up a view or array for a chunk, adding any decoding still needed to 'decodes' (for decode_parallel):
+	// note: will throw if the chunk's size isn't divisible by sizeof(T)
+	template< typename T >
+	void prepare(Entry const &entry, ChunkView< T > *to_, std::vector< Decode > *decodes) const {
+		assert(to_);
+		auto &to = *to_;
+		size_t count = element_count< T >(entry);
+		if (in_place< T >(entry)) {
+			to.owned.clear();
+			to.first = reinterpret_cast< T const * >(payload(entry));
+		} else {
+			to.owned.resize(count);
+			to.first = to.owned.data();
+			decodes->emplace_back(Decode{&entry, to.owned.data()});
+		}
+		to.count = count;
+	}
+	template< typename T, typename A >
+	void prepare(Entry const &entry, std::vector< T, A > *to_, std::vector< Decode > *decodes) const {
+		assert(to_);
+		auto &to = *to_;
+		static_assert(std::is_trivially_copyable< T >::value, "Chunks can only be read as arrays of trivially copyable types.");
+		size_t count = element_count< T >(entry);
+		if (in_place< T >(entry)) {
+			//(copy-constructing from the payload fills the array in one pass)
+			T const *from = reinterpret_cast< T const * >(payload(entry));
+			to.assign(from, from + count);
+		} else {
+			to.resize(count);
+			decodes->emplace_back(Decode{&entry, to.data()});
+		}
+	}
+	//-- internals ---
+	std::unique_ptr< DataFile > opened; //(if opened from a file)
+	char const *data = nullptr;
+	size_t size = 0;
+	std::string name;
+
+	//fill in 'entries' (and 'sequential', 'trailing') from data/size:
+	void parse_contents();
+
+	//number of T in a chunk (throws if its size isn't a multiple of sizeof(T)):
+	template< typename T >
+	size_t element_count(Entry const &entry) const {
+		if (entry.raw_size % sizeof(T) != 0) {
+			throw std::runtime_error("Size of chunk '" + std::string(entry.magic, 4) + "' in '" + name + "' not divisible by element size.");
+		}
+		return size_t(entry.raw_size / sizeof(T));
+	}
+
+	//can a chunk's payload be used directly as an array of T?
+	template< typename T >
+	bool in_place(Entry const &entry) const {
+		return entry.codec == Stored && reinterpret_cast< uintptr_t >(payload(entry)) % alignof(T) == 0;
+	}
+};
+
+//Builds a v2 chunk file (see above); chunks are written in the order they are added:
+struct ChunkFileWriter {
+	//add a chunk; 'alignment' must be a power of two (values below ChunkFile::MinAlignment are raised to it):
+	void add(std::string const &magic, void const *data, size_t size, uint32_t alignment = ChunkFile::MinAlignment);
+	template< typename T >
+	void add(std::string const &magic, std::vector< T > const &from, uint32_t alignment = ChunkFile::MinAlignment) {
+		add(magic, from.data(), from.size() * sizeof(T), alignment);
+	}
+
+	//add a chunk, LZ4 compressed (it is stored as-is if that doesn't make it smaller):
+	// 'shuffle' is the element size to byte-shuffle by first (e.g., 4 for arrays of floats or uint32s; 0 for none)
+	void add_compressed(std::string const &magic, void const *data, size_t size, uint16_t shuffle = 0, uint32_t alignment = ChunkFile::MinAlignment);
+	template< typename T >
+	void add_compressed(std::string const &magic, std::vector< T > const &from, uint16_t shuffle = 0, uint32_t alignment = ChunkFile::MinAlignment) {
+		add_compressed(magic, from.data(), from.size() * sizeof(T), shuffle, alignment);
+	}
+
+	//write header, table of contents, and (padded) payloads:
+	void write(std::ostream *to) const;
+
+	//-- internals ---
+	struct Chunk {
+		ChunkFile::Entry entry; //(offset is filled in by write)
+		std::vector< char > data;
+	};
+	std::vector< Chunk > chunks;
+};
@@ -0,0 +1,55 @@
+#include "DataFile.hpp"
+
+#include "AssetPack.hpp"
+#include "data_path.hpp"
+
+#include <fstream>
+
+DataFile::DataFile(std::string const &path) {
+	if (find_packed(path, &data, &size)) {
+		packed = true;
+		return;
+	}
+
+	if ((read = take_data_read(path))) {
+		data = (read->size ? read->data.get() : nullptr);
+		size = read->size;
+		return;
+	}
+
+	mapped = std::make_unique< MappedFile >(path);
+	data = mapped->data;
+	size = mapped->size;
+}
+
+bool DataFile::exists(std::string const &path) {
+	char const *data;
+	size_t size;
+	if (find_packed(path, &data, &size)) return true;
+	return bool(std::ifstream(path, std::ios::binary));
+}
+
+bool DataFile::find_packed(std::string const &path, char const **data, size_t *size) {
+	AssetPack const *pack = data_pack();
+	if (!pack) return false;
+
+	//packed files are named by their data_path() suffix:
+	static std::string const prefix = data_path("");
+	if (path.size() <= prefix.size() || path.compare(0, prefix.size(), prefix) != 0) return false;
+	ChunkFile::Entry const *entry = pack->find(path.substr(prefix.size()));
+	if (!entry) return false;
+
+	*size = size_t(entry->size);
+	*data = (*size ? pack->file.payload(*entry) : nullptr);
+	return true;
+}
+
+AssetPack const *data_pack() {
+	//(if opening throws, the next call tries again -- and so throws again)
+	static std::unique_ptr< AssetPack > pack = []() -> std::unique_ptr< AssetPack > {
+		std::string filename = data_path("assets.pack");
+		if (!std::ifstream(filename, std::ios::binary)) return nullptr;
+		return std::make_unique< AssetPack >(filename);
+	}();
+	return pack.get();
+}
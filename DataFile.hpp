@@ -0,0 +1,63 @@
+#pragma once
+
+/*
+ * A DataFile is the read-only contents of a file, by path -- a drop-in for reading
+ *  whatever data_path() returns:
+ *  - if the asset pack (data_path("assets.pack"), built by pack-assets) has the file, its
+ *    contents are a slice of the pack's mapping, so loading every asset costs one open and
+ *    reads sequentially through one file (see AssetPack.hpp);
+ *  - otherwise, if the file was read ahead at startup, its contents are the read's buffer
+ *    (see DataReads.hpp);
+ *  - otherwise, the file itself is mapped (see MappedFile.hpp).
+ *
+ * The pack is opened on first use and stays mapped for the life of the program.
+ * Note that a pack shadows the loose files it was built from, so rebuild (or delete)
+ *  it after changing assets.
+ *
+ */
+
+#include "MappedFile.hpp"
+#include "DataReads.hpp"
+
+#include <string>
+#include <memory>
+#include <streambuf>
+
+struct AssetPack;
+
+struct DataFile {
+	//open a file:
+	// note: will throw if the file isn't in the pack and fails to open or map.
+	DataFile(std::string const &path);
+
+	DataFile(DataFile const &) = delete;
+	DataFile &operator=(DataFile const &) = delete;
+
+	//does a file exist (in the pack or on disk)?
+	static bool exists(std::string const &path);
+
+	//is a file in the asset pack? (if so, sets *data and *size to its contents):
+	static bool find_packed(std::string const &path, char const **data, size_t *size);
+
+	//the contents of the file (nullptr if the file is empty):
+	char const *data = nullptr;
+	size_t size = 0;
+
+	bool packed = false; //is this a slice of the asset pack?
+
+	//-- internals ---
+	std::unique_ptr< DataRead > read; //(if not packed, and read ahead)
+	std::unique_ptr< MappedFile > mapped; //(if not packed or read ahead)
+};
+
+//the asset pack, or nullptr if there isn't one:
+// note: will throw if the pack exists but is malformed.
+AssetPack const *data_pack();
+
+//streambuf over memory (e.g., a DataFile's contents) for loaders that read from a std::istream:
+struct MemoryBuf : std::streambuf {
+	MemoryBuf(char const *begin, char const *end) {
+		char *b = const_cast< char * >(begin); //n.b. get area is never written through
+		setg(b, b, b + (end - begin));
+	}
+};
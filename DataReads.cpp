@@ -0,0 +1,380 @@
+#include "DataReads.hpp"
+
+#include "DataFile.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#if defined(_WIN32)
+#include <fstream>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define DATA_READS_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <cstring>
+#endif
+
+namespace {
+	struct Slot {
+		enum State {
+			Named, //waiting for start_data_reads()
+			Reading,
+			Done, //'read' holds the contents
+			Unread, //failed (or in the pack, so not read)
+			Taken, //'read' was handed out
+		} state = Named;
+		std::unique_ptr< DataRead > read;
+	};
+
+	struct Reads {
+		std::mutex mutex; //guards everything below
+		std::condition_variable finished; //notified when a slot leaves 'Reading'
+		std::map< std::string, Slot > slots; //by path
+		bool started = false;
+		std::thread reader; //(does the reading, in the background)
+
+		~Reads() {
+			if (reader.joinable()) reader.join();
+		}
+	};
+
+	//(function-local static, so ReadAhead objects at global scope can use it)
+	Reads &get_reads() {
+		static Reads reads;
+		return reads;
+	}
+
+	//a file being read:
+	struct Request {
+		std::string const *path;
+		Slot *slot;
+		std::unique_ptr< DataRead > read;
+		size_t done = 0; //bytes read so far
+		bool finished = false; //handed to 'slot' yet? (only touched by the reading thread)
+		#if !defined(_WIN32)
+		int fd = -1;
+		#endif
+	};
+
+	//hand a request's result to its slot (and so to anyone waiting in take_data_read()):
+	void finish(Request &request, bool succeeded) {
+		#if !defined(_WIN32)
+		if (request.fd != -1) {
+			close(request.fd);
+			request.fd = -1;
+		}
+		#endif
+		request.finished = true;
+		Reads &reads = get_reads();
+		{
+			std::unique_lock< std::mutex > lock(reads.mutex);
+			request.slot->state = (succeeded ? Slot::Done : Slot::Unread);
+			if (succeeded) request.slot->read = std::move(request.read);
+		}
+		reads.finished.notify_all();
+	}
+
+	//open a file and allocate its buffer (false if it can't be opened):
+	bool open_request(Request &request) {
+		#if defined(_WIN32)
+		return true; //(opened by read_blocking)
+		#else
+		request.fd = open(request.path->c_str(), O_RDONLY | O_CLOEXEC);
+		if (request.fd == -1) return false;
+		struct stat st;
+		if (fstat(request.fd, &st) != 0) return false;
+		request.read = std::make_unique< DataRead >();
+		request.read->size = size_t(st.st_size);
+		request.read->data.reset(new char[request.read->size]); //(uninitialized -- about to be overwritten)
+		return true;
+		#endif
+	}
+
+	//read the rest of a file with blocking calls:
+	bool read_blocking(Request &request) {
+		#if defined(_WIN32)
+		std::ifstream file(*request.path, std::ios::binary | std::ios::ate);
+		if (!file) return false;
+		request.read = std::make_unique< DataRead >();
+		request.read->size = size_t(file.tellg());
+		request.read->data.reset(new char[request.read->size]);
+		file.seekg(0);
+		return bool(file.read(request.read->data.get(), request.read->size));
+		#else
+		while (request.done < request.read->size) {
+			ssize_t got = pread(request.fd, request.read->data.get() + request.done, request.read->size - request.done, off_t(request.done));
+			if (got < 0 && errno == EINTR) continue;
+			if (got <= 0) return false; //(error, or the file got shorter)
+			request.done += size_t(got);
+		}
+		return true;
+		#endif
+	}
+
+	//fallback: read files with blocking calls on a few threads:
+	void read_with_threads(std::vector< Request > &requests) {
+		std::atomic< size_t > next(0);
+		auto worker = [&]() {
+			for (size_t i = next++; i < requests.size(); i = next++) {
+				finish(requests[i], read_blocking(requests[i]));
+			}
+		};
+
+		//(files are mostly in the page cache or on an SSD, so a few reads in flight are plenty)
+		size_t count = std::min< size_t >(std::clamp(std::thread::hardware_concurrency(), 2u, 8u), requests.size());
+		std::vector< std::thread > pool;
+		for (size_t i = 1; i < count; ++i) {
+			pool.emplace_back(worker);
+		}
+		worker();
+		for (auto &thread : pool) {
+			thread.join();
+		}
+	}
+
+	#if defined(DATA_READS_IO_URING)
+	//io_uring, set up with raw system calls (since liburing isn't a dependency):
+	struct Ring {
+		~Ring() {
+			if (sqes) munmap(sqes, sqes_size);
+			if (cq_ring && cq_ring != sq_ring) munmap(cq_ring, cq_ring_size);
+			if (sq_ring) munmap(sq_ring, sq_ring_size);
+			if (fd != -1) close(fd);
+		}
+
+		//false if the kernel doesn't support io_uring (or it is disabled):
+		bool setup(unsigned entries) {
+			std::memset(&params, 0, sizeof(params));
+			fd = int(syscall(__NR_io_uring_setup, entries, &params));
+			if (fd < 0) {
+				fd = -1;
+				return false;
+			}
+
+			sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+			cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+			if (params.features & IORING_FEAT_SINGLE_MMAP) {
+				sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+			}
+			sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+
+			auto map = [this](size_t size, off_t offset) -> char * {
+				void *ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+				return (ptr == MAP_FAILED ? nullptr : reinterpret_cast< char * >(ptr));
+			};
+			sq_ring = map(sq_ring_size, IORING_OFF_SQ_RING);
+			if (!sq_ring) return false;
+			if (params.features & IORING_FEAT_SINGLE_MMAP) {
+				cq_ring = sq_ring;
+			} else {
+				cq_ring = map(cq_ring_size, IORING_OFF_CQ_RING);
+				if (!cq_ring) return false;
+			}
+			char *sqes_ptr = map(sqes_size, IORING_OFF_SQES);
+			if (!sqes_ptr) return false;
+			sqes = reinterpret_cast< io_uring_sqe * >(sqes_ptr);
+			return true;
+		}
+
+		unsigned *sq(uint32_t offset) { return reinterpret_cast< unsigned * >(sq_ring + offset); }
+		unsigned *cq(uint32_t offset) { return reinterpret_cast< unsigned * >(cq_ring + offset); }
+
+		int fd = -1;
+		io_uring_params params;
+		char *sq_ring = nullptr, *cq_ring = nullptr;
+		io_uring_sqe *sqes = nullptr;
+		size_t sq_ring_size = 0, cq_ring_size = 0, sqes_size = 0;
+	};
+
+	//read files with io_uring -- every read is submitted at once (as far as the ring has room),
+	// and each file is finished as soon as its read completes:
+	//returns false (having read nothing) if io_uring can't be used.
+	bool read_with_io_uring(std::vector< Request > &requests) {
+		Ring ring;
+		if (!ring.setup(unsigned(std::min< size_t >(requests.size(), 256)))) return false;
+
+		unsigned *sq_head = ring.sq(ring.params.sq_off.head);
+		unsigned *sq_tail = ring.sq(ring.params.sq_off.tail);
+		unsigned sq_mask = *ring.sq(ring.params.sq_off.ring_mask);
+		unsigned *sq_array = ring.sq(ring.params.sq_off.array);
+		unsigned *cq_head = ring.cq(ring.params.cq_off.head);
+		unsigned *cq_tail = ring.cq(ring.params.cq_off.tail);
+		unsigned cq_mask = *ring.cq(ring.params.cq_off.ring_mask);
+		io_uring_cqe *cqes = reinterpret_cast< io_uring_cqe * >(ring.cq_ring + ring.params.cq_off.cqes);
+
+		std::deque< size_t > to_submit; //requests with more to read
+		for (size_t i = 0; i < requests.size(); ++i) {
+			if (requests[i].read->size == 0) finish(requests[i], true);
+			else to_submit.emplace_back(i);
+		}
+
+		unsigned in_flight = 0; //queued in the ring, but not completed
+
+		//handle completed reads:
+		auto reap = [&]() {
+			unsigned head = *cq_head;
+			unsigned end = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+			for (; head != end; ++head) {
+				io_uring_cqe const &cqe = cqes[head & cq_mask];
+				size_t index = size_t(cqe.user_data);
+				Request &request = requests[index];
+				--in_flight;
+				if (cqe.res > 0) {
+					request.done += size_t(cqe.res);
+					if (request.done < request.read->size) to_submit.emplace_back(index); //(short read)
+					else finish(request, true);
+				} else if (cqe.res == -EINTR || cqe.res == -EAGAIN) {
+					to_submit.emplace_back(index);
+				} else if (cqe.res == 0) {
+					finish(request, false); //(the file got shorter)
+				} else {
+					//e.g., kernels before 5.6 don't have IORING_OP_READ:
+					finish(request, read_blocking(request));
+				}
+			}
+			__atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+		};
+
+		while (!to_submit.empty() || in_flight > 0) {
+			//queue reads for the rest of each file, as far as there is room:
+			unsigned tail = *sq_tail;
+			while (!to_submit.empty() && in_flight < ring.params.sq_entries) {
+				Request &request = requests[to_submit.front()];
+				io_uring_sqe &sqe = ring.sqes[tail & sq_mask];
+				std::memset(&sqe, 0, sizeof(sqe));
+				sqe.opcode = IORING_OP_READ;
+				sqe.fd = request.fd;
+				sqe.addr = uint64_t(reinterpret_cast< uintptr_t >(request.read->data.get() + request.done));
+				sqe.len = uint32_t(std::min< size_t >(request.read->size - request.done, size_t(1) << 30));
+				sqe.off = uint64_t(request.done);
+				sqe.user_data = uint64_t(to_submit.front());
+				sq_array[tail & sq_mask] = tail & sq_mask;
+				++tail;
+				++in_flight;
+				to_submit.pop_front();
+			}
+			__atomic_store_n(sq_tail, tail, __ATOMIC_RELEASE);
+
+			//submit (anything the kernel hasn't taken yet) and wait for at least one read to complete:
+			unsigned unsubmitted = tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+			if (syscall(__NR_io_uring_enter, ring.fd, unsubmitted, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0
+			 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+				std::cerr << "WARNING: io_uring_enter failed (" << std::strerror(errno) << "); reading remaining data files with pread." << std::endl;
+
+				//reads the kernel has taken still write into their buffers, so wait for them to complete:
+				// (completions are posted to the ring without io_uring_enter; reads it hasn't taken never start, since the ring is closed without submitting them)
+				unsigned untaken = tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+				while (in_flight > untaken) {
+					reap();
+					if (in_flight > untaken) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				}
+
+				//...then read whatever is left of each file with pread:
+				std::vector< Request > rest;
+				for (auto &request : requests) {
+					if (!request.finished) rest.emplace_back(std::move(request));
+				}
+				read_with_threads(rest);
+				return true;
+			}
+
+			reap();
+		}
+		return true;
+	}
+	#endif //DATA_READS_IO_URING
+
+	void read_all(std::vector< Request > requests) {
+		//files in the pack are already mapped, so just ask for their pages:
+		std::vector< Request > loose;
+		for (auto &request : requests) {
+			char const *data = nullptr;
+			size_t size = 0;
+			bool packed = false;
+			try {
+				packed = DataFile::find_packed(*request.path, &data, &size);
+			} catch (std::exception &) {
+				//(a bad pack is reported when a loader opens it)
+			}
+			if (packed) {
+				#if !defined(_WIN32)
+				if (size) {
+					uintptr_t page = uintptr_t(sysconf(_SC_PAGESIZE));
+					uintptr_t begin = reinterpret_cast< uintptr_t >(data) / page * page;
+					madvise(reinterpret_cast< void * >(begin), reinterpret_cast< uintptr_t >(data) + size - begin, MADV_WILLNEED);
+				}
+				#endif
+				finish(request, false);
+			} else if (open_request(request)) {
+				loose.emplace_back(std::move(request));
+			} else {
+				finish(request, false);
+			}
+		}
+		if (loose.empty()) return;
+
+		#if defined(DATA_READS_IO_URING)
+		if (read_with_io_uring(loose)) return;
+		#endif
+		read_with_threads(loose);
+	}
+}
+
+ReadAhead::ReadAhead(std::vector< std::string > const &paths) {
+	Reads &reads = get_reads();
+	std::unique_lock< std::mutex > lock(reads.mutex);
+	if (reads.started) {
+		throw std::runtime_error("ReadAhead constructed after start_data_reads().");
+	}
+	for (auto const &path : paths) {
+		reads.slots.emplace(path, Slot());
+	}
+}
+
+void start_data_reads() {
+	Reads &reads = get_reads();
+	std::unique_lock< std::mutex > lock(reads.mutex);
+	if (reads.started) {
+		throw std::runtime_error("start_data_reads() called more than once.");
+	}
+	reads.started = true;
+
+	std::vector< Request > requests;
+	for (auto &[path, slot] : reads.slots) {
+		slot.state = Slot::Reading;
+		requests.emplace_back();
+		requests.back().path = &path;
+		requests.back().slot = &slot;
+	}
+	if (requests.empty()) return;
+
+	reads.reader = std::thread(read_all, std::move(requests));
+}
+
+std::unique_ptr< DataRead > take_data_read(std::string const &path) {
+	Reads &reads = get_reads();
+	std::unique_lock< std::mutex > lock(reads.mutex);
+	auto f = reads.slots.find(path);
+	if (f == reads.slots.end()) return nullptr;
+	Slot &slot = f->second;
+	reads.finished.wait(lock, [&](){ return slot.state != Slot::Reading; });
+	if (slot.state != Slot::Done) return nullptr;
+	slot.state = Slot::Taken;
+	return std::move(slot.read);
+}
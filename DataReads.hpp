@@ -0,0 +1,43 @@
+#pragma once
+
+/*
+ * Batched reads of the data files that loaders will open, so that startup's disk reads
+ *  overlap each other (and window setup, and parsing) instead of happening one at a
+ *  time inside each loader:
+ *  - files are named by ReadAhead objects at global scope, next to the Load<>s that use them;
+ *  - main() calls start_data_reads() early, which reads every named file at once -- on Linux
+ *    as one io_uring batch; elsewhere (or where io_uring isn't available) with a few threads
+ *    calling pread();
+ *  - when a loader opens a named file, DataFile (DataFile.hpp) takes its read buffer, waiting
+ *    only for that file's read if it is still in flight.
+ *
+ * Files in the asset pack aren't copied into buffers: the pack is already mapped, so their
+ *  slices of it are just advised as needed soon (and the kernel reads them ahead).
+ * If a read fails, DataFile opens the file as usual (and so reports the error).
+ *
+ */
+
+#include <memory>
+#include <string>
+#include <vector>
+
+//name files to read (paths as returned by data_path()):
+// (only construct *before* "start_data_reads()" -- i.e., at global scope)
+struct ReadAhead {
+	ReadAhead(std::vector< std::string > const &paths);
+};
+
+//Start reading every named file in the background:
+// (called once, by main())
+void start_data_reads();
+
+//the contents of a file that was read ahead:
+struct DataRead {
+	std::unique_ptr< char[] > data;
+	size_t size = 0;
+};
+
+//take the contents of a named file, waiting for its read to finish if needed:
+// returns nullptr if the file wasn't named, reads weren't started, the read failed, or the
+// contents were already taken (each read is handed out once).
+std::unique_ptr< DataRead > take_data_read(std::string const &path);
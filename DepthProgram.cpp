@@ -0,0 +1,62 @@
+#include "DepthProgram.hpp"
+
+#include "gl_compile_program.hpp"
+#include "gl_errors.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+
+Scene::Drawable::Pipeline depth_program_pipeline;
+
+Load< DepthProgram > depth_program(LoadOnGLThread, {}, []() -> DepthProgram const * {
+	DepthProgram *ret = new DepthProgram();
+
+	depth_program_pipeline.program = ret->program;
+
+	depth_program_pipeline.OBJECT_TO_CLIP_mat4 = ret->OBJECT_TO_CLIP_mat4;
+	depth_program_pipeline.POSITION_DEQUANTIZE_mat4x3 = ret->POSITION_DEQUANTIZE_mat4x3;
+
+	return ret;
+});
+
+DepthProgram::DepthProgram() {
+	//Compile vertex and fragment shaders using the convenient 'gl_compile_program' helper function:
+	program = gl_compile_program(
+		//vertex shader:
+		// (computes gl_Position exactly as LitColorTextureProgram does -- and both declare it invariant -- so a
+		//  later GL_LEQUAL pass over the same geometry lands on the same depths)
+		"#version 330\n"
+		"uniform mat4 OBJECT_TO_CLIP;\n"
+		"uniform mat4x3 POSITION_DEQUANTIZE;\n" //identity unless mesh is quantized
+		"in vec4 Position;\n"
+		"invariant gl_Position;\n"
+		"void main() {\n"
+		"	vec4 p = vec4(POSITION_DEQUANTIZE * Position, 1.0);\n"
+		"	gl_Position = OBJECT_TO_CLIP * p;\n"
+		"}\n"
+	,
+		//fragment shader:
+		// (color writes are expected to be off; depth is written by fixed function)
+		"#version 330\n"
+		"out vec4 fragColor;\n"
+		"void main() {\n"
+		"	fragColor = vec4(0.0);\n"
+		"}\n"
+	);
+
+	//look up the locations of vertex attributes:
+	Position_vec4 = glGetAttribLocation(program, "Position");
+
+	//look up the locations of uniforms:
+	OBJECT_TO_CLIP_mat4 = glGetUniformLocation(program, "OBJECT_TO_CLIP");
+	POSITION_DEQUANTIZE_mat4x3 = glGetUniformLocation(program, "POSITION_DEQUANTIZE");
+
+	//default to unquantized vertices (Scene::draw sets this per drawable):
+	glUseProgram(program);
+	glUniformMatrix4x3fv(POSITION_DEQUANTIZE_mat4x3, 1, GL_FALSE, glm::value_ptr(glm::mat4x3(1.0f)));
+	glUseProgram(0);
+}
+
+DepthProgram::~DepthProgram() {
+	glDeleteProgram(program);
+	program = 0;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "GL.hpp"
+#include "Load.hpp"
+#include "Scene.hpp"
+
+//Shader program that only writes depth (reads nothing but Position), for depth prepasses and shadow maps:
+// (vertex arrays made for it by MeshBuffer::make_vao_for_program read the buffer's packed position stream)
+struct DepthProgram {
+	DepthProgram();
+	~DepthProgram();
+
+	GLuint program = 0;
+
+	//Attribute (per-vertex variable) locations:
+	GLuint Position_vec4 = -1U;
+
+	//Uniform (per-invocation variable) locations:
+	GLuint OBJECT_TO_CLIP_mat4 = -1U;
+	GLuint POSITION_DEQUANTIZE_mat4x3 = -1U; //see MeshBuffer::quantized
+
+	//Textures:
+	// none
+};
+
+extern Load< DepthProgram > depth_program;
+
+//For Scene::depth_prepass (drawables need a Pipeline::depth_vao made for depth_program->program):
+extern Scene::Drawable::Pipeline depth_program_pipeline;
@@ -12,7 +12,7 @@
 static GLuint vertex_buffer = 0;
 static GLuint vertex_buffer_for_color_program = 0;
 
-static Load< void > setup_buffers(LoadTagDefault, [](){
+static Load< void > setup_buffers(LoadOnGLThread, {&color_program}, [](){
 	//you may recognize this init code from DrawSprites.cpp:
 
 	{ //set up vertex buffer:
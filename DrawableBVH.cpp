@@ -0,0 +1,446 @@
+#include "DrawableBVH.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <queue>
+#include <utility>
+
+//-------------------------
+//helpers:
+
+static DrawableBVH::AABB combine(DrawableBVH::AABB const &a, DrawableBVH::AABB const &b) {
+	return DrawableBVH::AABB(glm::min(a.min, b.min), glm::max(a.max, b.max));
+}
+
+//(half) surface area; used as the insertion cost heuristic:
+static float area(DrawableBVH::AABB const &a) {
+	glm::vec3 d = a.max - a.min;
+	return d.x * d.y + d.y * d.z + d.z * d.x;
+}
+
+//queries walk the tree with a stack that starts out this size (and moves to the heap if a tree is ever deeper):
+static constexpr uint32_t MaxStack = 128;
+
+DrawableBVH::AABB DrawableBVH::world_bounds(Scene::Drawable const &drawable) {
+	AABB local(drawable.min, drawable.max);
+	if (local.empty()) return AABB();
+	assert(drawable.transform);
+
+	//transform center and extents (Arvo's method):
+	glm::mat4x3 to_world = drawable.transform->make_local_to_world();
+	glm::vec3 center = 0.5f * (local.max + local.min);
+	glm::vec3 extent = 0.5f * (local.max - local.min);
+	glm::vec3 world_center = to_world * glm::vec4(center, 1.0f);
+	glm::vec3 world_extent =
+		  glm::abs(to_world[0]) * extent.x
+		+ glm::abs(to_world[1]) * extent.y
+		+ glm::abs(to_world[2]) * extent.z;
+	return AABB(world_center - world_extent, world_center + world_extent);
+}
+
+//-------------------------
+//tree maintenance:
+
+void DrawableBVH::build(Scene const &scene) {
+	clear();
+	for (auto const &drawable : scene.drawables) {
+		insert(&drawable);
+	}
+}
+
+void DrawableBVH::clear() {
+	nodes.clear();
+	root = -1U;
+	free_list = -1U;
+	leaves.clear();
+}
+
+void DrawableBVH::insert(Scene::Drawable const *drawable) {
+	assert(drawable);
+	if (leaves.count(drawable)) return;
+
+	AABB tight = world_bounds(*drawable);
+	if (tight.empty()) return;
+
+	uint32_t leaf = allocate_node();
+	nodes[leaf].tight = tight;
+	nodes[leaf].box = AABB(tight.min - glm::vec3(margin), tight.max + glm::vec3(margin));
+	nodes[leaf].drawable = drawable;
+	nodes[leaf].height = 0;
+	insert_leaf(leaf);
+
+	leaves.emplace(drawable, leaf);
+}
+
+void DrawableBVH::remove(Scene::Drawable const *drawable) {
+	auto f = leaves.find(drawable);
+	if (f == leaves.end()) return;
+	remove_leaf(f->second);
+	free_node(f->second);
+	leaves.erase(f);
+}
+
+void DrawableBVH::update() {
+	for (auto const &[drawable, leaf] : leaves) {
+		Node &node = nodes[leaf];
+		node.tight = world_bounds(*drawable);
+		if (node.box.contains(node.tight)) continue;
+
+		//moved out of fat box, so re-insert:
+		remove_leaf(leaf);
+		nodes[leaf].box = AABB(nodes[leaf].tight.min - glm::vec3(margin), nodes[leaf].tight.max + glm::vec3(margin));
+		insert_leaf(leaf);
+	}
+}
+
+uint32_t DrawableBVH::allocate_node() {
+	if (free_list == -1U) {
+		nodes.emplace_back();
+		return uint32_t(nodes.size() - 1);
+	}
+	uint32_t index = free_list;
+	free_list = nodes[index].parent;
+	nodes[index] = Node();
+	return index;
+}
+
+void DrawableBVH::free_node(uint32_t index) {
+	nodes[index] = Node();
+	nodes[index].height = -1;
+	nodes[index].parent = free_list;
+	free_list = index;
+}
+
+void DrawableBVH::insert_leaf(uint32_t leaf) {
+	if (root == -1U) {
+		root = leaf;
+		nodes[root].parent = -1U;
+		return;
+	}
+
+	//find the best sibling, descending by the area cost of the new parent (as per Box2D's dynamic tree):
+	AABB const leaf_box = nodes[leaf].box;
+	uint32_t index = root;
+	while (!nodes[index].is_leaf()) {
+		uint32_t c0 = nodes[index].child[0];
+		uint32_t c1 = nodes[index].child[1];
+
+		float node_area = area(nodes[index].box);
+		float combined_area = area(combine(nodes[index].box, leaf_box));
+
+		//cost of making a new parent for this node and the leaf:
+		float cost = 2.0f * combined_area;
+		//minimum cost of pushing the leaf further down the tree:
+		float inheritance_cost = 2.0f * (combined_area - node_area);
+
+		auto descend_cost = [&](uint32_t c) {
+			float combined = area(combine(leaf_box, nodes[c].box));
+			if (nodes[c].is_leaf()) return combined + inheritance_cost;
+			return (combined - area(nodes[c].box)) + inheritance_cost;
+		};
+		float cost0 = descend_cost(c0);
+		float cost1 = descend_cost(c1);
+
+		if (cost < cost0 && cost < cost1) break;
+		index = (cost0 < cost1 ? c0 : c1);
+	}
+	uint32_t sibling = index;
+
+	//make a new parent for sibling + leaf:
+	uint32_t old_parent = nodes[sibling].parent;
+	uint32_t new_parent = allocate_node();
+	nodes[new_parent].parent = old_parent;
+	nodes[new_parent].box = combine(leaf_box, nodes[sibling].box);
+	nodes[new_parent].height = nodes[sibling].height + 1;
+	nodes[new_parent].child[0] = sibling;
+	nodes[new_parent].child[1] = leaf;
+	nodes[sibling].parent = new_parent;
+	nodes[leaf].parent = new_parent;
+
+	if (old_parent != -1U) {
+		if (nodes[old_parent].child[0] == sibling) nodes[old_parent].child[0] = new_parent;
+		else nodes[old_parent].child[1] = new_parent;
+	} else {
+		root = new_parent;
+	}
+
+	fix_upward(nodes[leaf].parent);
+}
+
+void DrawableBVH::remove_leaf(uint32_t leaf) {
+	if (leaf == root) {
+		root = -1U;
+		return;
+	}
+
+	uint32_t parent = nodes[leaf].parent;
+	uint32_t grandparent = nodes[parent].parent;
+	uint32_t sibling = (nodes[parent].child[0] == leaf ? nodes[parent].child[1] : nodes[parent].child[0]);
+
+	if (grandparent != -1U) {
+		//attach sibling in place of parent:
+		if (nodes[grandparent].child[0] == parent) nodes[grandparent].child[0] = sibling;
+		else nodes[grandparent].child[1] = sibling;
+		nodes[sibling].parent = grandparent;
+		free_node(parent);
+		fix_upward(grandparent);
+	} else {
+		root = sibling;
+		nodes[sibling].parent = -1U;
+		free_node(parent);
+	}
+	nodes[leaf].parent = -1U;
+}
+
+void DrawableBVH::fix_upward(uint32_t index) {
+	while (index != -1U) {
+		index = balance(index);
+
+		Node &node = nodes[index];
+		Node const &c0 = nodes[node.child[0]];
+		Node const &c1 = nodes[node.child[1]];
+		node.height = 1 + std::max(c0.height, c1.height);
+		node.box = combine(c0.box, c1.box);
+
+		index = node.parent;
+	}
+}
+
+//if the subtree at index is unbalanced, rotate the taller child up; returns the subtree's new root:
+uint32_t DrawableBVH::balance(uint32_t iA) {
+	Node &A = nodes[iA];
+	if (A.is_leaf() || A.height < 2) return iA;
+
+	uint32_t iB = A.child[0];
+	uint32_t iC = A.child[1];
+	Node &B = nodes[iB];
+	Node &C = nodes[iC];
+
+	int32_t imbalance = C.height - B.height;
+
+	//replace A with X in A's parent (or as root):
+	auto replace_in_parent = [&](uint32_t iX) {
+		Node &X = nodes[iX];
+		X.parent = A.parent;
+		A.parent = iX;
+		if (X.parent != -1U) {
+			if (nodes[X.parent].child[0] == iA) nodes[X.parent].child[0] = iX;
+			else nodes[X.parent].child[1] = iX;
+		} else {
+			root = iX;
+		}
+	};
+
+	if (imbalance > 1) {
+		//rotate C up:
+		uint32_t iF = C.child[0];
+		uint32_t iG = C.child[1];
+		Node &F = nodes[iF];
+		Node &G = nodes[iG];
+
+		C.child[0] = iA;
+		replace_in_parent(iC);
+
+		if (F.height > G.height) {
+			C.child[1] = iF;
+			A.child[1] = iG;
+			G.parent = iA;
+			A.box = combine(B.box, G.box);
+			C.box = combine(A.box, F.box);
+			A.height = 1 + std::max(B.height, G.height);
+			C.height = 1 + std::max(A.height, F.height);
+		} else {
+			C.child[1] = iG;
+			A.child[1] = iF;
+			F.parent = iA;
+			A.box = combine(B.box, F.box);
+			C.box = combine(A.box, G.box);
+			A.height = 1 + std::max(B.height, F.height);
+			C.height = 1 + std::max(A.height, G.height);
+		}
+		return iC;
+	}
+
+	if (imbalance < -1) {
+		//rotate B up:
+		uint32_t iD = B.child[0];
+		uint32_t iE = B.child[1];
+		Node &D = nodes[iD];
+		Node &E = nodes[iE];
+
+		B.child[0] = iA;
+		replace_in_parent(iB);
+
+		if (D.height > E.height) {
+			B.child[1] = iD;
+			A.child[0] = iE;
+			E.parent = iA;
+			A.box = combine(C.box, E.box);
+			B.box = combine(A.box, D.box);
+			A.height = 1 + std::max(C.height, E.height);
+			B.height = 1 + std::max(A.height, D.height);
+		} else {
+			B.child[1] = iE;
+			A.child[0] = iD;
+			D.parent = iA;
+			A.box = combine(C.box, D.box);
+			B.box = combine(A.box, E.box);
+			A.height = 1 + std::max(C.height, D.height);
+			B.height = 1 + std::max(A.height, E.height);
+		}
+		return iB;
+	}
+
+	return iA;
+}
+
+//-------------------------
+//queries:
+
+//walk all nodes for which 'test(box)' is true, calling 'leaf(node)' on leaves:
+template< typename Test, typename Leaf >
+static void walk(std::vector< DrawableBVH::Node > const &nodes, uint32_t root, Test const &test, Leaf const &leaf) {
+	if (root == -1U) return;
+	uint32_t fixed[MaxStack];
+	std::vector< uint32_t > grown;
+	uint32_t *stack = fixed;
+	uint32_t capacity = MaxStack;
+	uint32_t top = 0;
+	stack[top++] = root;
+	while (top > 0) {
+		DrawableBVH::Node const &node = nodes[stack[--top]];
+		if (!test(node.box)) continue;
+		if (node.is_leaf()) {
+			leaf(node);
+		} else {
+			if (top + 2 > capacity) {
+				if (grown.empty()) grown.assign(stack, stack + top);
+				grown.resize(2 * capacity);
+				stack = grown.data();
+				capacity = uint32_t(grown.size());
+			}
+			stack[top++] = node.child[0];
+			stack[top++] = node.child[1];
+		}
+	}
+}
+
+void DrawableBVH::query_aabb(AABB const &box, std::vector< Scene::Drawable const * > *out) const {
+	assert(out);
+	walk(nodes, root,
+		[&box](AABB const &b) { return b.overlaps(box); },
+		[&box,out](Node const &n) { if (n.tight.overlaps(box)) out->emplace_back(n.drawable); }
+	);
+}
+
+void DrawableBVH::query_sphere(glm::vec3 const &center, float radius, std::vector< Scene::Drawable const * > *out) const {
+	assert(out);
+	float radius2 = radius * radius;
+	walk(nodes, root,
+		[&](AABB const &b) { return b.distance2(center) <= radius2; },
+		[&](Node const &n) { if (n.tight.distance2(center) <= radius2) out->emplace_back(n.drawable); }
+	);
+}
+
+void DrawableBVH::query_nearest(glm::vec3 const &point, uint32_t k, std::vector< Scene::Drawable const * > *out) const {
+	assert(out);
+	if (root == -1U || k == 0) return;
+
+	//best-first search over nodes (min-heap by box distance):
+	typedef std::pair< float, uint32_t > Entry;
+	std::priority_queue< Entry, std::vector< Entry >, std::greater< Entry > > todo;
+	//k best leaves so far (max-heap by distance, so the worst is on top):
+	std::priority_queue< Entry > best;
+
+	todo.emplace(nodes[root].box.distance2(point), root);
+	while (!todo.empty()) {
+		auto [dis2, index] = todo.top();
+		todo.pop();
+		if (best.size() == k && dis2 > best.top().first) break; //nothing left can be closer
+
+		Node const &node = nodes[index];
+		if (node.is_leaf()) {
+			best.emplace(node.tight.distance2(point), index);
+			if (best.size() > k) best.pop();
+		} else {
+			todo.emplace(nodes[node.child[0]].box.distance2(point), node.child[0]);
+			todo.emplace(nodes[node.child[1]].box.distance2(point), node.child[1]);
+		}
+	}
+
+	size_t first = out->size();
+	out->resize(first + best.size());
+	for (size_t i = out->size(); i > first; --i) {
+		(*out)[i-1] = nodes[best.top().second].drawable;
+		best.pop();
+	}
+}
+
+bool DrawableBVH::query_ray(glm::vec3 const &origin, glm::vec3 const &direction, float max_t, Scene::Drawable const **hit_, float *t_) const {
+	assert(hit_);
+	assert(t_);
+
+	glm::vec3 inv_dir = 1.0f / direction;
+
+	//ray parameter at which box is entered (or +inf if missed):
+	auto enter = [&](AABB const &b) {
+		glm::vec3 t0 = (b.min - origin) * inv_dir;
+		glm::vec3 t1 = (b.max - origin) * inv_dir;
+		glm::vec3 lo = glm::min(t0, t1);
+		glm::vec3 hi = glm::max(t0, t1);
+		float t_enter = std::max(std::max(lo.x, lo.y), std::max(lo.z, 0.0f));
+		float t_exit = std::min(std::min(hi.x, hi.y), std::min(hi.z, max_t));
+		return (t_enter <= t_exit ? t_enter : std::numeric_limits< float >::infinity());
+	};
+
+	Scene::Drawable const *hit = nullptr;
+	float best = std::numeric_limits< float >::infinity();
+	walk(nodes, root,
+		[&](AABB const &b) { return enter(b) < best; },
+		[&](Node const &n) {
+			float t = enter(n.tight);
+			if (t < best) {
+				best = t;
+				hit = n.drawable;
+			}
+		}
+	);
+
+	if (!hit) return false;
+	*hit_ = hit;
+	*t_ = best;
+	return true;
+}
+
+void DrawableBVH::query_frustum(glm::mat4 const &world_to_clip, std::vector< Scene::Drawable const * > *out) const {
+	assert(out);
+
+	//frustum planes from the rows of the clip matrix (Gribb & Hartmann); inside is dot(plane, (p,1)) >= 0:
+	glm::vec4 rows[4];
+	for (uint32_t r = 0; r < 4; ++r) {
+		rows[r] = glm::vec4(world_to_clip[0][r], world_to_clip[1][r], world_to_clip[2][r], world_to_clip[3][r]);
+	}
+	glm::vec4 planes[6] = {
+		rows[3] + rows[0], rows[3] - rows[0],
+		rows[3] + rows[1], rows[3] - rows[1],
+		rows[3] + rows[2], rows[3] - rows[2],
+	};
+
+	auto visible = [&planes](AABB const &b) {
+		for (auto const &p : planes) {
+			//test the corner furthest along the plane normal:
+			glm::vec3 corner(
+				p.x >= 0.0f ? b.max.x : b.min.x,
+				p.y >= 0.0f ? b.max.y : b.min.y,
+				p.z >= 0.0f ? b.max.z : b.min.z
+			);
+			if (glm::dot(glm::vec3(p), corner) + p.w < 0.0f) return false;
+		}
+		return true;
+	};
+
+	walk(nodes, root,
+		visible,
+		[&](Node const &n) { if (visible(n.tight)) out->emplace_back(n.drawable); }
+	);
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+/*
+ * DrawableBVH is a dynamic bounding volume hierarchy over the world-space
+ *  bounding boxes of a Scene's drawables (see Scene::Drawable::min/max).
+ *
+ * It is useful for gameplay checks ("what is near the player?") and for
+ *  culling ("what might be on screen?") without testing every drawable.
+ *  (Scene::draw uses one for frustum culling -- see Scene::bvh.)
+ *
+ * Leaves store slightly enlarged ("fat") boxes, so small motions don't
+ *  change the tree; update() only re-inserts drawables that moved out of
+ *  their fat box. Insertion keeps the tree balanced with AVL-style rotations.
+ *
+ * Drawables without bounds (min > max) are not tracked.
+ *
+ */
+
+#include "Scene.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <unordered_map>
+#include <limits>
+
+struct DrawableBVH {
+	struct AABB {
+		glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+		glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+
+		AABB() = default;
+		AABB(glm::vec3 const &min_, glm::vec3 const &max_) : min(min_), max(max_) { }
+
+		bool empty() const { return !(min.x <= max.x && min.y <= max.y && min.z <= max.z); }
+		bool overlaps(AABB const &o) const {
+			return min.x <= o.max.x && o.min.x <= max.x
+			    && min.y <= o.max.y && o.min.y <= max.y
+			    && min.z <= o.max.z && o.min.z <= max.z;
+		}
+		bool contains(AABB const &o) const {
+			return min.x <= o.min.x && min.y <= o.min.y && min.z <= o.min.z
+			    && o.max.x <= max.x && o.max.y <= max.y && o.max.z <= max.z;
+		}
+		//squared distance from a point to the box (zero if inside):
+		float distance2(glm::vec3 const &pt) const {
+			glm::vec3 d = glm::max(glm::max(min - pt, pt - max), glm::vec3(0.0f));
+			return glm::dot(d, d);
+		}
+	};
+
+	//world-space box of a drawable's local bounds (empty if the drawable has none):
+	static AABB world_bounds(Scene::Drawable const &drawable);
+
+	//amount leaf boxes are enlarged by (in world units) to absorb small motions:
+	float margin = 0.1f;
+
+	//track every drawable (with bounds) in a scene:
+	// note: drawables are tracked by pointer, so must not be removed from the scene while tracked.
+	void build(Scene const &scene);
+
+	//recompute world bounds of tracked drawables, re-inserting any that left their fat box:
+	// (call after moving transforms)
+	void update();
+
+	//track / stop tracking individual drawables:
+	void insert(Scene::Drawable const *drawable);
+	void remove(Scene::Drawable const *drawable);
+	void clear();
+
+	//is a drawable tracked?
+	bool tracks(Scene::Drawable const *drawable) const { return leaves.count(drawable) != 0; }
+
+	//----- queries -----
+	//(results are appended to *out; tests are against each drawable's exact world box)
+
+	//drawables whose world box overlaps 'box':
+	void query_aabb(AABB const &box, std::vector< Scene::Drawable const * > *out) const;
+
+	//drawables whose world box overlaps a sphere:
+	void query_sphere(glm::vec3 const &center, float radius, std::vector< Scene::Drawable const * > *out) const;
+
+	//(up to) k drawables closest to 'point' (by distance to world box), nearest first:
+	void query_nearest(glm::vec3 const &point, uint32_t k, std::vector< Scene::Drawable const * > *out) const;
+
+	//first drawable world box hit by the ray origin + t * direction, for t in [0, max_t]:
+	// returns false if nothing was hit; otherwise sets *hit and *t
+	bool query_ray(glm::vec3 const &origin, glm::vec3 const &direction, float max_t, Scene::Drawable const **hit, float *t) const;
+
+	//drawables whose world box is (at least partly) inside the view frustum of 'world_to_clip':
+	// (useful for render culling)
+	void query_frustum(glm::mat4 const &world_to_clip, std::vector< Scene::Drawable const * > *out) const;
+
+	//-- internals ---
+	struct Node {
+		AABB box; //fat box for leaves; union of children for internal nodes
+		AABB tight; //(leaves only) exact world box of drawable
+		uint32_t parent = -1U;
+		uint32_t child[2] = {-1U, -1U}; //leaves have child[0] == -1U
+		int32_t height = 0; //leaves are height 0; -1 marks free nodes
+		Scene::Drawable const *drawable = nullptr;
+		bool is_leaf() const { return child[0] == -1U; }
+	};
+	std::vector< Node > nodes;
+	uint32_t root = -1U;
+	uint32_t free_list = -1U; //free nodes are chained through 'parent'
+	std::unordered_map< Scene::Drawable const *, uint32_t > leaves;
+
+	uint32_t allocate_node();
+	void free_node(uint32_t index);
+	void insert_leaf(uint32_t leaf);
+	void remove_leaf(uint32_t leaf);
+	uint32_t balance(uint32_t index);
+	void fix_upward(uint32_t index);
+};
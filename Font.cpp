@@ -15,7 +15,6 @@ Font::Font(std::string const &font_path, int font_size, unsigned int width, unsi
     this->width = width;
     this->height = height;
 
-    const char *fontfile = font_path.c_str();
     FT_Error ft_error;
 
     /* Initialize FreeType and create FreeType font face. */
@@ -23,7 +22,14 @@ Font::Font(std::string const &font_path, int font_size, unsigned int width, unsi
         std::cerr << "Error initializing FreeType library" << std::endl;
         abort();
     }
-    if ((ft_error = FT_New_Face (ft_library, fontfile, 0, &ft_face))) {
+    /* Font file may be in the asset pack (see DataFile.hpp). */
+    try {
+        font_file = std::make_unique<DataFile>(font_path);
+    } catch (std::exception &e) {
+        std::cerr << "Error opening font file: " << font_path << " (" << e.what() << ")" << std::endl;
+        abort();
+    }
+    if ((ft_error = FT_New_Memory_Face (ft_library, reinterpret_cast<FT_Byte const *>(font_file->data), FT_Long(font_file->size), 0, &ft_face))) {
         std::cerr << "Error loading font file: " << font_path << std::endl;
         abort();
     }
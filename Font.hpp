@@ -15,10 +15,13 @@
 #include <hb.h>
 #include <hb-ft.h>
 
+#include "DataFile.hpp"
+
 #include <iostream>
 #include <string>
 #include <vector>
 #include <map>
+#include <memory>
 
 struct Text {
     std::string text;
@@ -59,6 +62,7 @@ struct Font {
 
     glm::u8vec3 color = glm::u8vec3(0);
 
+    std::unique_ptr<DataFile> font_file; //(FreeType reads the face from this for as long as it is open)
     FT_Library ft_library;
     FT_Face ft_face;
     hb_font_t *hb_font;
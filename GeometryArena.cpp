@@ -0,0 +1,179 @@
+#include "GeometryArena.hpp"
+
+#include "gl_errors.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <cassert>
+
+namespace {
+	//buffers with the same attribs (and quantization) can share vertex arrays:
+	bool same_attrib(MeshBuffer::Attrib const &a, MeshBuffer::Attrib const &b) {
+		return a.size == b.size && a.type == b.type && a.normalized == b.normalized
+			&& a.stride == b.stride && a.offset == b.offset && a.decode_uniform == b.decode_uniform;
+	}
+	bool same_format(MeshBuffer const &a, MeshBuffer const &b) {
+		return a.quantized == b.quantized
+			&& same_attrib(a.Position, b.Position)
+			&& same_attrib(a.Normal, b.Normal)
+			&& same_attrib(a.Color, b.Color)
+			&& same_attrib(a.TexCoord, b.TexCoord)
+			&& same_attrib(a.PackedPosition, b.PackedPosition);
+	}
+
+	//copy the first 'used' bytes of '*name' to a new buffer of 'capacity' bytes, replacing '*name':
+	void grow_buffer(GLuint *name, size_t used, size_t capacity) {
+		GLuint bigger = 0;
+		glGenBuffers(1, &bigger);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, bigger);
+		glBufferData(GL_COPY_WRITE_BUFFER, capacity, nullptr, GL_STATIC_DRAW);
+		if (used) {
+			glBindBuffer(GL_COPY_READ_BUFFER, *name);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, used);
+			glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		}
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		if (*name) glDeleteBuffers(1, name);
+		*name = bigger;
+	}
+}
+
+GeometryArena::~GeometryArena() {
+	//members don't delete their (shared) buffers, but clear them anyway so nothing dangles:
+	for (auto &buffer : buffers) {
+		buffer->buffer = 0;
+		buffer->position_buffer = 0;
+		buffer->index_buffer = 0;
+	}
+	buffers.clear();
+	formats.clear(); //(shared buffers delete their buffers and vertex arrays)
+}
+
+MeshBuffer const &GeometryArena::load(std::string const &filename) {
+	auto ret = std::make_unique< MeshBuffer >();
+	MeshBuffer::Staged staged;
+	ret->parse(filename, &staged);
+
+	//find (or make) storage for this vertex format:
+	Format *format = nullptr;
+	for (auto &f : formats) {
+		if (same_format(*f.shared, *ret)) {
+			format = &f;
+			break;
+		}
+	}
+	if (!format) {
+		formats.emplace_back();
+		format = &formats.back();
+		format->shared = std::make_unique< MeshBuffer >();
+		MeshBuffer &shared = *format->shared;
+		shared.quantized = ret->quantized;
+		shared.Position = ret->Position;
+		shared.Normal = ret->Normal;
+		shared.Color = ret->Color;
+		shared.TexCoord = ret->TexCoord;
+		shared.PackedPosition = ret->PackedPosition;
+		//(all buffers are always made, so vertex arrays can be made before any indexed file is loaded)
+		glGenBuffers(1, &shared.buffer);
+		glGenBuffers(1, &shared.position_buffer);
+		glGenBuffers(1, &shared.index_buffer);
+		shared.index_type = GL_UNSIGNED_INT;
+	}
+	MeshBuffer &shared = *format->shared;
+
+	size_t stride = size_t(ret->Position.stride);
+	assert(stride != 0 && format->vertex_bytes % stride == 0);
+	size_t packed_stride = size_t(ret->PackedPosition.stride);
+	if (ret->total_vertices != staged.vertices.size() / stride || ret->total_vertices != staged.positions.size() / packed_stride) {
+		throw std::runtime_error("Mesh file '" + filename + "' has a vertex count that doesn't match its data.");
+	}
+	if (format->vertex_bytes / stride + ret->total_vertices > size_t(std::numeric_limits< GLuint >::max())) {
+		throw std::runtime_error("GeometryArena can't fit '" + filename + "' (too many vertices).");
+	}
+
+	size_t index_count = (ret->index_type ? ret->indices.size() : 0);
+	reserve(*format, staged.vertices.size(), index_count);
+
+	ret->vertex_base = GLuint(format->vertex_bytes / stride);
+	ret->index_base = GLuint(format->index_count);
+
+	//append vertices:
+	glBindBuffer(GL_COPY_WRITE_BUFFER, shared.buffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, format->vertex_bytes, staged.vertices.size(), staged.vertices.data());
+	format->vertex_bytes += staged.vertices.size();
+
+	//append packed positions (at the same vertex index):
+	glBindBuffer(GL_COPY_WRITE_BUFFER, shared.position_buffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, size_t(ret->vertex_base) * packed_stride, staged.positions.size(), staged.positions.data());
+
+	//append indices, rebased to the shared vertex buffer:
+	if (index_count) {
+		std::vector< uint32_t > rebased(ret->indices);
+		for (auto &i : rebased) i += ret->vertex_base;
+		glBindBuffer(GL_COPY_WRITE_BUFFER, shared.index_buffer);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, format->index_count * sizeof(uint32_t), rebased.size() * sizeof(uint32_t), rebased.data());
+		format->index_count += index_count;
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	//point meshes at their place in the shared buffers:
+	auto rebase = [&ret](GLenum index_type, GLuint *start) {
+		*start += (index_type ? ret->index_base : ret->vertex_base);
+	};
+	for (Mesh &mesh : ret->meshes) {
+		rebase(mesh.index_type, &mesh.start);
+		if (mesh.index_type) mesh.index_type = GL_UNSIGNED_INT;
+	}
+	for (auto &chain : ret->lods) {
+		for (Mesh &mesh : chain) {
+			rebase(mesh.index_type, &mesh.start);
+			if (mesh.index_type) mesh.index_type = GL_UNSIGNED_INT;
+		}
+	}
+	if (ret->index_type) ret->index_type = GL_UNSIGNED_INT;
+
+	ret->shared = &shared;
+	ret->buffer = shared.buffer;
+	ret->position_buffer = shared.position_buffer;
+	ret->index_buffer = (ret->index_type ? shared.index_buffer : 0);
+
+	GL_ERRORS();
+
+	format->members.emplace_back(ret.get());
+	buffers.emplace_back(std::move(ret));
+	return *buffers.back();
+}
+
+void GeometryArena::reserve(Format &format, size_t vertex_bytes, size_t index_count) {
+	MeshBuffer &shared = *format.shared;
+	bool moved = false;
+
+	//grow by doubling (from 1MB of vertices and 256k indices), so adding files stays linear overall:
+	if (format.vertex_bytes + vertex_bytes > format.vertex_capacity) {
+		size_t capacity = std::max(format.vertex_bytes + vertex_bytes, std::max< size_t >(2 * format.vertex_capacity, 1 << 20));
+		grow_buffer(&shared.buffer, format.vertex_bytes, capacity);
+		format.vertex_capacity = capacity;
+		//(the packed position buffer holds the same vertices, so grows along with it)
+		size_t stride = size_t(shared.Position.stride), packed_stride = size_t(shared.PackedPosition.stride);
+		grow_buffer(&shared.position_buffer, format.vertex_bytes / stride * packed_stride, capacity / stride * packed_stride);
+		moved = true;
+	}
+	if (format.index_count + index_count > format.index_capacity) {
+		size_t capacity = std::max(format.index_count + index_count, std::max< size_t >(2 * format.index_capacity, 1 << 18));
+		grow_buffer(&shared.index_buffer, format.index_count * sizeof(uint32_t), capacity * sizeof(uint32_t));
+		format.index_capacity = capacity;
+		moved = true;
+	}
+	if (!moved) return;
+
+	//update everything that refers to the old buffers:
+	for (MeshBuffer *member : format.members) {
+		member->buffer = shared.buffer;
+		member->position_buffer = shared.position_buffer;
+		if (member->index_buffer) member->index_buffer = shared.index_buffer;
+	}
+	for (auto const &[layout, vao] : shared.vaos) {
+		shared.bind_vao(vao, layout);
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+/*
+ * GeometryArena loads several .pnct files into shared OpenGL buffers: one vertex
+ *  buffer, one packed position buffer, and one index buffer per vertex format
+ *  (float or quantized, see Mesh.hpp).
+ *
+ * Each file still gets its own MeshBuffer (for lookup(), lookup_lods(), positions, ...),
+ *  but its 'shared' pointer refers to the format's MeshBuffer, which owns the buffers:
+ *  - mesh starts are offsets into the shared buffers (vertex_base / index_base are added at load);
+ *  - indices are rebased to the shared vertex buffer and always GL_UNSIGNED_INT;
+ *  - make_vao_for_program returns the format's vertex array, so drawables from
+ *    different files use the same one (and Scene::draw can gather them into multi-draws).
+ *
+ * Shared buffers grow (by copying to a larger buffer) as files are added; vertex
+ *  arrays from make_vao_for_program are re-pointed when this happens, so stay valid.
+ *
+ */
+
+#include "Mesh.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+struct GeometryArena {
+	GeometryArena() = default;
+	~GeometryArena();
+
+	GeometryArena(GeometryArena const &) = delete;
+	GeometryArena &operator=(GeometryArena const &) = delete;
+
+	//read a mesh file into the arena:
+	// note: the returned MeshBuffer belongs to the arena
+	// note: will throw if file fails to read.
+	MeshBuffer const &load(std::string const &filename);
+
+	//-- internals ---
+
+	//one per vertex format:
+	struct Format {
+		std::unique_ptr< MeshBuffer > shared; //attribs, buffers, and vertex arrays (no meshes)
+		size_t vertex_bytes = 0, vertex_capacity = 0; //bytes used / allocated in shared->buffer (shared->position_buffer holds as many vertices)
+		size_t index_count = 0, index_capacity = 0; //indices used / allocated in shared->index_buffer
+		std::vector< MeshBuffer * > members; //files stored in this format
+	};
+	std::vector< Format > formats;
+
+	std::vector< std::unique_ptr< MeshBuffer > > buffers; //one per loaded file
+
+	//make sure 'format' has room for 'vertex_bytes' more vertex data and 'index_count' more indices:
+	void reserve(Format &format, size_t vertex_bytes, size_t index_count);
+};
@@ -0,0 +1,189 @@
+#include "LightClusters.hpp"
+
+#include "gl_errors.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+LightClusters::LightClusters() {
+	for (Buffer *b : {&lights_tb, &clusters_tb, &indices_tb}) {
+		glGenBuffers(1, &b->buffer);
+		glGenTextures(1, &b->texture);
+	}
+
+	//attach each buffer to its texture (formats match the layouts described in the header):
+	auto attach = [](Buffer const &b, GLenum format) {
+		glBindBuffer(GL_TEXTURE_BUFFER, b.buffer);
+		glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW); //(non-empty placeholder until first update)
+		glBindTexture(GL_TEXTURE_BUFFER, b.texture);
+		glTexBuffer(GL_TEXTURE_BUFFER, format, b.buffer);
+	};
+	attach(lights_tb, GL_RGBA32F);
+	attach(clusters_tb, GL_RG32UI);
+	attach(indices_tb, GL_R32UI);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	GL_ERRORS();
+}
+
+LightClusters::~LightClusters() {
+	for (Buffer *b : {&lights_tb, &clusters_tb, &indices_tb}) {
+		glDeleteTextures(1, &b->texture);
+		b->texture = 0;
+		glDeleteBuffers(1, &b->buffer);
+		b->buffer = 0;
+	}
+}
+
+void LightClusters::update(Scene const &scene, Scene::Camera const &camera, glm::uvec2 const &drawable_size) {
+	assert(camera.transform);
+	assert(grid.x > 0 && grid.y > 0 && grid.z > 0);
+
+	glm::mat4x3 world_to_view = camera.transform->make_world_to_local();
+
+	//view depth (distance along the camera's -z axis) of a world position:
+	depth_row = -glm::vec4(world_to_view[0][2], world_to_view[1][2], world_to_view[2][2], world_to_view[3][2]);
+
+	//ndc = view.xy * scale / depth (as in the infinite perspective projection Camera::make_projection builds):
+	float scale_y = 1.0f / std::tan(0.5f * camera.fovy);
+	glm::vec2 proj_scale = glm::vec2(scale_y / camera.aspect, scale_y);
+
+	float near = camera.near;
+	float far_ = std::max(far, near * 2.0f);
+	float slice_scale = float(grid.z) / std::log(far_ / near);
+	slice_scale_bias = glm::vec2(slice_scale, -std::log(near) * slice_scale);
+	tile_scale = glm::vec2(grid.x, grid.y) / glm::max(glm::vec2(drawable_size), glm::vec2(1.0f));
+
+	auto slice = [&](float depth) -> uint32_t {
+		if (depth <= near) return 0;
+		float s = std::log(depth) * slice_scale_bias.x + slice_scale_bias.y;
+		return uint32_t(std::min(s, float(grid.z - 1)));
+	};
+
+	//------ build light list (global lights first) ------
+	light_data.clear();
+	binned.clear();
+
+	auto append = [this](Scene::Light const &light, float type, float range) {
+		glm::mat4x3 to_world = light.transform->make_local_to_world();
+		glm::vec3 position = to_world[3];
+		glm::vec3 direction = -glm::normalize(to_world[2]);
+		float cutoff = std::cos(0.5f * light.spot_fov);
+		light_data.emplace_back(position, type);
+		light_data.emplace_back(direction, cutoff);
+		light_data.emplace_back(light.energy, range);
+	};
+
+	for (auto const &light : scene.lights) {
+		if (light.type == Scene::Light::Hemisphere) append(light, 1.0f, 0.0f);
+		else if (light.type == Scene::Light::Directional) append(light, 3.0f, 0.0f);
+	}
+	global_count = GLint(light_data.size() / TexelsPerLight);
+
+	for (auto const &light : scene.lights) {
+		if (light.type != Scene::Light::Point && light.type != Scene::Light::Spot) continue;
+
+		float peak = std::max(light.energy.r, std::max(light.energy.g, light.energy.b));
+		if (!(peak > 0.0f)) continue;
+		//shader attenuation is energy / max(1, distance^2), windowed to reach zero at range:
+		float range = std::sqrt(std::max(1.0f, peak / min_intensity));
+
+		glm::vec3 position = light.transform->make_local_to_world()[3];
+		glm::vec3 view = world_to_view * glm::vec4(position, 1.0f);
+		float depth = -view.z;
+		if (depth + range <= near) continue; //entirely behind the camera
+
+		//conservative screen bounds of the light's view-space bounding box:
+		float z_min = std::max(depth - range, near);
+		float z_max = depth + range;
+		glm::vec2 lo = glm::vec2( std::numeric_limits< float >::infinity());
+		glm::vec2 hi = glm::vec2(-std::numeric_limits< float >::infinity());
+		for (float z : {z_min, z_max}) {
+			for (float s : {-range, range}) {
+				glm::vec2 ndc = (glm::vec2(view.x, view.y) + glm::vec2(s)) * proj_scale / z;
+				lo = glm::min(lo, ndc);
+				hi = glm::max(hi, ndc);
+			}
+		}
+		if (hi.x < -1.0f || hi.y < -1.0f || lo.x > 1.0f || lo.y > 1.0f) continue; //off screen
+
+		auto tile = [](float ndc, uint32_t count) -> uint32_t {
+			float t = (glm::clamp(ndc, -1.0f, 1.0f) * 0.5f + 0.5f) * float(count);
+			return std::min(uint32_t(t), count - 1);
+		};
+
+		Binned b;
+		b.light = uint32_t(light_data.size() / TexelsPerLight);
+		b.min = glm::uvec3(tile(lo.x, grid.x), tile(lo.y, grid.y), slice(z_min));
+		b.max = glm::uvec3(tile(hi.x, grid.x), tile(hi.y, grid.y), slice(z_max));
+		binned.emplace_back(b);
+
+		append(light, (light.type == Scene::Light::Spot ? 2.0f : 0.0f), range);
+	}
+
+	//------ bin into clusters (count, prefix sum, fill) ------
+	cluster_data.assign(size_t(grid.x) * grid.y * grid.z, glm::uvec2(0));
+	auto cluster = [this](uint32_t x, uint32_t y, uint32_t z) -> glm::uvec2 & {
+		return cluster_data[(size_t(z) * grid.y + y) * grid.x + x];
+	};
+	auto for_each_cluster = [&](Binned const &b, auto &&fn) {
+		for (uint32_t z = b.min.z; z <= b.max.z; ++z) {
+			for (uint32_t y = b.min.y; y <= b.max.y; ++y) {
+				for (uint32_t x = b.min.x; x <= b.max.x; ++x) {
+					fn(cluster(x, y, z));
+				}
+			}
+		}
+	};
+
+	for (auto const &b : binned) {
+		for_each_cluster(b, [](glm::uvec2 &c) { c.y += 1; });
+	}
+	uint32_t total = 0;
+	for (auto &c : cluster_data) {
+		c.x = total;
+		total += c.y;
+		c.y = 0; //(re-counted during fill)
+	}
+	index_data.resize(std::max(total, 1u));
+	for (auto const &b : binned) {
+		for_each_cluster(b, [&](glm::uvec2 &c) {
+			index_data[c.x + c.y] = b.light;
+			c.y += 1;
+		});
+	}
+
+	//------ upload ------
+	if (light_data.empty()) light_data.emplace_back(0.0f); //(texture buffers shouldn't be empty)
+
+	auto upload = [](Buffer const &b, void const *data, size_t size) {
+		glBindBuffer(GL_TEXTURE_BUFFER, b.buffer);
+		glBufferData(GL_TEXTURE_BUFFER, size, nullptr, GL_STREAM_DRAW); //orphan last frame's storage
+		glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+	};
+	upload(lights_tb, light_data.data(), light_data.size() * sizeof(light_data[0]));
+	upload(clusters_tb, cluster_data.data(), cluster_data.size() * sizeof(cluster_data[0]));
+	upload(indices_tb, index_data.data(), index_data.size() * sizeof(index_data[0]));
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	GL_ERRORS();
+}
+
+void LightClusters::bind(GLuint first_unit) const {
+	GLuint unit = first_unit;
+	for (Buffer const *b : {&lights_tb, &clusters_tb, &indices_tb}) {
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glBindTexture(GL_TEXTURE_BUFFER, b->texture);
+		++unit;
+	}
+	glActiveTexture(GL_TEXTURE0);
+}
+
+void LightClusters::unbind(GLuint first_unit) const {
+	for (GLuint unit = first_unit; unit < first_unit + 3; ++unit) {
+		glActiveTexture(GL_TEXTURE0 + unit);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+	}
+	glActiveTexture(GL_TEXTURE0);
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+/*
+ * LightClusters bins a Scene's lights into a view-space "froxel" grid
+ *  (screen tiles x exponentially-spaced depth slices) for clustered forward shading.
+ *
+ * Each frame, call update() with the scene and camera; it uploads:
+ *  - a light list (three RGBA32F texels per light; see below),
+ *  - a cluster table (RG32UI: first index, count for each cluster),
+ *  - a light index list (R32UI: light numbers, grouped by cluster),
+ * as texture buffers, so a fragment shader only evaluates the lights that
+ *  can reach its cluster (see LitColorTextureProgram).
+ *
+ * Hemisphere and directional lights reach everything; they are stored at the
+ *  start of the light list (global_count of them) and are not binned.
+ *
+ * Point and spot lights are given a finite range -- the distance at which
+ *  their brightest channel falls to min_intensity -- and are binned as spheres.
+ *
+ */
+
+#include "GL.hpp"
+#include "Scene.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+struct LightClusters {
+	LightClusters();
+	~LightClusters();
+
+	LightClusters(LightClusters const &) = delete;
+	LightClusters &operator=(LightClusters const &) = delete;
+
+	//froxel grid size:
+	glm::uvec3 grid = glm::uvec3(16, 9, 24);
+	//depth slices run from camera near plane to 'far' (the last slice also covers everything beyond):
+	float far = 100.0f;
+	//point and spot lights are cut off where their intensity falls to this:
+	float min_intensity = 1.0f / 128.0f;
+
+	//bin lights for viewing from 'camera' into a viewport of size 'drawable_size' and upload results:
+	void update(Scene const &scene, Scene::Camera const &camera, glm::uvec2 const &drawable_size);
+
+	//bind the lights, clusters, and light indices texture buffers to texture units first_unit, first_unit+1, first_unit+2:
+	void bind(GLuint first_unit) const;
+	void unbind(GLuint first_unit) const;
+
+	//----- results of update() (for setting shader uniforms) -----
+	GLint global_count = 0; //number of hemisphere/directional lights at the start of the light list
+	glm::vec4 depth_row = glm::vec4(0.0f); //dot(depth_row, vec4(world position, 1)) is view depth
+	glm::vec2 tile_scale = glm::vec2(0.0f); //gl_FragCoord.xy * tile_scale is tile x,y
+	glm::vec2 slice_scale_bias = glm::vec2(0.0f); //log(view depth) * scale + bias is depth slice
+
+	//light list layout (texels per light):
+	// [0] = vec4(world position, type)  -- type is 0: point, 1: hemisphere, 2: spot, 3: directional
+	// [1] = vec4(world direction, spot cutoff cosine)
+	// [2] = vec4(energy, range)
+	enum : uint32_t { TexelsPerLight = 3 };
+
+	//-- internals ---
+	struct Buffer {
+		GLuint buffer = 0;
+		GLuint texture = 0;
+	};
+	Buffer lights_tb, clusters_tb, indices_tb;
+
+	//scratch space, kept between frames to avoid reallocation:
+	std::vector< glm::vec4 > light_data;
+	std::vector< glm::uvec2 > cluster_data;
+	std::vector< uint32_t > index_data;
+	struct Binned {
+		uint32_t light;
+		glm::uvec3 min, max; //inclusive cluster range
+	};
+	std::vector< Binned > binned;
+};
@@ -3,9 +3,11 @@
 #include "gl_compile_program.hpp"
 #include "gl_errors.hpp"
 
+#include <glm/gtc/type_ptr.hpp>
+
 Scene::Drawable::Pipeline lit_color_texture_program_pipeline;
 
-Load< LitColorTextureProgram > lit_color_texture_program(LoadTagEarly, []() -> LitColorTextureProgram const * {
+Load< LitColorTextureProgram > lit_color_texture_program(LoadOnGLThread, {}, []() -> LitColorTextureProgram const * {
 	LitColorTextureProgram *ret = new LitColorTextureProgram();
 
 	//----- build the pipeline template -----
@@ -14,14 +16,8 @@ Load< LitColorTextureProgram > lit_color_texture_program(LoadTagEarly, []() -> L
 	lit_color_texture_program_pipeline.OBJECT_TO_CLIP_mat4 = ret->OBJECT_TO_CLIP_mat4;
 	lit_color_texture_program_pipeline.OBJECT_TO_LIGHT_mat4x3 = ret->OBJECT_TO_LIGHT_mat4x3;
 	lit_color_texture_program_pipeline.NORMAL_TO_LIGHT_mat3 = ret->NORMAL_TO_LIGHT_mat3;
-
-	/* This will be used later if/when we build a light loop into the Scene:
-	lit_color_texture_program_pipeline.LIGHT_TYPE_int = ret->LIGHT_TYPE_int;
-	lit_color_texture_program_pipeline.LIGHT_LOCATION_vec3 = ret->LIGHT_LOCATION_vec3;
-	lit_color_texture_program_pipeline.LIGHT_DIRECTION_vec3 = ret->LIGHT_DIRECTION_vec3;
-	lit_color_texture_program_pipeline.LIGHT_ENERGY_vec3 = ret->LIGHT_ENERGY_vec3;
-	lit_color_texture_program_pipeline.LIGHT_CUTOFF_float = ret->LIGHT_CUTOFF_float;
-	*/
+	lit_color_texture_program_pipeline.POSITION_DEQUANTIZE_mat4x3 = ret->POSITION_DEQUANTIZE_mat4x3;
+	lit_color_texture_program_pipeline.NORMAL_OCTAHEDRAL_bool = ret->NORMAL_OCTAHEDRAL_bool;
 
 	//make a 1-pixel white texture to bind by default:
 	GLuint tex;
@@ -51,6 +47,8 @@ LitColorTextureProgram::LitColorTextureProgram() {
 		"uniform mat4 OBJECT_TO_CLIP;\n"
 		"uniform mat4x3 OBJECT_TO_LIGHT;\n"
 		"uniform mat3 NORMAL_TO_LIGHT;\n"
+		"uniform mat4x3 POSITION_DEQUANTIZE;\n" //identity unless mesh is quantized
+		"uniform bool NORMAL_OCTAHEDRAL;\n" //if set, Normal.xy is an octahedral encoding
 		"in vec4 Position;\n"
 		"in vec3 Normal;\n"
 		"in vec4 Color;\n"
@@ -59,48 +57,71 @@ LitColorTextureProgram::LitColorTextureProgram() {
 		"out vec3 normal;\n"
 		"out vec4 color;\n"
 		"out vec2 texCoord;\n"
+		"invariant gl_Position;\n" //(so depth matches DepthProgram's, for Scene::depth_prepass)
+		"vec3 octahedral_decode(vec2 e) {\n"
+		"	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));\n"
+		"	if (n.z < 0.0) n.xy = (1.0 - abs(e.yx)) * vec2(e.x >= 0.0 ? 1.0 : -1.0, e.y >= 0.0 ? 1.0 : -1.0);\n"
+		"	return normalize(n);\n"
+		"}\n"
 		"void main() {\n"
-		"	gl_Position = OBJECT_TO_CLIP * Position;\n"
-		"	position = OBJECT_TO_LIGHT * Position;\n"
-		"	normal = NORMAL_TO_LIGHT * Normal;\n"
+		"	vec4 p = vec4(POSITION_DEQUANTIZE * Position, 1.0);\n"
+		"	gl_Position = OBJECT_TO_CLIP * p;\n"
+		"	position = OBJECT_TO_LIGHT * p;\n"
+		"	normal = NORMAL_TO_LIGHT * (NORMAL_OCTAHEDRAL ? octahedral_decode(Normal.xy) : Normal);\n"
 		"	color = Color;\n"
 		"	texCoord = TexCoord;\n"
 		"}\n"
 	,
 		//fragment shader:
+		// (lights come from LightClusters: global lights first, then the ones binned into this fragment's cluster)
 		"#version 330\n"
 		"uniform sampler2D TEX;\n"
-		"uniform int LIGHT_TYPE;\n"
-		"uniform vec3 LIGHT_LOCATION;\n"
-		"uniform vec3 LIGHT_DIRECTION;\n"
-		"uniform vec3 LIGHT_ENERGY;\n"
-		"uniform float LIGHT_CUTOFF;\n"
+		"uniform samplerBuffer LIGHTS;\n"
+		"uniform usamplerBuffer CLUSTERS;\n"
+		"uniform usamplerBuffer LIGHT_INDICES;\n"
+		"uniform int GLOBAL_LIGHTS;\n"
+		"uniform ivec3 CLUSTER_GRID;\n"
+		"uniform vec4 CLUSTER_DEPTH;\n"
+		"uniform vec2 CLUSTER_TILE;\n"
+		"uniform vec2 CLUSTER_SLICE;\n"
 		"in vec3 position;\n"
 		"in vec3 normal;\n"
 		"in vec4 color;\n"
 		"in vec2 texCoord;\n"
 		"out vec4 fragColor;\n"
+		"vec3 light_energy(int i, vec3 n) {\n"
+		"	vec4 a = texelFetch(LIGHTS, 3*i+0);\n"
+		"	vec4 b = texelFetch(LIGHTS, 3*i+1);\n"
+		"	vec4 c = texelFetch(LIGHTS, 3*i+2);\n"
+		"	int type = int(a.w);\n"
+		"	if (type == 1) { //hemi light \n"
+		"		return (dot(n,-b.xyz) * 0.5 + 0.5) * c.rgb;\n"
+		"	} else if (type == 3) { //directional light \n"
+		"		return max(0.0, dot(n,-b.xyz)) * c.rgb;\n"
+		"	}\n"
+		"	vec3 l = (a.xyz - position);\n"
+		"	float dis2 = dot(l,l);\n"
+		"	l = normalize(l);\n"
+		"	float window = clamp(1.0 - (dis2 * dis2) / (c.w * c.w * c.w * c.w), 0.0, 1.0);\n"
+		"	float nl = max(0.0, dot(n, l)) / max(1.0, dis2) * window * window;\n"
+		"	if (type == 2) { //spot light \n"
+		"		float d = dot(l,-b.xyz);\n"
+		"		nl *= smoothstep(b.w,mix(b.w,1.0,0.1), d);\n"
+		"	}\n"
+		"	return nl * c.rgb;\n"
+		"}\n"
 		"void main() {\n"
 		"	vec3 n = normalize(normal);\n"
-		"	vec3 e;\n"
-		"	if (LIGHT_TYPE == 0) { //point light \n"
-		"		vec3 l = (LIGHT_LOCATION - position);\n"
-		"		float dis2 = dot(l,l);\n"
-		"		l = normalize(l);\n"
-		"		float nl = max(0.0, dot(n, l)) / max(1.0, dis2);\n"
-		"		e = nl * LIGHT_ENERGY;\n"
-		"	} else if (LIGHT_TYPE == 1) { //hemi light \n"
-		"		e = (dot(n,-LIGHT_DIRECTION) * 0.5 + 0.5) * LIGHT_ENERGY;\n"
-		"	} else if (LIGHT_TYPE == 2) { //spot light \n"
-		"		vec3 l = (LIGHT_LOCATION - position);\n"
-		"		float dis2 = dot(l,l);\n"
-		"		l = normalize(l);\n"
-		"		float nl = max(0.0, dot(n, l)) / max(1.0, dis2);\n"
-		"		float c = dot(l,-LIGHT_DIRECTION);\n"
-		"		nl *= smoothstep(LIGHT_CUTOFF,mix(LIGHT_CUTOFF,1.0,0.1), c);\n"
-		"		e = nl * LIGHT_ENERGY;\n"
-		"	} else { //(LIGHT_TYPE == 3) //directional light \n"
-		"		e = max(0.0, dot(n,-LIGHT_DIRECTION)) * LIGHT_ENERGY;\n"
+		"	vec3 e = vec3(0.0);\n"
+		"	for (int i = 0; i < GLOBAL_LIGHTS; ++i) {\n"
+		"		e += light_energy(i, n);\n"
+		"	}\n"
+		"	float depth = dot(CLUSTER_DEPTH, vec4(position, 1.0));\n"
+		"	ivec3 cell = ivec3(ivec2(gl_FragCoord.xy * CLUSTER_TILE), int(log(max(depth, 1e-6)) * CLUSTER_SLICE.x + CLUSTER_SLICE.y));\n"
+		"	cell = clamp(cell, ivec3(0), CLUSTER_GRID - 1);\n"
+		"	uvec2 range = texelFetch(CLUSTERS, (cell.z * CLUSTER_GRID.y + cell.y) * CLUSTER_GRID.x + cell.x).xy;\n"
+		"	for (uint i = 0u; i < range.y; ++i) {\n"
+		"		e += light_energy(int(texelFetch(LIGHT_INDICES, int(range.x + i)).x), n);\n"
 		"	}\n"
 		"	vec4 albedo = texture(TEX, texCoord) * color;\n"
 		"	fragColor = vec4(e*albedo.rgb, albedo.a);\n"
@@ -119,20 +140,31 @@ LitColorTextureProgram::LitColorTextureProgram() {
 	OBJECT_TO_CLIP_mat4 = glGetUniformLocation(program, "OBJECT_TO_CLIP");
 	OBJECT_TO_LIGHT_mat4x3 = glGetUniformLocation(program, "OBJECT_TO_LIGHT");
 	NORMAL_TO_LIGHT_mat3 = glGetUniformLocation(program, "NORMAL_TO_LIGHT");
+	POSITION_DEQUANTIZE_mat4x3 = glGetUniformLocation(program, "POSITION_DEQUANTIZE");
+	NORMAL_OCTAHEDRAL_bool = glGetUniformLocation(program, "NORMAL_OCTAHEDRAL");
 
-	LIGHT_TYPE_int = glGetUniformLocation(program, "LIGHT_TYPE");
-	LIGHT_LOCATION_vec3 = glGetUniformLocation(program, "LIGHT_LOCATION");
-	LIGHT_DIRECTION_vec3 = glGetUniformLocation(program, "LIGHT_DIRECTION");
-	LIGHT_ENERGY_vec3 = glGetUniformLocation(program, "LIGHT_ENERGY");
-	LIGHT_CUTOFF_float = glGetUniformLocation(program, "LIGHT_CUTOFF");
-
+	GLOBAL_LIGHTS_int = glGetUniformLocation(program, "GLOBAL_LIGHTS");
+	CLUSTER_GRID_ivec3 = glGetUniformLocation(program, "CLUSTER_GRID");
+	CLUSTER_DEPTH_vec4 = glGetUniformLocation(program, "CLUSTER_DEPTH");
+	CLUSTER_TILE_vec2 = glGetUniformLocation(program, "CLUSTER_TILE");
+	CLUSTER_SLICE_vec2 = glGetUniformLocation(program, "CLUSTER_SLICE");
 
 	GLuint TEX_sampler2D = glGetUniformLocation(program, "TEX");
+	GLuint LIGHTS_samplerBuffer = glGetUniformLocation(program, "LIGHTS");
+	GLuint CLUSTERS_usamplerBuffer = glGetUniformLocation(program, "CLUSTERS");
+	GLuint LIGHT_INDICES_usamplerBuffer = glGetUniformLocation(program, "LIGHT_INDICES");
 
 	//set TEX to always refer to texture binding zero:
 	glUseProgram(program); //bind program -- glUniform* calls refer to this program now
 
 	glUniform1i(TEX_sampler2D, 0); //set TEX to sample from GL_TEXTURE0
+	glUniform1i(LIGHTS_samplerBuffer, 1); //light list lives in GL_TEXTURE1..3 (see LightClusters::bind)
+	glUniform1i(CLUSTERS_usamplerBuffer, 2);
+	glUniform1i(LIGHT_INDICES_usamplerBuffer, 3);
+
+	//default to unquantized vertices (Scene::draw sets these per drawable):
+	glUniformMatrix4x3fv(POSITION_DEQUANTIZE_mat4x3, 1, GL_FALSE, glm::value_ptr(glm::mat4x3(1.0f)));
+	glUniform1i(NORMAL_OCTAHEDRAL_bool, 0);
 
 	glUseProgram(0); //unbind program -- glUniform* calls refer to ??? now
 }
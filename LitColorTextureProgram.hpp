@@ -21,16 +21,21 @@ struct LitColorTextureProgram {
 	GLuint OBJECT_TO_CLIP_mat4 = -1U;
 	GLuint OBJECT_TO_LIGHT_mat4x3 = -1U;
 	GLuint NORMAL_TO_LIGHT_mat3 = -1U;
+	GLuint POSITION_DEQUANTIZE_mat4x3 = -1U; //see MeshBuffer::quantized
+	GLuint NORMAL_OCTAHEDRAL_bool = -1U;
+
+	//lighting (see LightClusters):
+	GLuint GLOBAL_LIGHTS_int = -1U;
+	GLuint CLUSTER_GRID_ivec3 = -1U;
+	GLuint CLUSTER_DEPTH_vec4 = -1U;
+	GLuint CLUSTER_TILE_vec2 = -1U;
+	GLuint CLUSTER_SLICE_vec2 = -1U;
 
-	//lighting:
-	GLuint LIGHT_TYPE_int = -1U;
-	GLuint LIGHT_LOCATION_vec3 = -1U;
-	GLuint LIGHT_DIRECTION_vec3 = -1U;
-	GLuint LIGHT_ENERGY_vec3 = -1U;
-	GLuint LIGHT_CUTOFF_float = -1U;
-	
 	//Textures:
 	//TEXTURE0 - texture that is accessed by TexCoord
+	//TEXTURE1 - light list (texture buffer) -- bound by LightClusters::bind(1)
+	//TEXTURE2 - cluster table (texture buffer)
+	//TEXTURE3 - light indices (texture buffer)
 };
 
 extern Load< LitColorTextureProgram > lit_color_texture_program;
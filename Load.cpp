@@ -1,20 +1,31 @@
 #include "Load.hpp"
 
-#include <array>
-#include <list>
+#include <algorithm>
 #include <cassert>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 
 namespace {
-	std::array< std::list< std::function< void() > >, MaxLoadTag > &get_load_lists() {
-		static std::array< std::list< std::function< void() > >, MaxLoadTag > load_lists;
-		return load_lists;
+	struct LoadFunction {
+		void const *key;
+		LoadThread thread;
+		LoadAfter after;
+		std::function< void() > fn;
+	};
+
+	std::list< LoadFunction > &get_load_list() {
+		static std::list< LoadFunction > load_list;
+		return load_list;
 	}
 }
 
-void add_load_function(LoadTag tag, std::function< void() > const &fn) {
-	auto &load_lists = get_load_lists();
-	assert(tag < load_lists.size());
-	load_lists[tag].emplace_back(fn);
+void add_load_function(void const *key, LoadThread thread, LoadAfter const &after, std::function< void() > const &fn) {
+	get_load_list().emplace_back(LoadFunction{key, thread, after, fn});
 }
 
 void call_load_functions() {
@@ -22,11 +33,113 @@ void call_load_functions() {
 	assert(!has_been_called && "call_load_functions should only be called *once*");
 	has_been_called = true;
 
-	auto &load_lists = get_load_lists();
-	for (auto &fn_list : load_lists) {
-		while (!fn_list.empty()) {
-			(*fn_list.begin())(); //call first function in the list
-			fn_list.pop_front(); //remove from list
+	std::vector< LoadFunction > functions(get_load_list().begin(), get_load_list().end());
+	get_load_list().clear();
+	if (functions.empty()) return;
+
+	//------ build the dependency graph ------
+	std::unordered_map< void const *, size_t > index_of;
+	for (size_t i = 0; i < functions.size(); ++i) {
+		index_of.emplace(functions[i].key, i);
+	}
+
+	std::vector< std::vector< size_t > > dependents(functions.size()); //functions waiting on each function
+	std::vector< size_t > waiting(functions.size(), 0); //number of unfinished functions each function is waiting on
+	for (size_t i = 0; i < functions.size(); ++i) {
+		for (void const *key : functions[i].after) {
+			auto f = index_of.find(key);
+			if (f == index_of.end()) {
+				throw std::runtime_error("A loading function depends on something that isn't loaded by a Load<>.");
+			}
+			dependents[f->second].emplace_back(i);
+			waiting[i] += 1;
 		}
 	}
+
+	{ //check for cycles (by finding an order every function can run in):
+		std::vector< size_t > count = waiting;
+		std::vector< size_t > order;
+		for (size_t i = 0; i < functions.size(); ++i) {
+			if (count[i] == 0) order.emplace_back(i);
+		}
+		for (size_t o = 0; o < order.size(); ++o) {
+			for (size_t d : dependents[order[o]]) {
+				if (--count[d] == 0) order.emplace_back(d);
+			}
+		}
+		if (order.size() != functions.size()) {
+			throw std::runtime_error("Loading functions depend on each other in a cycle.");
+		}
+	}
+
+	//------ run functions as their dependencies finish ------
+	//(ready functions are run in the order they were added, as far as dependencies allow)
+	std::mutex mutex; //guards everything below
+	std::condition_variable changed; //notified when a function finishes (or fails)
+	std::deque< size_t > ready[2]; //runnable functions, by LoadThread
+	size_t finished = 0;
+	std::exception_ptr failure; //first exception thrown by a loading function
+	for (size_t i = 0; i < functions.size(); ++i) {
+		if (waiting[i] == 0) ready[functions[i].thread].emplace_back(i);
+	}
+
+	//run a ready function of type 'thread' (returns false once there won't be any more):
+	auto run_one = [&](LoadThread thread) -> bool {
+		size_t index;
+		{
+			std::unique_lock< std::mutex > lock(mutex);
+			changed.wait(lock, [&](){ return !ready[thread].empty() || finished == functions.size() || failure; });
+			if (ready[thread].empty()) return false;
+			index = ready[thread].front();
+			ready[thread].pop_front();
+		}
+
+		std::exception_ptr error;
+		try {
+			functions[index].fn();
+		} catch (...) {
+			error = std::current_exception();
+		}
+
+		{
+			std::unique_lock< std::mutex > lock(mutex);
+			if (error) {
+				if (!failure) failure = error;
+				//(clear the queues, so nothing else starts)
+				ready[LoadOnGLThread].clear();
+				ready[LoadOnWorker].clear();
+			} else {
+				finished += 1;
+				if (!failure) {
+					for (size_t d : dependents[index]) {
+						if (--waiting[d] == 0) ready[functions[d].thread].emplace_back(d);
+					}
+				}
+			}
+		}
+		changed.notify_all();
+		return true;
+	};
+
+	size_t worker_functions = std::count_if(functions.begin(), functions.end(), [](LoadFunction const &function) {
+		return function.thread == LoadOnWorker;
+	});
+	//(at least two workers, since loading functions may also wait -- e.g., on file reads or other threads)
+	std::vector< std::thread > workers;
+	size_t worker_count = std::min< size_t >(worker_functions, std::max(2u, std::min(4u, std::thread::hardware_concurrency())));
+	for (size_t i = 0; i < worker_count; ++i) {
+		workers.emplace_back([&](){
+			while (run_one(LoadOnWorker)) { }
+		});
+	}
+
+	//this thread runs the LoadOnGLThread functions:
+	while (run_one(LoadOnGLThread)) { }
+
+	//(workers finish whatever they are running before stopping)
+	for (auto &worker : workers) {
+		worker.join();
+	}
+
+	if (failure) std::rethrow_exception(failure);
 }
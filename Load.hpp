@@ -6,8 +6,8 @@
  * This is useful for global-scope resources that need an OpenGL context:
  *
  * //at global scope:
- * Load< Mesh > main_mesh([]() -> const Mesh * {
- *     return &Meshes.get("Main");
+ * Load< Mesh > main_mesh(LoadOnGLThread, {&main_meshes}, []() -> const Mesh * {
+ *     return &main_meshes->get("Main");
  * });
  *
  * //later:
@@ -15,30 +15,39 @@
  *     glBindVertexArray(main_mesh->vao);
  * }
  *
- * Load<> is built on the add_load_function() call that adds a function to one of several lists of functions that are called after the OpenGL canvas is initialized.
+ * Load<> is built on the add_load_function() call that adds a function to a list of functions that are called after the OpenGL canvas is initialized.
  *
- * These functions are grouped by 'tags', which allow some sequencing of calls.
- * (particularly, this is useful for loading large data blobs [e.g. Meshes] before looking up individual elements within them.)
+ * Each function says which other Load<>s it reads (its 'after' list) and whether it makes OpenGL calls:
+ *  - LoadOnGLThread functions run on the thread that calls call_load_functions() (the one with the OpenGL context);
+ *  - LoadOnWorker functions -- which must not make OpenGL calls -- run on a pool of worker threads.
+ * Every function runs as soon as everything in its 'after' list has loaded, so loading CPU-heavy things
+ *  (parsing, decoding) happens in parallel with each other and with OpenGL setup, and startup takes about
+ *  as long as the longest chain of dependencies.
+ * (a loader with both parts is usually split into a LoadOnWorker Load<> and a LoadOnGLThread Load<> after it.)
  *
  */
 
 #include <functional>
 #include <stdexcept>
 #include <cstdint>
+#include <vector>
 
-enum LoadTag : uint32_t {
-	LoadTagEarly,
-	LoadTagDefault,
-	LoadTagLate,
-	MaxLoadTag //<-- just used to track # of load tags
+enum LoadThread : uint32_t {
+	LoadOnGLThread, //may make OpenGL calls
+	LoadOnWorker, //may *not* make OpenGL calls
 };
 
+//the Load<>s (by address; they need not be constructed yet) that a loading function reads:
+typedef std::vector< void const * > LoadAfter;
+
 //Add a function to an internal list of loading functions:
+// 'key' is the address that other functions name in their 'after' lists (e.g., the Load<> adding it)
 // (only call *before* "call_load_functions()")
-void add_load_function(LoadTag tag, std::function< void() > const &fn);
+void add_load_function(void const *key, LoadThread thread, LoadAfter const &after, std::function< void() > const &fn);
 
-//Call all loading functions:
-// (loading functions may throw exceptions if they fail.)
+//Call all loading functions (each after the functions it depends on), returning once all have been called:
+// (loading functions may throw exceptions if they fail; the first one thrown is rethrown here.)
+// (will throw if a function depends on something that isn't a loading function, or if dependencies form a cycle.)
 // (only call *once*)
 void call_load_functions();
 
@@ -50,8 +59,8 @@ T const *new_T() { return new T; }
 template< typename T >
 struct Load {
 	//Constructing a Load< T > adds the passed function to the list of functions to call:
-	Load(LoadTag tag, const std::function< T const *() > &load_fn = new_T< T >) : value(nullptr) {
-		add_load_function(tag, [this,load_fn](){
+	Load(LoadThread thread, LoadAfter const &after = LoadAfter(), const std::function< T const *() > &load_fn = new_T< T >) : value(nullptr) {
+		add_load_function(this, thread, after, [this,load_fn](){
 			this->value = load_fn();
 			if (!(this->value)) {
 				throw std::runtime_error("Loading failed.");
@@ -74,9 +83,7 @@ struct Load {
 template< >
 struct Load< void > {
 	//Constructing a Load< T > adds the passed function to the list of functions to call:
-	Load( LoadTag tag, const std::function< void() > &load_fn) {
-		add_load_function(tag, load_fn);
+	Load(LoadThread thread, LoadAfter const &after, const std::function< void() > &load_fn) {
+		add_load_function(this, thread, after, load_fn);
 	}
 };
-
-
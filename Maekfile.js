@@ -130,9 +130,13 @@ if (maek.OS === 'windows') {
 //returns objFile: objFileBase + a platform-dependant suffix ('.o' or '.obj')
 const game_names = [
 	maek.CPP('WalkMesh.cpp'),
+	maek.CPP('PVS.cpp'),
+	maek.CPP('Animation.cpp'),
 	maek.CPP('PlayMode.cpp'),
 	maek.CPP('main.cpp'),
 	maek.CPP('LitColorTextureProgram.cpp'),
+	maek.CPP('DepthProgram.cpp'),
+	maek.CPP('LightClusters.cpp'),
 	maek.CPP('TextureProgram.cpp'),
 	//maek.CPP('ColorTextureProgram.cpp'),  //not used right now, but you might want it
 	maek.CPP('Sound.cpp'),
@@ -140,15 +144,31 @@ const game_names = [
 	maek.CPP('load_opus.cpp')
 ];
 
+//chunk and data file reading (see ChunkFile.hpp, DataFile.hpp), used by the game and by every tool:
+const chunk_file_names = [
+	maek.CPP('ChunkFile.cpp'),
+	maek.CPP('MappedFile.cpp'),
+	maek.CPP('lz4_block.cpp'),
+	maek.CPP('DataFile.cpp'),
+	maek.CPP('DataReads.cpp'),
+	maek.CPP('AssetPack.cpp'),
+	maek.CPP('data_path.cpp')
+];
+
 const common_names = [
-	maek.CPP('data_path.cpp'),
+	...chunk_file_names,
 	maek.CPP('PathFont.cpp'),
 	maek.CPP('PathFont-font.cpp'),
 	maek.CPP('Font.cpp'),
 	maek.CPP('DrawLines.cpp'),
 	maek.CPP('ColorProgram.cpp'),
 	maek.CPP('Scene.cpp'),
+	maek.CPP('DrawableBVH.cpp'),
+	maek.CPP('OcclusionCulling.cpp'),
+	maek.CPP('SoftwareOcclusion.cpp'),
+	maek.CPP('StaticBatch.cpp'),
 	maek.CPP('Mesh.cpp'),
+	maek.CPP('GeometryArena.cpp'),
 	maek.CPP('load_save_png.cpp'),
 	maek.CPP('gl_compile_program.cpp'),
 	maek.CPP('Mode.cpp'),
@@ -168,6 +188,23 @@ const show_scene_names = [
 	maek.CPP('ShowSceneMode.cpp')
 ];
 
+const bake_scene_names = [
+	maek.CPP('bake-scene.cpp')
+];
+
+const cook_meshes_names = [
+	maek.CPP('cook-meshes.cpp')
+];
+
+const pack_assets_names = [
+	maek.CPP('pack-assets.cpp')
+];
+
+const bake_pvs_names = [
+	maek.CPP('bake-pvs.cpp'),
+	maek.CPP('WalkMesh.cpp')
+];
+
 //the '[exeFile =] LINK(objFiles, exeFileBase, [, options])' links an array of objects into an executable:
 // objFiles: array of objects to link
 // exeFileBase: name of executable file to produce
@@ -175,9 +212,13 @@ const show_scene_names = [
 const game_exe = maek.LINK([...game_names, ...common_names], 'dist/game');
 const show_meshes_exe = maek.LINK([...show_meshes_names, ...common_names], 'scenes/show-meshes');
 const show_scene_exe = maek.LINK([...show_scene_names, ...common_names], 'scenes/show-scene');
+const bake_scene_exe = maek.LINK([...bake_scene_names, ...chunk_file_names], 'scenes/bake-scene');
+const cook_meshes_exe = maek.LINK([...cook_meshes_names, ...chunk_file_names], 'scenes/cook-meshes');
+const bake_pvs_exe = maek.LINK([...bake_pvs_names, ...common_names], 'scenes/bake-pvs');
+const pack_assets_exe = maek.LINK([...pack_assets_names, ...chunk_file_names], 'scenes/pack-assets');
 
 //set the default target to the game (and copy the readme files):
-maek.TARGETS = [game_exe, show_meshes_exe, show_scene_exe, ...copies];
+maek.TARGETS = [game_exe, show_meshes_exe, show_scene_exe, bake_scene_exe, cook_meshes_exe, bake_pvs_exe, pack_assets_exe, ...copies];
 
 //Note that tasks that produce ':abstract targets' are never cached.
 // This is similar to how .PHONY targets behave in make.
@@ -0,0 +1,33 @@
+#pragma once
+
+/*
+ * A MappedFile maps an entire file, read-only, into memory.
+ *
+ * This is useful for parsing chunk-based formats (see read_write_chunk.hpp)
+ *  in place, rather than copying every chunk through a std::istream.
+ *
+ */
+
+#include <string>
+#include <cstddef>
+
+struct MappedFile {
+	//map a file:
+	// note: will throw if file fails to open or map.
+	MappedFile(std::string const &filename);
+	~MappedFile();
+
+	//mappings are owned, so copying is not allowed:
+	MappedFile(MappedFile const &) = delete;
+	MappedFile &operator=(MappedFile const &) = delete;
+
+	//the contents of the file (nullptr if the file is empty):
+	char const *data = nullptr;
+	size_t size = 0;
+
+	//-- internals ---
+	#if defined(_WIN32)
+	void *file_handle = nullptr;
+	void *mapping_handle = nullptr;
+	#endif
+};
@@ -1,20 +1,46 @@
 #include "Mesh.hpp"
-#include "read_write_chunk.hpp"
+#include "ChunkFile.hpp"
 
 #include <glm/glm.hpp>
 
 #include <stdexcept>
-#include <fstream>
 #include <iostream>
 #include <vector>
 #include <string>
 #include <set>
+#include <map>
+#include <algorithm>
 #include <cstddef>
+#include <cstring>
+#include <cassert>
+#include <chrono>
 
-MeshBuffer::MeshBuffer(std::string const &filename) {
+MeshBuffer::MeshBuffer(std::string const &filename, bool keep_vertex_data) {
+	Staged staged;
+	parse(filename, &staged);
+
+	//upload data:
 	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glBufferData(GL_ARRAY_BUFFER, staged.vertices.size(), staged.vertices.data(), GL_STATIC_DRAW);
+	glGenBuffers(1, &position_buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, position_buffer);
+	glBufferData(GL_ARRAY_BUFFER, staged.positions.size(), staged.positions.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	//upload indices:
+	if (index_type) {
+		glGenBuffers(1, &index_buffer);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, staged.indices.size(), staged.indices.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	}
+
+	if (keep_vertex_data) vertex_data = std::move(staged.vertices);
+}
 
-	std::ifstream file(filename, std::ios::binary);
+void MeshBuffer::parse(std::string const &filename, Staged *staged) {
+	assert(staged);
 
 	GLuint total = 0;
 
@@ -25,112 +51,432 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 		glm::vec2 TexCoord;
 	};
 	static_assert(sizeof(Vertex) == 3*4+3*4+4*1+2*4, "Vertex is packed.");
-	std::vector< Vertex > data;
+	ChunkView< Vertex > data;
 
-	//read + upload data chunk:
-	if (filename.size() >= 5 && filename.substr(filename.size()-5) == ".pnct") {
-		read_chunk(file, "pnct", &data);
+	ChunkView< QuantizedVertex > quantized_data;
 
-		//upload data:
-		glBindBuffer(GL_ARRAY_BUFFER, buffer);
-		glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(Vertex), data.data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	struct IndexEntry {
+		uint32_t name_begin, name_end;
+		uint32_t vertex_begin, vertex_end;
+	};
+	static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
 
-		total = GLuint(data.size()); //store total for later checks on index
+	struct IndexRange {
+		uint32_t index_begin, index_end;
+	};
+	static_assert(sizeof(IndexRange) == 8, "Index range should be packed");
 
-		//store attrib locations:
-		Position = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Position));
-		Normal = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Normal));
-		Color = Attrib(4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), offsetof(Vertex, Color));
-		TexCoord = Attrib(2, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, TexCoord));
-	} else {
+	if (!(filename.size() >= 5 && filename.substr(filename.size()-5) == ".pnct")) {
 		throw std::runtime_error("Unknown file type '" + filename + "'");
 	}
+	ChunkFile file(filename);
+
+	//vertices are either floats ("pnct") or quantized ("pncq"; written by cook-meshes --quantize):
+	quantized = (file.find("pncq") != nullptr);
+
+	//(chunks are viewed in place in the mapped file; only indices are kept)
+	ChunkView< char > strings;
+	ChunkView< IndexEntry > index;
+	ChunkView< IndexRange > ranges; //(optional, with "ind0") range of indices used by each index entry (written by cook-meshes)
+	ChunkView< QuantizationBox > boxes; //(quantized files) box for each index entry
+
+	{ //view chunks, decoding any compressed ones (larger ones -- usually vertices and indices -- in parallel):
+		std::vector< ChunkFile::Decode > decodes;
+		if (quantized) file.prepare(file.require("pncq"), &quantized_data, &decodes);
+		else file.prepare(file.require("pnct"), &data, &decodes);
+		file.prepare(file.require("str0"), &strings, &decodes);
+		file.prepare(file.require("idx0"), &index, &decodes);
+		if (file.find("ind0")) {
+			file.prepare(file.require("ind0"), &indices, &decodes);
+			file.prepare(file.require("inr0"), &ranges, &decodes);
+		}
+		if (quantized) file.prepare(file.require("qbx0"), &boxes, &decodes);
+		file.decode_parallel(decodes);
+	}
 
-	std::vector< char > strings;
-	read_chunk(file, "str0", &strings);
+	{ //stage vertex data:
+		if (quantized) {
+			staged->vertices.assign(reinterpret_cast< uint8_t const * >(quantized_data.data()), reinterpret_cast< uint8_t const * >(quantized_data.data() + quantized_data.size()));
 
-	{ //read index chunk, add to meshes:
-		struct IndexEntry {
-			uint32_t name_begin, name_end;
-			uint32_t vertex_begin, vertex_end;
-		};
-		static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
+			total = GLuint(quantized_data.size());
+
+			//(positions are decoded below, once each mesh's quantization box is known)
+
+			//stage packed positions:
+			std::vector< glm::u16vec4 > packed;
+			packed.reserve(quantized_data.size());
+			for (auto const &v : quantized_data) {
+				packed.emplace_back(v.Position);
+			}
+			staged->positions.assign(reinterpret_cast< uint8_t const * >(packed.data()), reinterpret_cast< uint8_t const * >(packed.data() + packed.size()));
+
+			Position = Attrib(3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(QuantizedVertex), offsetof(QuantizedVertex, Position), "POSITION_DEQUANTIZE");
+			PackedPosition = Attrib(3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(glm::u16vec4), 0, "POSITION_DEQUANTIZE"); //(keeps the padding, so each position stays 4-byte aligned)
+			Normal = Attrib(2, GL_SHORT, GL_TRUE, sizeof(QuantizedVertex), offsetof(QuantizedVertex, Normal), "NORMAL_OCTAHEDRAL");
+			Color = Attrib(4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(QuantizedVertex), offsetof(QuantizedVertex, Color));
+			TexCoord = Attrib(2, GL_HALF_FLOAT, GL_FALSE, sizeof(QuantizedVertex), offsetof(QuantizedVertex, TexCoord));
+		} else {
+			staged->vertices.assign(reinterpret_cast< uint8_t const * >(data.data()), reinterpret_cast< uint8_t const * >(data.data() + data.size()));
+
+			total = GLuint(data.size()); //store total for later checks on index
+
+			positions.reserve(data.size());
+			for (auto const &v : data) {
+				positions.emplace_back(v.Position);
+			}
+			static_assert(sizeof(glm::vec3) == 3*4, "positions are packed.");
+			staged->positions.assign(reinterpret_cast< uint8_t const * >(positions.data()), reinterpret_cast< uint8_t const * >(positions.data() + positions.size()));
+
+			//store attrib locations:
+			Position = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Position));
+			Normal = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Normal));
+			Color = Attrib(4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), offsetof(Vertex, Color));
+			TexCoord = Attrib(2, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, TexCoord));
+			PackedPosition = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), 0);
+		}
+	}
+
+	{ //add meshes from index chunk:
+		if (file.find("ind0") && ranges.size() != index.size()) {
+			throw std::runtime_error("index ranges don't match index entries");
+		}
+		if (quantized) {
+			if (boxes.size() != index.size()) {
+				throw std::runtime_error("quantization boxes don't match index entries");
+			}
+			positions.assign(total, glm::vec3(0.0f));
+		}
 
-		std::vector< IndexEntry > index;
-		read_chunk(file, "idx0", &index);
+		total_vertices = total;
+		total_indices = GLuint(indices.size());
+		if (!ranges.empty()) {
+			//16-bit indices are used if they can address every vertex:
+			index_type = (total <= 0x10000 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT);
+		}
+		index_hash = hash_index(strings.data(), strings.size(), index.data(), index.size() * sizeof(IndexEntry), ranges.data(), ranges.size() * sizeof(IndexRange), boxes.data(), boxes.size() * sizeof(QuantizationBox));
 
-		for (auto const &entry : index) {
+		for (uint32_t i = 0; i < index.size(); ++i) {
+			IndexEntry const &entry = index[i];
 			if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
 				throw std::runtime_error("index entry has out-of-range name begin/end");
 			}
 			if (!(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= total)) {
 				throw std::runtime_error("index entry has out-of-range vertex start/count");
 			}
-			std::string name(&strings[0] + entry.name_begin, &strings[0] + entry.name_end);
+			std::string name(strings.data() + entry.name_begin, strings.data() + entry.name_end);
 			Mesh mesh;
 			mesh.type = GL_TRIANGLES;
-			mesh.start = entry.vertex_begin;
-			mesh.count = entry.vertex_end - entry.vertex_begin;
-			for (uint32_t v = entry.vertex_begin; v < entry.vertex_end; ++v) {
-				mesh.min = glm::min(mesh.min, data[v].Position);
-				mesh.max = glm::max(mesh.max, data[v].Position);
+			if (ranges.empty()) {
+				mesh.start = entry.vertex_begin;
+				mesh.count = entry.vertex_end - entry.vertex_begin;
+			} else {
+				IndexRange const &range = ranges[i];
+				if (!(range.index_begin <= range.index_end && range.index_end <= indices.size())) {
+					throw std::runtime_error("index range is out of range");
+				}
+				for (uint32_t j = range.index_begin; j < range.index_end; ++j) {
+					if (!(entry.vertex_begin <= indices[j] && indices[j] < entry.vertex_end)) {
+						throw std::runtime_error("index refers to vertex outside of its mesh");
+					}
+				}
+				mesh.start = range.index_begin;
+				mesh.count = range.index_end - range.index_begin;
+				mesh.index_type = index_type;
+			}
+			if (quantized) {
+				QuantizationBox const &box = boxes[i];
+				if (!(box.min.x <= box.max.x && box.min.y <= box.max.y && box.min.z <= box.max.z)) {
+					throw std::runtime_error("quantization box is empty");
+				}
+				mesh.min = box.min;
+				mesh.max = box.max;
+				mesh.dequantize = dequantize_matrix(box);
+				for (uint32_t v = entry.vertex_begin; v < entry.vertex_end; ++v) {
+					positions[v] = dequantize_position(quantized_data[v].Position, box);
+				}
+			} else {
+				for (uint32_t v = entry.vertex_begin; v < entry.vertex_end; ++v) {
+					mesh.min = glm::min(mesh.min, data[v].Position);
+					mesh.max = glm::max(mesh.max, data[v].Position);
+				}
 			}
-			bool inserted = meshes.insert(std::make_pair(name, mesh)).second;
-			if (!inserted) {
+			if (!add_mesh(name, mesh)) {
 				std::cerr << "WARNING: mesh name '" + name + "' in filename '" + filename + "' collides with existing mesh." << std::endl;
 			}
 		}
+
+		//stage indices (in index_type) for upload:
+		if (index_type == GL_UNSIGNED_SHORT) {
+			std::vector< uint16_t > narrow(indices.begin(), indices.end());
+			staged->indices.assign(reinterpret_cast< uint8_t const * >(narrow.data()), reinterpret_cast< uint8_t const * >(narrow.data() + narrow.size()));
+		} else if (index_type == GL_UNSIGNED_INT) {
+			staged->indices.assign(reinterpret_cast< uint8_t const * >(indices.data()), reinterpret_cast< uint8_t const * >(indices.data() + indices.size()));
+		}
+	}
+
+	{ //group "Name.LOD<n>" meshes into LOD chains for "Name":
+		std::map< std::string, std::map< uint32_t, Mesh > > levels;
+		for (uint32_t i = 0; i < meshes.size(); ++i) {
+			std::string const &name = names[i];
+			auto dot = name.rfind(".LOD");
+			if (dot == std::string::npos || dot + 4 == name.size()) continue;
+			if (name.find_first_not_of("0123456789", dot + 4) != std::string::npos) continue;
+			uint32_t level = uint32_t(std::stoul(name.substr(dot + 4)));
+			if (level == 0) continue; //level zero is the base mesh itself
+			levels[name.substr(0, dot)].emplace(level, meshes[i]);
+		}
+		for (auto const &[base, chain] : levels) {
+			Handle base_handle = find(base);
+			if (!base_handle) {
+				std::cerr << "WARNING: LOD meshes for '" << base << "' in filename '" << filename << "' have no base mesh." << std::endl;
+				continue;
+			}
+			std::vector< Mesh > &list = lods[base_handle.index];
+			for (auto const &[level, mesh] : chain) {
+				if (level != list.size() + 1) {
+					std::cerr << "WARNING: LOD chain for '" << base << "' in filename '" << filename << "' skips level " << (list.size() + 1) << "; ignoring coarser levels." << std::endl;
+					break;
+				}
+				//LODs are drawn with their base mesh's dequantization, so must share its box:
+				if (mesh.dequantize != meshes[base_handle.index].dequantize) {
+					std::cerr << "WARNING: LOD " << level << " of '" << base << "' in filename '" << filename << "' is quantized differently than its base mesh; ignoring it and coarser levels." << std::endl;
+					break;
+				}
+				list.emplace_back(mesh);
+			}
+		}
 	}
 
-	if (file.peek() != EOF) {
+	if (file.trailing) {
 		std::cerr << "WARNING: trailing data in mesh file '" << filename << "'" << std::endl;
 	}
 
 	/* //DEBUG:
 	std::cout << "File '" << filename << "' contained meshes";
-	for (auto const &m : meshes) {
-		if (&m.second == &meshes.rbegin()->second && meshes.size() > 1) std::cout << " and";
-		std::cout << " '" << m.first << "'";
-		if (&m.second != &meshes.rbegin()->second) std::cout << ",";
+	for (uint32_t i = 0; i < names.size(); ++i) {
+		if (i + 1 == names.size() && names.size() > 1) std::cout << " and";
+		std::cout << " '" << names[i] << "'";
+		if (i + 1 != names.size()) std::cout << ",";
 	}
 	std::cout << std::endl;
 	*/
 }
 
-const Mesh &MeshBuffer::lookup(std::string const &name) const {
-	auto f = meshes.find(name);
-	if (f == meshes.end()) {
-		throw std::runtime_error("Looking up mesh '" + name + "' that doesn't exist.");
+const Mesh &MeshBuffer::lookup(std::string_view name) const {
+	return meshes[handle(name).index];
+}
+
+std::vector< Mesh > const &MeshBuffer::lookup_lods(std::string_view name) const {
+	static std::vector< Mesh > const empty;
+	Handle found = find(name);
+	if (!found) return empty;
+	return lods[found.index];
+}
+
+MeshBuffer::Handle MeshBuffer::find(Name const &name) const {
+	if (slots.empty()) return Handle{};
+	uint32_t mask = uint32_t(slots.size()) - 1;
+	for (uint32_t i = name.hash & mask; ; i = (i + 1) & mask) {
+		Slot const &slot = slots[i];
+		if (slot.index == -1U) return Handle{}; //(table is never full, so probing always ends)
+		if (slot.hash == name.hash && names[slot.index] == name.name) return Handle{slot.index};
+	}
+}
+
+MeshBuffer::Handle MeshBuffer::handle(std::string_view name) const {
+	Handle found = find(name);
+	if (!found) {
+		throw std::runtime_error("Looking up mesh '" + std::string(name) + "' that doesn't exist.");
+	}
+	return found;
+}
+
+MeshBuffer::Handle MeshBuffer::add_mesh(std::string const &name, Mesh const &mesh) {
+	Name key(name);
+	if (find(key)) return Handle{};
+
+	//grow (and rehash) to stay at most half full:
+	if (2 * (meshes.size() + 1) > slots.size()) {
+		std::vector< Slot > old;
+		old.swap(slots);
+		slots.resize(std::max< size_t >(16, 2 * old.size()));
+		uint32_t mask = uint32_t(slots.size()) - 1;
+		for (Slot const &slot : old) {
+			if (slot.index == -1U) continue;
+			uint32_t i = slot.hash & mask;
+			while (slots[i].index != -1U) i = (i + 1) & mask;
+			slots[i] = slot;
+		}
+	}
+
+	Handle added{uint32_t(meshes.size())};
+	meshes.emplace_back(mesh);
+	names.emplace_back(name);
+	lods.emplace_back();
+
+	uint32_t mask = uint32_t(slots.size()) - 1;
+	uint32_t i = key.hash & mask;
+	while (slots[i].index != -1U) i = (i + 1) & mask;
+	slots[i] = Slot{key.hash, added.index};
+
+	return added;
+}
+
+struct MeshBuffer::Async::Parsed {
+	std::unique_ptr< MeshBuffer > buffer;
+	Staged staged;
+	bool taken = false; //has buffer() given 'buffer' away?
+	MeshBuffer *result = nullptr; //(valid once taken)
+};
+
+MeshBuffer::Async::Async(std::string const &filename, bool keep_vertex_data_) : keep_vertex_data(keep_vertex_data_) {
+	ready = ready_promise.get_future().share();
+	parsing = std::async(std::launch::async, [filename]() {
+		auto ret = std::make_shared< Parsed >();
+		ret->buffer = std::make_unique< MeshBuffer >();
+		ret->buffer->parse(filename, &ret->staged);
+		return ret;
+	});
+}
+
+void MeshBuffer::Async::wait_parsed() const {
+	if (!parsed && !failure) parsing.wait();
+}
+
+MeshBuffer *MeshBuffer::Async::buffer() {
+	if (failure) std::rethrow_exception(failure);
+	if (!parsed) {
+		try {
+			parsed = parsing.get();
+		} catch (...) {
+			failure = std::current_exception();
+			ready_promise.set_exception(failure);
+			throw;
+		}
+	}
+	if (!parsed->taken) {
+		MeshBuffer *ret = parsed->buffer.release();
+		//allocate (but don't fill) buffers, so vertex arrays can be made right away:
+		// (uses the copy-write target so as not to disturb any bound vertex array)
+		glGenBuffers(1, &ret->buffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, ret->buffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, parsed->staged.vertices.size(), nullptr, GL_STATIC_DRAW);
+		glGenBuffers(1, &ret->position_buffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, ret->position_buffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, parsed->staged.positions.size(), nullptr, GL_STATIC_DRAW);
+		if (ret->index_type) {
+			glGenBuffers(1, &ret->index_buffer);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, ret->index_buffer);
+			glBufferData(GL_COPY_WRITE_BUFFER, parsed->staged.indices.size(), nullptr, GL_STATIC_DRAW);
+		}
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		parsed->taken = true;
+		parsed->result = ret;
+	}
+	return parsed->result;
+}
+
+bool MeshBuffer::Async::upload(size_t budget) {
+	if (!parsed && !failure) {
+		if (parsing.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return false;
+	}
+	MeshBuffer *target = buffer();
+	Staged &staged = parsed->staged;
+
+	auto resident = [&]() {
+		return uploaded_indices == staged.indices.size() && uploaded_vertices == staged.vertices.size() && uploaded_positions == staged.positions.size();
+	};
+	if (resident()) return true;
+
+	//copy the next part of 'bytes' into 'name':
+	// since no part of a buffer is written twice (and nothing may draw from the part being written),
+	// the range can be mapped unsynchronized -- no waiting on the GPU -- and its old contents invalidated:
+	auto upload_slice = [&budget](GLuint name, std::vector< uint8_t > const &bytes, size_t *uploaded) {
+		if (*uploaded == bytes.size() || budget == 0) return;
+		size_t size = std::min(budget, bytes.size() - *uploaded);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, name);
+		void *dst = glMapBufferRange(GL_COPY_WRITE_BUFFER, GLintptr(*uploaded), GLsizeiptr(size), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		bool written = false;
+		if (dst) {
+			std::memcpy(dst, bytes.data() + *uploaded, size);
+			written = (glUnmapBuffer(GL_COPY_WRITE_BUFFER) == GL_TRUE);
+		}
+		if (!written) {
+			//mapping failed or the data store was lost while mapped, so copy the usual way:
+			glBufferSubData(GL_COPY_WRITE_BUFFER, GLintptr(*uploaded), GLsizeiptr(size), bytes.data() + *uploaded);
+		}
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		*uploaded += size;
+		budget -= size;
+	};
+	//indices first, since indexed meshes can't be drawn without them:
+	upload_slice(target->index_buffer, staged.indices, &uploaded_indices);
+	upload_slice(target->buffer, staged.vertices, &uploaded_vertices);
+	upload_slice(target->position_buffer, staged.positions, &uploaded_positions);
+
+	if (resident()) {
+		//everything is resident; free the staging copy (handing over the vertices, if they are to be kept):
+		if (keep_vertex_data) target->vertex_data = std::move(staged.vertices);
+		staged = Staged();
+		uploaded_indices = uploaded_vertices = uploaded_positions = 0;
+		ready_promise.set_value();
+		return true;
+	}
+	return false;
+}
+
+float MeshBuffer::Async::progress() const {
+	if (!parsed) return 0.0f;
+	if (ready.wait_for(std::chrono::seconds(0)) == std::future_status::ready) return 1.0f;
+	size_t total = parsed->staged.indices.size() + parsed->staged.vertices.size() + parsed->staged.positions.size();
+	if (total == 0) return 1.0f;
+	return float(uploaded_indices + uploaded_vertices + uploaded_positions) / float(total);
+}
+
+MeshBuffer::~MeshBuffer() {
+	if (shared) return; //buffers (and vertex arrays) belong to 'shared'
+
+	for (auto &[layout, vao] : vaos) {
+		glDeleteVertexArrays(1, &vao);
+	}
+	vaos.clear();
+
+	if (index_buffer != 0) {
+		glDeleteBuffers(1, &index_buffer);
+		index_buffer = 0;
+	}
+	if (position_buffer != 0) {
+		glDeleteBuffers(1, &position_buffer);
+		position_buffer = 0;
+	}
+	if (buffer != 0) {
+		glDeleteBuffers(1, &buffer);
+		buffer = 0;
 	}
-	return f->second;
 }
 
 GLuint MeshBuffer::make_vao_for_program(GLuint program) const {
-	//create a new vertex array object:
-	GLuint vao = 0;
-	glGenVertexArrays(1, &vao);
-	glBindVertexArray(vao);
+	if (shared) return shared->make_vao_for_program(program);
+
+	std::array< Attrib const *, 4 > attribs{{&Position, &Normal, &Color, &TexCoord}};
+	static std::array< char const *, 4 > const attrib_names{{"Position", "Normal", "Color", "TexCoord"}};
 
-	//Try to bind all attributes in this buffer:
+	//Find where the program wants each attribute in this buffer:
+	AttribLayout layout;
 	std::set< GLuint > bound;
-	glBindBuffer(GL_ARRAY_BUFFER, buffer);
-	auto bind_attribute = [&](char const *name, MeshBuffer::Attrib const &attrib) {
-		if (attrib.size == 0) return; //don't bind empty attribs
-		GLint location = glGetAttribLocation(program, name);
-		if (location == -1) return; //can't bind missing attribs
-		glVertexAttribPointer(location, attrib.size, attrib.type, attrib.normalized, attrib.stride, (GLbyte *)0 + attrib.offset);
-		glEnableVertexAttribArray(location);
-		bound.insert(location);
-	};
-	bind_attribute("Position", Position);
-	bind_attribute("Normal", Normal);
-	bind_attribute("Color", Color);
-	bind_attribute("TexCoord", TexCoord);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindVertexArray(0);
+	for (uint32_t i = 0; i < attribs.size(); ++i) {
+		layout[i] = -1;
+		if (attribs[i]->size == 0) continue; //don't bind empty attribs
+		GLint location = glGetAttribLocation(program, attrib_names[i]);
+		if (location == -1) continue; //can't bind missing attribs
+		if (attribs[i]->decode_uniform && glGetUniformLocation(program, attribs[i]->decode_uniform) == -1) {
+			throw std::runtime_error("ERROR: program reads attribute '" + std::string(attrib_names[i]) + "' but has no '" + attribs[i]->decode_uniform + "' uniform to decode it with.");
+		}
+		layout[i] = location;
+		bound.insert(GLuint(location));
+	}
 
-	//Check that all active attributes were bound:
+	//Check that all active attributes will be bound:
 	GLint active = 0;
 	glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &active);
 	assert(active >= 0 && "Doesn't makes sense to have negative active attributes.");
@@ -146,5 +492,40 @@ GLuint MeshBuffer::make_vao_for_program(GLuint program) const {
 		}
 	}
 
+	//Reuse the vertex array made for any program with the same layout:
+	auto f = vaos.find(layout);
+	if (f != vaos.end()) return f->second;
+
+	//create a new vertex array object:
+	GLuint vao = 0;
+	glGenVertexArrays(1, &vao);
+	bind_vao(vao, layout);
+
+	vaos.emplace(layout, vao);
+
 	return vao;
 }
+
+void MeshBuffer::bind_vao(GLuint vao, AttribLayout const &layout) const {
+	std::array< Attrib const *, 4 > attribs{{&Position, &Normal, &Color, &TexCoord}};
+
+	//programs that read nothing but Position (e.g., depth-only passes) get the packed stream:
+	bool position_only = (layout[0] != -1 && layout[1] == -1 && layout[2] == -1 && layout[3] == -1);
+	if (position_only && position_buffer != 0 && PackedPosition.size != 0) attribs[0] = &PackedPosition;
+	else position_only = false;
+
+	glBindVertexArray(vao);
+
+	glBindBuffer(GL_ARRAY_BUFFER, position_only ? position_buffer : buffer);
+	for (uint32_t i = 0; i < attribs.size(); ++i) {
+		if (layout[i] == -1) continue;
+		Attrib const &attrib = *attribs[i];
+		glVertexAttribPointer(GLuint(layout[i]), attrib.size, attrib.type, attrib.normalized, attrib.stride, (GLbyte *)0 + attrib.offset);
+		glEnableVertexAttribArray(GLuint(layout[i]));
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	//element array buffer binding is part of vertex array state:
+	if (index_buffer) glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
+	glBindVertexArray(0);
+	if (index_buffer) glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
@@ -5,15 +5,40 @@
  *  the OpenGL pipeline together.
  * A "MeshBuffer" holds a collection of such meshes (loaded from a file) in
  *  a single OpenGL array buffer. Individual meshes can be looked up by name
- *  using the MeshBuffer::lookup() function.
+ *  using the MeshBuffer::lookup() function (a hash table probe), or resolved
+ *  once to a MeshBuffer::Handle and then indexed directly in hot paths.
+ * Meshes named "Name.LOD1", "Name.LOD2", ... (see export-meshes.py --lods)
+ *  are lower-detail versions of "Name"; find them with lookup_lods().
+ * Files cooked by scenes/cook-meshes are indexed: vertices are shared between
+ *  triangles, and meshes are ranges of an index buffer (drawn with glDrawElements).
+ * Files cooked with --quantize store vertices in a 20-byte layout (see quantize.hpp);
+ *  shaders rebuild positions with each mesh's 'dequantize' matrix and decode
+ *  octahedral normals (see MeshBuffer::quantized and Scene::Drawable::Pipeline).
+ * MeshBuffer::Async loads a file without stalling the OpenGL thread: the file is
+ *  parsed on a worker thread and then uploaded a slice at a time (e.g., once per frame).
+ * GeometryArena (GeometryArena.hpp) loads several files into shared buffers, so
+ *  their meshes can be drawn with the same vertex array.
+ * Besides the interleaved vertex buffer, a MeshBuffer keeps a tightly packed copy of
+ *  just the positions (MeshBuffer::position_buffer), which vertex arrays for
+ *  position-only programs (depth prepass, shadows) read instead -- 8 or 12 bytes
+ *  per vertex rather than 20 or 36.
  *
  */
 
 #include "GL.hpp"
+#include "quantize.hpp"
 #include <glm/glm.hpp>
+#include <array>
 #include <map>
 #include <limits>
 #include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <exception>
+#include <future>
+#include <memory>
 
 
 struct Mesh {
@@ -23,32 +48,221 @@ struct Mesh {
 	GLuint start = 0; //index of first vertex
 	GLuint count = 0; //count of vertices
 
+	//if set, start and count are a range of the MeshBuffer's indices (of this type) instead of its vertices:
+	GLenum index_type = 0;
+
 	//Bounding box.
 	//useful for debug visualization and (perhaps, eventually) collision detection:
+	// (in quantized buffers this is the box positions are relative to, which LODs share with their base mesh)
 	glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
 	glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+
+	//takes Position attributes (as the shader sees them) to object space; identity unless the MeshBuffer is quantized:
+	glm::mat4x3 dequantize = glm::mat4x3(1.0f);
 };
 
 struct MeshBuffer {
-	//construct from a file:
+	//construct from a file (keeping a CPU copy of the vertices in vertex_data if 'keep_vertex_data' is set):
 	// note: will throw if file fails to read.
-	MeshBuffer(std::string const &filename);
+	MeshBuffer(std::string const &filename, bool keep_vertex_data = false);
+
+	//empty (for code that fills in buffer and attribs itself, e.g., StaticBatch):
+	MeshBuffer() = default;
+
+	//deletes buffer, position_buffer, index_buffer, and the vertex arrays made by make_vao_for_program:
+	~MeshBuffer();
+
+	//(owns OpenGL objects, so can't be copied)
+	MeshBuffer(MeshBuffer const &) = delete;
+	MeshBuffer &operator=(MeshBuffer const &) = delete;
+
+	//construct from a file without stalling the OpenGL thread:
+	//  MeshBuffer::Async async(filename); //starts reading the file on a worker thread
+	//  MeshBuffer const *meshes = async.buffer(); //(later) waits for parsing; meshes, positions, and attribs are now usable, but buffers are empty
+	//  async.upload(); //(each frame) copies the next slice of data into the buffers; returns true once everything is resident
+	// note: until 'ready' is ready, drawing with the buffer is undefined.
+	struct Async {
+		//(if 'keep_vertex_data' is set, the uploaded buffer keeps a CPU copy of its vertices in vertex_data)
+		Async(std::string const &filename, bool keep_vertex_data = false);
+
+		//(any thread) wait for parsing to finish (without taking the result -- so errors are still thrown by buffer()):
+		void wait_parsed() const;
+
+		//(GL thread) wait for parsing to finish and return the buffer (allocated with new; caller owns it):
+		// note: will throw if file fails to read (and again, with the same exception, on every later call).
+		MeshBuffer *buffer();
+
+		//(GL thread) upload up to 'budget' bytes (indices first, then vertices and packed positions); returns true once everything is resident:
+		// note: doesn't wait for parsing (returns false if it isn't finished), but will throw if it failed.
+		bool upload(size_t budget = 4 << 20);
+
+		//becomes ready when everything is resident (or holds the exception if loading failed):
+		std::shared_future< void > ready;
+
+		//fraction of bytes uploaded so far:
+		float progress() const;
+
+		//-- internals ---
+		struct Parsed;
+		std::future< std::shared_ptr< Parsed > > parsing; //(from worker thread)
+		std::shared_ptr< Parsed > parsed; //(once parsing is finished)
+		std::exception_ptr failure; //(if parsing failed -- rethrown by every later call)
+		std::promise< void > ready_promise;
+		bool keep_vertex_data = false;
+		size_t uploaded_indices = 0; //bytes
+		size_t uploaded_vertices = 0; //bytes
+		size_t uploaded_positions = 0; //bytes
+	};
 
 	//look up a particular mesh by name:
 	// note: will throw if mesh not found.
-	const Mesh &lookup(std::string const &name) const;
-	
-	//build a vertex array object that links this vbo to attributes to a program:
+	const Mesh &lookup(std::string_view name) const;
+
+	//look up the lower-detail versions of a mesh (level 1, 2, ...; coarsest last):
+	// note: returns an empty list if the mesh has no LODs.
+	std::vector< Mesh > const &lookup_lods(std::string_view name) const;
+
+	//FNV-1a hash of a mesh name (constexpr, so names known at compile time can be hashed then):
+	static constexpr uint32_t hash_name(std::string_view name) {
+		uint32_t hash = 0x811c9dc5;
+		for (char c : name) {
+			hash = (hash ^ uint32_t(uint8_t(c))) * 0x01000193;
+		}
+		return hash;
+	}
+
+	//a mesh name along with its hash, e.g.:
+	//  static constexpr MeshBuffer::Name DuckName("Duck"); //(hashed at compile time)
+	//  MeshBuffer::Handle duck = buffer.find(DuckName);
+	struct Name {
+		std::string_view name;
+		uint32_t hash = 0;
+		constexpr explicit Name(std::string_view name_) : name(name_), hash(hash_name(name_)) { }
+	};
+
+	//Handles are indices of meshes in this buffer; resolve them once (e.g., at load) and then use them with operator[]:
+	struct Handle {
+		uint32_t index = -1U;
+		explicit operator bool() const { return index != -1U; }
+		bool operator==(Handle const &other) const { return index == other.index; }
+		bool operator!=(Handle const &other) const { return index != other.index; }
+	};
+
+	//find the handle of a mesh by name:
+	// note: returns an invalid handle (one that tests false) if mesh not found.
+	Handle find(Name const &name) const;
+	Handle find(std::string_view name) const { return find(Name(name)); }
+
+	//find the handle of a mesh by name:
+	// note: will throw if mesh not found.
+	Handle handle(std::string_view name) const;
+
+	//access meshes (and their LODs, as per lookup_lods) by handle:
+	// note: handle must be valid (no checking is done)
+	Mesh const &operator[](Handle handle) const { return meshes[handle.index]; }
+	std::vector< Mesh > const &lookup_lods(Handle handle) const { return lods[handle.index]; }
+	std::string const &name(Handle handle) const { return names[handle.index]; }
+
+	//number of meshes; handles are 0 .. size()-1, in file order:
+	uint32_t size() const { return uint32_t(meshes.size()); }
+
+	//get a vertex array object that links this vbo to attributes to a program:
+	// only attributes the program reads are bound; if that is just Position, it is read from position_buffer (when there is one)
 	// note: will throw if program defines attributes not contained in this buffer
+	// note: will throw if this buffer is quantized and program lacks the uniforms needed to decode it
+	// note: programs with the same attribute locations share a vertex array; vertex arrays belong to this buffer (don't delete them)
 	GLuint make_vao_for_program(GLuint program) const;
 
 	//This is the OpenGL vertex buffer object containing the mesh data:
 	GLuint buffer = 0;
 
+	//(optional) tightly packed copy of the Position attribute of each vertex (described by PackedPosition), for position-only programs:
+	// (same vertex order as 'buffer', so mesh starts, vertex_base, and indices work for both)
+	GLuint position_buffer = 0;
+
+	//CPU copy of vertex positions (same order as the buffer; object space, even if quantized), for occlusion culling and collision:
+	std::vector< glm::vec3 > positions;
+
+	//(optional) CPU copy of the interleaved vertices in 'buffer' (as described by the Attribs), for code that rebuilds geometry -- e.g., StaticBatch:
+	// (empty unless asked for when loading; set by MeshBuffer::Async once the vertices are resident)
+	std::vector< uint8_t > vertex_data;
+
+	//Set if vertices use the quantized layout (QuantizedVertex in quantize.hpp), in which case
+	// programs must apply POSITION_DEQUANTIZE to Position and decode Normal when NORMAL_OCTAHEDRAL is set
+	// (drawables get these values from Mesh::dequantize and this flag):
+	bool quantized = false;
+
+	//For indexed files, the OpenGL element array buffer (bound in vertex arrays from make_vao_for_program):
+	GLuint index_buffer = 0;
+	GLenum index_type = 0; //GL_UNSIGNED_SHORT or GL_UNSIGNED_INT (0 if not indexed)
+	//...and a CPU copy of the indices (always 32-bit):
+	std::vector< uint32_t > indices;
+
+	//If set, this buffer's data lives in the buffers of 'shared' (see GeometryArena.hpp):
+	// 'buffer', 'position_buffer', and 'index_buffer' are shared's, mesh starts are offset by vertex_base or index_base,
+	// make_vao_for_program returns shared's vertex arrays, and the destructor leaves the buffers alone.
+	// (the CPU copies -- positions and indices -- are still just this file's, with indices relative to its first vertex)
+	MeshBuffer const *shared = nullptr;
+	GLuint vertex_base = 0; //index of this file's first vertex in 'buffer'
+	GLuint index_base = 0; //index of this file's first index in 'index_buffer'
+
 	//-- internals ---
 
-	//used by the lookup() function:
-	std::map< std::string, Mesh > meshes;
+	//meshes, their names, and their LOD chains (indexed by Handle::index):
+	std::vector< Mesh > meshes;
+	std::vector< std::string > names;
+	std::vector< std::vector< Mesh > > lods;
+
+	//open-addressing (linear probing) hash table of meshes by name, used by find():
+	// (size is a power of two, kept at most half full; empty slots have index -1U)
+	struct Slot {
+		uint32_t hash = 0;
+		uint32_t index = -1U;
+	};
+	std::vector< Slot > slots;
+
+	//data for 'buffer', 'position_buffer', and 'index_buffer', as staged by parse():
+	struct Staged {
+		std::vector< uint8_t > vertices;
+		std::vector< uint8_t > positions; //(as described by PackedPosition)
+		std::vector< uint8_t > indices; //(already in index_type)
+	};
+
+	//read file and fill in everything but the OpenGL buffers (makes no OpenGL calls, so can run on any thread):
+	// note: will throw if file fails to read.
+	void parse(std::string const &filename, Staged *staged);
+
+	//vertex arrays made by make_vao_for_program, by attribute layout (location of Position, Normal, Color, TexCoord; -1 if unused):
+	using AttribLayout = std::array< GLint, 4 >;
+	mutable std::map< AttribLayout, GLuint > vaos;
+
+	//(re)point vertex array 'vao' at this buffer's attributes (as placed by 'layout'; Position only reads position_buffer) and index buffer:
+	// (used by make_vao_for_program, and by GeometryArena when it moves data to a larger buffer)
+	void bind_vao(GLuint vao, AttribLayout const &layout) const;
+
+	//add a mesh to meshes/names/lods and the hash table:
+	// note: returns an invalid handle (and doesn't add the mesh) if name is already in use.
+	Handle add_mesh(std::string const &name, Mesh const &mesh);
+
+	//identifies the loaded file's contents; used to check that baked scenes (see bake-scene.cpp) are up to date:
+	GLuint total_vertices = 0;
+	GLuint total_indices = 0;
+	uint32_t index_hash = 0;
+
+	//FNV-1a hash of the file's "str0", "idx0", (if indexed) "inr0", and (if quantized) "qbx0" chunk payloads (as stored in index_hash):
+	static uint32_t hash_index(char const *strings, size_t strings_size, void const *index, size_t index_size, void const *ranges = nullptr, size_t ranges_size = 0, void const *boxes = nullptr, size_t boxes_size = 0) {
+		uint32_t hash = 0x811c9dc5;
+		auto add = [&hash](unsigned char const *data, size_t size) {
+			for (size_t i = 0; i < size; ++i) {
+				hash = (hash ^ data[i]) * 0x01000193;
+			}
+		};
+		add(reinterpret_cast< unsigned char const * >(strings), strings_size);
+		add(reinterpret_cast< unsigned char const * >(index), index_size);
+		add(reinterpret_cast< unsigned char const * >(ranges), ranges_size);
+		add(reinterpret_cast< unsigned char const * >(boxes), boxes_size);
+		return hash;
+	}
 
 	//These 'Attrib' structures describe the location of various attributes within the buffer (in exactly format wanted by glVertexAttribPointer). They are set when the file is loaded and are used by the "make_vao_for_program" call:
 	struct Attrib {
@@ -57,14 +271,19 @@ struct MeshBuffer {
 		GLboolean normalized = GL_FALSE;
 		GLsizei stride = 0;
 		GLsizei offset = 0;
+		//(optional) uniform a program needs in order to decode this attribute (checked by make_vao_for_program):
+		char const *decode_uniform = nullptr;
 
 		Attrib() = default;
-		Attrib(GLint size_, GLenum type_, GLboolean normalized_, GLsizei stride_, GLsizei offset_)
-		: size(size_), type(type_), normalized(normalized_), stride(stride_), offset(offset_) { }
+		Attrib(GLint size_, GLenum type_, GLboolean normalized_, GLsizei stride_, GLsizei offset_, char const *decode_uniform_ = nullptr)
+		: size(size_), type(type_), normalized(normalized_), stride(stride_), offset(offset_), decode_uniform(decode_uniform_) { }
 	};
 
 	Attrib Position;
 	Attrib Normal;
 	Attrib Color;
 	Attrib TexCoord;
+
+	//Position, as stored in position_buffer (same type and decoding, but with nothing in between):
+	Attrib PackedPosition;
 };
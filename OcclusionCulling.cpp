@@ -0,0 +1,134 @@
+#include "OcclusionCulling.hpp"
+
+#include "gl_compile_program.hpp"
+#include "gl_errors.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <vector>
+
+OcclusionCulling::OcclusionCulling() {
+	proxy_program = gl_compile_program(
+		//vertex shader:
+		"#version 330\n"
+		"uniform mat4 OBJECT_TO_CLIP;\n"
+		"in vec4 Position;\n"
+		"void main() {\n"
+		"	gl_Position = OBJECT_TO_CLIP * Position;\n"
+		"}\n"
+	,
+		//fragment shader:
+		"#version 330\n"
+		"out vec4 fragColor;\n"
+		"void main() {\n"
+		"	fragColor = vec4(1.0);\n"
+		"}\n"
+	);
+	proxy_OBJECT_TO_CLIP_mat4 = glGetUniformLocation(proxy_program, "OBJECT_TO_CLIP");
+	GLuint Position_vec4 = glGetAttribLocation(proxy_program, "Position");
+
+	//unit cube as a 14-vertex triangle strip:
+	std::vector< glm::vec3 > strip{
+		{0,1,1}, {1,1,1}, {0,0,1}, {1,0,1}, {1,0,0}, {1,1,1}, {1,1,0},
+		{0,1,1}, {0,1,0}, {0,0,1}, {0,0,0}, {1,0,0}, {0,1,0}, {1,1,0},
+	};
+
+	glGenVertexArrays(1, &proxy_vao);
+	glGenBuffers(1, &proxy_vbo);
+	glBindVertexArray(proxy_vao);
+	glBindBuffer(GL_ARRAY_BUFFER, proxy_vbo);
+	glBufferData(GL_ARRAY_BUFFER, strip.size() * sizeof(strip[0]), strip.data(), GL_STATIC_DRAW);
+	glVertexAttribPointer(Position_vec4, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (GLbyte *)0);
+	glEnableVertexAttribArray(Position_vec4);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+
+	GL_ERRORS();
+}
+
+OcclusionCulling::~OcclusionCulling() {
+	for (auto &[drawable, state] : states) {
+		glDeleteQueries(1, &state.query);
+	}
+	states.clear();
+
+	glDeleteBuffers(1, &proxy_vbo);
+	proxy_vbo = 0;
+	glDeleteVertexArrays(1, &proxy_vao);
+	proxy_vao = 0;
+	glDeleteProgram(proxy_program);
+	proxy_program = 0;
+}
+
+void OcclusionCulling::begin_frame() {
+	++frame;
+	stats = Stats();
+}
+
+void OcclusionCulling::end_frame() {
+	for (auto s = states.begin(); s != states.end(); /* later */) {
+		if (s->second.seen != frame) {
+			glDeleteQueries(1, &s->second.query);
+			s = states.erase(s);
+		} else {
+			++s;
+		}
+	}
+}
+
+OcclusionCulling::State &OcclusionCulling::state(Scene::Drawable const &drawable) {
+	auto [s, inserted] = states.emplace(&drawable, State());
+	State &state = s->second;
+	if (inserted) {
+		glGenQueries(1, &state.query);
+		state.phase = uint32_t(states.size());
+	}
+	//(results are read only on a drawable's first lookup in a frame, so the depth prepass and the main pass see the same visibility)
+	bool first_lookup = (state.seen != frame);
+	state.seen = frame;
+
+	if (first_lookup && state.pending) {
+		GLuint available = GL_FALSE;
+		glGetQueryObjectuiv(state.query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available) {
+			GLuint passed = 0;
+			glGetQueryObjectuiv(state.query, GL_QUERY_RESULT, &passed);
+			state.visible = (passed != 0);
+			state.pending = false;
+		}
+	}
+	return state;
+}
+
+bool OcclusionCulling::want_visible_query(State const &state) const {
+	if (state.pending) return false;
+	uint32_t interval = std::max(1u, visible_query_interval);
+	return (frame + state.phase) % interval == 0;
+}
+
+void OcclusionCulling::draw_proxy(glm::mat4 const &object_to_clip, glm::vec3 const &min, glm::vec3 const &max) {
+	//cube corner (0,0,0) -> min, (1,1,1) -> max:
+	glm::mat4 box_to_object = glm::mat4(
+		glm::vec4(max.x - min.x, 0.0f, 0.0f, 0.0f),
+		glm::vec4(0.0f, max.y - min.y, 0.0f, 0.0f),
+		glm::vec4(0.0f, 0.0f, max.z - min.z, 0.0f),
+		glm::vec4(min, 1.0f)
+	);
+	glm::mat4 box_to_clip = object_to_clip * box_to_object;
+
+	glUseProgram(proxy_program);
+	glBindVertexArray(proxy_vao);
+	glUniformMatrix4fv(proxy_OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(box_to_clip));
+
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glDepthMask(GL_FALSE);
+	GLboolean cull = glIsEnabled(GL_CULL_FACE);
+	glDisable(GL_CULL_FACE); //(box faces may be seen from inside-out when scaled negatively)
+
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 14);
+
+	if (cull) glEnable(GL_CULL_FACE);
+	glDepthMask(GL_TRUE);
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+/*
+ * OcclusionCulling holds the state Scene::draw needs to skip drawables that
+ *  are hidden behind others, using GL_ANY_SAMPLES_PASSED queries.
+ *
+ * To use, point Scene::occlusion at an OcclusionCulling that outlives the draw calls.
+ *
+ * Each frame (in the spirit of coherent hierarchical culling):
+ *  - drawables that were visible last frame are drawn first (occasionally
+ *    wrapped in a query, to notice when they become hidden);
+ *  - drawables that were hidden last frame get a query on their bounding box
+ *    (drawn without color or depth writes), and are then drawn with conditional
+ *    rendering on that query, so they appear without a frame of delay.
+ * Query results are only read once available, so the CPU never waits on the GPU.
+ *
+ * Drawables without bounds (see Scene::Drawable::min/max) are always drawn.
+ *
+ */
+
+#include "GL.hpp"
+#include "Scene.hpp"
+
+#include <glm/glm.hpp>
+
+#include <unordered_map>
+
+struct OcclusionCulling {
+	OcclusionCulling();
+	~OcclusionCulling();
+
+	OcclusionCulling(OcclusionCulling const &) = delete;
+	OcclusionCulling &operator=(OcclusionCulling const &) = delete;
+
+	//draw hidden drawables under conditional rendering on their bounding box query:
+	// (if false, hidden drawables are skipped until a query reports them visible -- cheaper, but may pop in a frame late)
+	bool conditional_render = true;
+
+	//visible drawables are re-queried once every this many frames (staggered across drawables):
+	uint32_t visible_query_interval = 4;
+
+	//counters for the most recent Scene::draw:
+	struct Stats {
+		uint32_t tested = 0; //drawables considered for culling (have bounds, a program, and vertices)
+		uint32_t culled = 0; //drawables whose latest query result failed (skipped; or, with conditional_render, drawn only if their new query passes)
+		uint32_t conditional = 0; //of those, drawables sent to conditional rendering (drawn if their query passes -- or isn't ready yet)
+		uint32_t queries = 0; //occlusion queries issued
+	} stats;
+
+	//-- internals (used by Scene::draw) ---
+
+	struct State {
+		GLuint query = 0;
+		bool pending = false; //query issued, result not yet read
+		bool visible = true; //most recent query result
+		uint32_t phase = 0; //staggers re-queries of visible drawables
+		uint32_t seen = 0; //last frame this drawable was drawn (for cleanup)
+	};
+	std::unordered_map< Scene::Drawable const *, State > states;
+	uint32_t frame = 0;
+
+	//start a frame: reset counters
+	void begin_frame();
+	//end a frame: forget drawables that weren't drawn this frame
+	void end_frame();
+
+	//get the state for a drawable, reading back its query result if it is ready (at most once per frame):
+	State &state(Scene::Drawable const &drawable);
+	//should a visible drawable be queried this frame?
+	bool want_visible_query(State const &state) const;
+
+	//draw a box (in object space) with color and depth writes off, as an occlusion proxy:
+	// (binds the proxy program and vao; caller should re-bind their own afterward)
+	void draw_proxy(glm::mat4 const &object_to_clip, glm::vec3 const &min, glm::vec3 const &max);
+
+	GLuint proxy_program = 0;
+	GLuint proxy_OBJECT_TO_CLIP_mat4 = -1U;
+	GLuint proxy_vao = 0;
+	GLuint proxy_vbo = 0;
+};
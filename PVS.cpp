@@ -0,0 +1,47 @@
+#include "PVS.hpp"
+
+#include "ChunkFile.hpp"
+
+#include <iostream>
+#include <stdexcept>
+
+PVS::PVS(std::string const &filename) {
+	ChunkFile file(filename);
+
+	struct Header {
+		uint32_t triangle_count;
+		uint32_t drawable_count;
+		uint32_t words_per_row;
+	};
+	static_assert(sizeof(Header) == 4 + 4 + 4, "PVS header is packed.");
+
+	ChunkView< Header > header;
+	file.view("pvh0", &header);
+	file.read("pvi0", &row_index);
+	file.read("pvs0", &rows);
+
+	if (file.trailing) {
+		std::cerr << "WARNING: trailing data in PVS file '" << filename << "'" << std::endl;
+	}
+
+	if (header.size() != 1) {
+		throw std::runtime_error("PVS file '" + filename + "' has a malformed header.");
+	}
+	drawable_count = header[0].drawable_count;
+	words_per_row = header[0].words_per_row;
+	if (row_index.size() != header[0].triangle_count) {
+		throw std::runtime_error("PVS file '" + filename + "' has a mis-sized row index.");
+	}
+	if (uint64_t(words_per_row) * 32 < drawable_count) {
+		throw std::runtime_error("PVS file '" + filename + "' has rows too short for its drawables.");
+	}
+	uint64_t row_count = (words_per_row ? rows.size() / words_per_row : 0);
+	if (row_count * words_per_row != rows.size()) {
+		throw std::runtime_error("PVS file '" + filename + "' has a partial row.");
+	}
+	for (auto const &r : row_index) {
+		if (r >= row_count) {
+			throw std::runtime_error("PVS file '" + filename + "' has an out-of-range row index.");
+		}
+	}
+}
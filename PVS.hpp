@@ -0,0 +1,43 @@
+#pragma once
+
+/*
+ * A PVS ("potentially visible set") records, for each triangle of a WalkMesh,
+ *  which of a scene's drawables might be seen by a player standing on it.
+ *
+ * PVS files are written by bake-pvs (see bake-pvs.cpp) and contain:
+ *  pvh0 < Header > -- walkmesh triangle count, drawable count, words per row
+ *  pvi0 < uint32_t > * -- for each triangle, the index of its row
+ *  pvs0 < uint32_t > * -- rows of words_per_row bitset words (bit i of a row: drawable i may be visible)
+ * Triangles with identical sets share a row.
+ *
+ * Drawables are numbered in scene-file ("msh0") order, which is also the order
+ *  Scene::load creates them in (as long as every mesh entry makes a drawable).
+ *
+ */
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+struct PVS {
+	//empty PVS (row() always returns nullptr):
+	PVS() = default;
+
+	//load from a file:
+	// note: will throw if file fails to read.
+	PVS(std::string const &filename);
+
+	//bitset for a walkmesh triangle, or nullptr if triangle is out of range:
+	uint32_t const *row(uint32_t triangle) const {
+		if (triangle >= row_index.size()) return nullptr;
+		return rows.data() + size_t(row_index[triangle]) * words_per_row;
+	}
+
+	uint32_t triangle_count() const { return uint32_t(row_index.size()); }
+	uint32_t drawable_count = 0;
+	uint32_t words_per_row = 0;
+
+	//-- internals ---
+	std::vector< uint32_t > row_index;
+	std::vector< uint32_t > rows;
+};
@@ -1,6 +1,7 @@
 #include "PlayMode.hpp"
 
 #include "LitColorTextureProgram.hpp"
+#include "DepthProgram.hpp"
 #include "TextureProgram.hpp"
 
 #include "DrawLines.hpp"
@@ -8,65 +9,174 @@
 #include "Load.hpp"
 #include "gl_errors.hpp"
 #include "data_path.hpp"
+#include "DataFile.hpp"
+#include "DataReads.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/quaternion.hpp>
 
+#include <algorithm>
+#include <iostream>
 #include <random>
+#include <unordered_set>
+
+//PlayMode's data files are all read at once, early in startup (see DataReads.hpp):
+ReadAhead play_mode_files({
+	data_path("waddle.pnct"),
+	data_path("waddle.scene"),
+	data_path("game5.opus"),
+	data_path("waddle.w"),
+	data_path("waddle.pvs"), //(optional, so may fail to read -- which is fine)
+	data_path("Sixtyfour_Convergence/SixtyfourConvergence-Regular.ttf"),
+});
+
+//waddle.pnct is parsed on a worker thread (so it overlaps other loading) and then uploaded a slice per frame (see PlayMode::update):
+std::unique_ptr< MeshBuffer::Async > phonebank_meshes_async;
+Load< void > phonebank_meshes_parsed(LoadOnWorker, {}, [](){
+	//(keeps a CPU copy of the vertices, which StaticBatch merges from)
+	phonebank_meshes_async = std::make_unique< MeshBuffer::Async >(data_path("waddle.pnct"), true);
+	phonebank_meshes_async->wait_parsed(); //(so the GL thread doesn't wait for it below)
+});
 
 GLuint phonebank_meshes_for_lit_color_texture_program = 0;
-Load< MeshBuffer > phonebank_meshes(LoadTagDefault, []() -> MeshBuffer const * {
-	MeshBuffer const *ret = new MeshBuffer(data_path("waddle.pnct"));
+GLuint phonebank_meshes_for_depth_program = 0; //(reads only the packed position stream)
+Load< MeshBuffer > phonebank_meshes(LoadOnGLThread, {&phonebank_meshes_parsed, &lit_color_texture_program, &depth_program}, []() -> MeshBuffer const * {
+	MeshBuffer const *ret = phonebank_meshes_async->buffer();
 	phonebank_meshes_for_lit_color_texture_program = ret->make_vao_for_program(lit_color_texture_program->program);
+	phonebank_meshes_for_depth_program = ret->make_vao_for_program(depth_program->program);
 	return ret;
 });
 
-Load< Scene > phonebank_scene(LoadTagDefault, []() -> Scene const * {
+//(scene parsing makes no GL calls -- it only reads the pipelines set up by the loads it follows)
+Load< Scene > phonebank_scene(LoadOnWorker, {&phonebank_meshes, &lit_color_texture_program}, []() -> Scene const * {
+	Scene::Drawable::Pipeline pipeline = lit_color_texture_program_pipeline;
+	pipeline.vao = phonebank_meshes_for_lit_color_texture_program;
+	pipeline.depth_vao = phonebank_meshes_for_depth_program;
+	pipeline.normal_octahedral = phonebank_meshes->quantized;
+
+	//if waddle.scene was baked against waddle.pnct, drawables are made straight from 'pipeline':
+	Scene::Baked baked{*phonebank_meshes, pipeline};
+
 	return new Scene(data_path("waddle.scene"), [&](Scene &scene, Scene::Transform *transform, std::string const &mesh_name){
-		Mesh const &mesh = phonebank_meshes->lookup(mesh_name);
+		MeshBuffer::Handle handle = phonebank_meshes->handle(mesh_name); //(throws if not found)
+		Mesh const &mesh = (*phonebank_meshes)[handle];
 
 		scene.drawables.emplace_back(transform);
 		Scene::Drawable &drawable = scene.drawables.back();
 
-		drawable.pipeline = lit_color_texture_program_pipeline;
+		drawable.min = mesh.min;
+		drawable.max = mesh.max;
+
+		drawable.pipeline = pipeline;
 
-		drawable.pipeline.vao = phonebank_meshes_for_lit_color_texture_program;
 		drawable.pipeline.type = mesh.type;
 		drawable.pipeline.start = mesh.start;
 		drawable.pipeline.count = mesh.count;
+		drawable.pipeline.index_type = mesh.index_type;
+		drawable.pipeline.position_dequantize = mesh.dequantize;
 
-	});
+		for (Mesh const &lod : phonebank_meshes->lookup_lods(handle)) {
+			drawable.lods.emplace_back(Scene::Drawable::LOD{lod.type, lod.start, lod.count});
+		}
+
+	}, &baked);
 });
 
-Load< Sound::Sample > game5_music_sample(LoadTagDefault, []() -> Sound::Sample const * {
+Load< Sound::Sample > game5_music_sample(LoadOnWorker, {}, []() -> Sound::Sample const * {
 	return new Sound::Sample(data_path("game5.opus"));
 });
 
 WalkMesh const *walkmesh = nullptr;
-Load< WalkMeshes > phonebank_walkmeshes(LoadTagDefault, []() -> WalkMeshes const * {
+Load< WalkMeshes > phonebank_walkmeshes(LoadOnWorker, {}, []() -> WalkMeshes const * {
 	WalkMeshes *ret = new WalkMeshes(data_path("waddle.w"));
 	walkmesh = &ret->lookup("WalkMesh");
 	return ret;
 });
 
-PlayMode::PlayMode() : scene(*phonebank_scene) {
-	for (auto &transform : scene.transforms) {
-		if (transform.name == "Raccoon") raccoon = &transform;
-		else if (transform.name == "Duck") duck = &transform;
-		else if (transform.name == "Swan.012") swan = &transform;
+//precomputed visibility from the walkmesh (optional -- written by scenes/bake-pvs):
+Load< PVS > phonebank_pvs(LoadOnWorker, {}, []() -> PVS const * {
+	std::string filename = data_path("waddle.pvs");
+	if (!DataFile::exists(filename)) {
+		std::cout << "NOTE: no PVS at '" << filename << "'; drawing without precomputed visibility." << std::endl;
+		return new PVS();
 	}
+	return new PVS(filename);
+});
+
+PlayMode::PlayMode() : scene(*phonebank_scene) {
+	raccoon = scene.lookup("Raccoon");
+	duck = scene.lookup("Duck");
+	swan = scene.lookup("Swan.012");
 
 	if (raccoon == nullptr) throw std::runtime_error("Raccoon not found.");
 	else if (duck == nullptr) throw std::runtime_error("Duck not found.");
 	else if (swan == nullptr) throw std::runtime_error("Swan not found.");
 
-	raccoon_rotation = raccoon->rotation;
-	duck_rotation = duck->rotation;
-
 	obj_bbox = glm::vec2(0.5f);
 
 	swan_bbox = glm::vec2(10.f);
 
+	bvh.build(scene);
+	scene.bvh = &bvh;
+
+	scene.occlusion = &occlusion;
+
+	//lay down depth first with the position-only program, so the lit shader runs about once per pixel:
+	scene.depth_prepass = &depth_program_pipeline;
+
+	//large drawables (walls, buildings, terrain) make good occluders for CPU occlusion culling:
+	for (auto const &drawable : scene.drawables) {
+		DrawableBVH::AABB box = DrawableBVH::world_bounds(drawable);
+		if (box.empty()) continue;
+		glm::vec3 size = box.max - box.min;
+		if (std::max(size.x, std::max(size.y, size.z)) < 4.0f) continue;
+		software_occlusion.add_occluder(drawable, *phonebank_meshes);
+	}
+	scene.software_occlusion = &software_occlusion;
+
+	//if the scene file doesn't animate the raccoon and duck, give them a gentle wobble:
+	{
+		bool animated = false;
+		for (auto const &clip : scene.clips) {
+			for (auto const &track : clip.tracks) {
+				if (track.transform == raccoon || track.transform == duck) animated = true;
+			}
+		}
+		if (!animated) {
+			scene.clips.emplace_back();
+			Scene::Clip &wobble = scene.clips.back();
+			wobble.name = "Wobble";
+			wobble.duration = 10.0f;
+			for (auto const &[transform, rotation] : {std::make_pair(raccoon, raccoon->rotation), std::make_pair(duck, duck->rotation)}) {
+				wobble.tracks.emplace_back(transform);
+				Scene::Clip::Track &track = wobble.tracks.back();
+				track.channel = Scene::Clip::Track::Rotation;
+				constexpr uint32_t Keys = 32;
+				for (uint32_t k = 0; k <= Keys; ++k) {
+					float amt = k / float(Keys);
+					glm::quat r = rotation * glm::angleAxis(
+						glm::radians(5.0f * std::sin(amt * 2.0f * float(M_PI))),
+						glm::vec3(0.0f, 1.0f, 0.0f)
+					);
+					track.times.emplace_back(amt * wobble.duration);
+					track.values.emplace_back(r.x, r.y, r.z, r.w);
+				}
+			}
+		}
+		for (auto const &clip : scene.clips) {
+			animation.play(clip);
+		}
+	}
+
+	//if the scene has no lights, light it with a hemisphere light from above:
+	if (scene.lights.empty()) {
+		scene.transforms.emplace_back();
+		scene.set_name(&scene.transforms.back(), "Default Light");
+		scene.lights.emplace_back(&scene.transforms.back());
+		scene.lights.back().type = Scene::Light::Hemisphere;
+		scene.lights.back().energy = glm::vec3(1.0f, 1.0f, 0.95f);
+	}
+
 	Text text1(newline + "You are a Raccoon                                                                                     Press enter to Start",
 				script_line_length,
 				script_line_height
@@ -155,6 +265,15 @@ PlayMode::PlayMode() : scene(*phonebank_scene) {
 	//start player walking at nearest walk point:
 	player.at = walkmesh->nearest_walk_point(player.transform->position);
 
+	//use the PVS if it was baked for this scene and walkmesh:
+	if (phonebank_pvs->triangle_count() != 0) {
+		if (phonebank_pvs->triangle_count() == walkmesh->triangles.size() && phonebank_pvs->drawable_count == scene.drawables.size()) {
+			pvs = &*phonebank_pvs;
+		} else {
+			std::cerr << "WARNING: PVS doesn't match scene and walkmesh; ignoring it." << std::endl;
+		}
+	}
+
 	music_loop = Sound::loop_3D(*game5_music_sample, 1.0f, player.camera->transform->position, 10.0f);
 }
 
@@ -255,22 +374,39 @@ bool PlayMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size)
 }
 
 void PlayMode::update(float elapsed) {
-	// wobble raccoon
-	{
-		//slowly rotates through [0,1):
-		wobble += elapsed / 10.0f;
-		wobble -= std::floor(wobble);
+	//finish uploading meshes (a slice per frame):
+	if (!meshes_resident && phonebank_meshes_async->upload()) {
+		meshes_resident = true;
+
+		//without a PVS, merge drawables that never move into a few large batches to cut draw calls:
+		// (a PVS culls individual drawables, which batching would defeat, so the two are used as alternatives)
+		// (batching reads the CPU copy of the vertices, which the meshes get once they are resident)
+		if (!pvs) {
+			//anything moved by the player or by a clip (or under something that is) isn't static:
+			std::unordered_set< Scene::Transform const * > moving{raccoon, duck, player.transform};
+			for (auto const &clip : scene.clips) {
+				for (auto const &track : clip.tracks) {
+					moving.emplace(track.transform);
+				}
+			}
+			static_batch = std::make_unique< StaticBatch >(scene, *phonebank_meshes, [&moving](Scene::Drawable const &drawable) {
+				for (Scene::Transform const *t = drawable.transform; t != nullptr; t = t->parent) {
+					if (moving.count(t)) return false;
+				}
+				return true;
+			});
 
-		raccoon->rotation = raccoon_rotation * glm::angleAxis(
-			glm::radians(5.0f * std::sin(wobble * 2.0f * float(M_PI))),
-			glm::vec3(0.0f, 1.0f, 0.0f)
-		);
-		duck->rotation = duck_rotation * glm::angleAxis(
-			glm::radians(5.0f * std::sin(wobble * 2.0f * float(M_PI))),
-			glm::vec3(0.0f, 1.0f, 0.0f)
-		);
+			//track the batches instead of the drawables merged into them:
+			for (auto const &drawable : scene.drawables) {
+				if (drawable.batched) bvh.remove(&drawable);
+				if (drawable.batch) bvh.insert(&drawable);
+			}
+		}
 	}
-	
+
+	//keyframe animation (raccoon and duck wobble, plus any clips from the scene file):
+	animation.update(elapsed);
+
 	//player walking:
 	{
 		//combine inputs into a move:
@@ -363,34 +499,23 @@ void PlayMode::update(float elapsed) {
 		5.0f, 0.0f, 0.0f, 1.0f
 	);
 
+	//raccoon and duck wobble (and the player walks), so bounds need refitting:
+	bvh.update();
+
 	{
 		// check if player is near duck/raccoon
 		// https://developer.mozilla.org/en-US/docs/Games/Techniques/3D_collision_detection
-		// barely a bbox, more like a bsquare
+		// barely a bbox, more like a bsquare (ignores height)
 
-		float mminX = player.transform->position.x - obj_bbox.x;
-		float mmaxX = player.transform->position.x + obj_bbox.x;
-		float mminY = player.transform->position.y - obj_bbox.y;
-		float mmaxY = player.transform->position.y + obj_bbox.y;
-		
-		float rminX = raccoon->position.x - obj_bbox.x;
-		float rmaxX = raccoon->position.x + obj_bbox.x;
-		float rminY = raccoon->position.y - obj_bbox.y;
-		float rmaxY = raccoon->position.y + obj_bbox.y;
-
-		float dminX = duck->position.x - obj_bbox.x;
-		float dmaxX = duck->position.x + obj_bbox.x;
-		float dminY = duck->position.y - obj_bbox.y;
-		float dmaxY = duck->position.y + obj_bbox.y;
-
-		float sminX = swan->position.x - swan_bbox.x;
-		float smaxX = swan->position.x + swan_bbox.x;
-		float sminY = swan->position.y - swan_bbox.y;
-		float smaxY = swan->position.y + swan_bbox.y;
-
-		bool raccoonCollide = (mminX <= rmaxX && mmaxX >= rminX && mminY <= rmaxY && mmaxY >= rminY);
-		bool duckCollide = (mminX <= dmaxX && mmaxX >= dminX && mminY <= dmaxY && mmaxY >= dminY);
-		bool swanCollide = (mminX <= smaxX && mmaxX >= sminX && mminY <= smaxY && mmaxY >= sminY);
+		//does the player's square overlap the square of size 'range' around target's origin?
+		auto near = [this](Scene::Transform const *target, glm::vec2 const &range) {
+			glm::vec2 d = glm::abs(glm::vec2(player.transform->position) - glm::vec2(target->position));
+			return d.x <= obj_bbox.x + range.x && d.y <= obj_bbox.y + range.y;
+		};
+
+		bool raccoonCollide = near(raccoon, obj_bbox);
+		bool duckCollide = near(duck, obj_bbox);
+		bool swanCollide = near(swan, swan_bbox);
 		
 		if(swanCollide){
 			if(cont.pressed) trigger = true;
@@ -453,12 +578,20 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 	//update camera aspect ratio for drawable:
 	player.camera->aspect = float(drawable_size.x) / float(drawable_size.y);
 
-	//set up light type and position for lit_color_texture_program:
-	// TODO: consider using the Light(s) in the scene to do this
+	//only draw what can be seen from the player's walkmesh triangle:
+	if (pvs) {
+		scene.visible_set = pvs->row(walkmesh->triangle_index(player.at));
+		scene.visible_set_size = (scene.visible_set ? pvs->drawable_count : 0);
+	}
+
+	//bin scene lights for lit_color_texture_program:
+	light_clusters.update(scene, *player.camera, drawable_size);
 	glUseProgram(lit_color_texture_program->program);
-	glUniform1i(lit_color_texture_program->LIGHT_TYPE_int, 1);
-	glUniform3fv(lit_color_texture_program->LIGHT_DIRECTION_vec3, 1, glm::value_ptr(glm::vec3(0.0f, 0.0f,-1.0f)));
-	glUniform3fv(lit_color_texture_program->LIGHT_ENERGY_vec3, 1, glm::value_ptr(glm::vec3(1.0f, 1.0f, 0.95f)));
+	glUniform1i(lit_color_texture_program->GLOBAL_LIGHTS_int, light_clusters.global_count);
+	glUniform3i(lit_color_texture_program->CLUSTER_GRID_ivec3, light_clusters.grid.x, light_clusters.grid.y, light_clusters.grid.z);
+	glUniform4fv(lit_color_texture_program->CLUSTER_DEPTH_vec4, 1, glm::value_ptr(light_clusters.depth_row));
+	glUniform2fv(lit_color_texture_program->CLUSTER_TILE_vec2, 1, glm::value_ptr(light_clusters.tile_scale));
+	glUniform2fv(lit_color_texture_program->CLUSTER_SLICE_vec2, 1, glm::value_ptr(light_clusters.slice_scale_bias));
 	glUseProgram(0);
 
 	glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
@@ -468,7 +601,12 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 	glEnable(GL_DEPTH_TEST);
 	glDepthFunc(GL_LESS); //this is the default depth comparison function, but FYI you can change it.
 
-	scene.draw(*player.camera);
+	//(until the meshes are resident, only the overlay is drawn)
+	if (meshes_resident) {
+		light_clusters.bind(1);
+		scene.draw(*player.camera);
+		light_clusters.unbind(1);
+	}
 
 	/* In case you are wondering if your walkmesh is lining up with your scene, try:
 	{
@@ -516,12 +654,13 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 		));
 
 		constexpr float H = 0.09f;
-		lines.draw_text(bottomText,
+		std::string text = (meshes_resident ? bottomText : "Loading... " + std::to_string(int(100.0f * phonebank_meshes_async->progress())) + "%");
+		lines.draw_text(text,
 			glm::vec3(-aspect + 0.1f * H, -1.0 + 0.1f * H, 0.0),
 			glm::vec3(H, 0.0f, 0.0f), glm::vec3(0.0f, H, 0.0f),
 			glm::u8vec4(0x00, 0x00, 0x00, 0x00));
 		float ofs = 2.0f / drawable_size.y;
-		lines.draw_text(bottomText,
+		lines.draw_text(text,
 			glm::vec3(-aspect + 0.1f * H + ofs, -1.0 + + 0.1f * H + ofs, 0.0),
 			glm::vec3(H, 0.0f, 0.0f), glm::vec3(0.0f, H, 0.0f),
 			glm::u8vec4(0x00, 0x00, 0xff, 0x00));
@@ -4,11 +4,19 @@
 #include "Sound.hpp"
 #include "Font.hpp"
 #include "WalkMesh.hpp"
+#include "Animation.hpp"
+#include "PVS.hpp"
+#include "StaticBatch.hpp"
+#include "DrawableBVH.hpp"
+#include "LightClusters.hpp"
+#include "OcclusionCulling.hpp"
+#include "SoftwareOcclusion.hpp"
 
 #include <glm/glm.hpp>
 
 #include <vector>
 #include <deque>
+#include <memory>
 
 // ------- from Jim's notes -------
 struct PosTexVertex {
@@ -52,9 +60,6 @@ struct PlayMode : Mode {
 	Scene::Transform *raccoon = nullptr;
 	Scene::Transform *duck = nullptr;
 	Scene::Transform *swan = nullptr;
-	glm::quat raccoon_rotation;
-	glm::quat duck_rotation;
-	float wobble = 0.0f;
 	
 	std::shared_ptr< Font > TextFont;
 	std::vector<Text> texts;
@@ -79,6 +84,29 @@ struct PlayMode : Mode {
 	glm::vec2 obj_bbox;
 	glm::vec2 swan_bbox;
 
+	//plays scene.clips (including the raccoon and duck wobble):
+	AnimationSampler animation;
+
+	//scene lights, binned per frame for lit_color_texture_program:
+	LightClusters light_clusters;
+
+	//spatial index over scene drawables, used to skip drawables outside the view (scene.bvh points here):
+	DrawableBVH bvh;
+
+	//skips drawing drawables hidden behind others (scene.occlusion points here):
+	OcclusionCulling occlusion;
+	//...and, before that, on the CPU against the scene's largest drawables (scene.software_occlusion points here):
+	SoftwareOcclusion software_occlusion;
+
+	//precomputed visibility per walkmesh triangle (nullptr if none was baked for this scene):
+	PVS const *pvs = nullptr;
+
+	//set once the scene's meshes have finished uploading (see MeshBuffer::Async); until then, the scene isn't drawn:
+	bool meshes_resident = false;
+
+	//non-moving drawables merged into a few large drawables (only made when there is no PVS, once meshes are resident):
+	std::unique_ptr< StaticBatch > static_batch;
+
 	//player info:
 	struct Player {
 		WalkPoint at;
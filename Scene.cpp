@@ -1,11 +1,23 @@
 #include "Scene.hpp"
 
 #include "gl_errors.hpp"
+#include "ChunkFile.hpp"
+#include "DrawableBVH.hpp"
+#include "Mesh.hpp"
+#include "OcclusionCulling.hpp"
+#include "SoftwareOcclusion.hpp"
 #include "read_write_chunk.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
+#include <cstring>
 #include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <string_view>
+#include <tuple>
 
 //-------------------------
 
@@ -79,6 +91,80 @@ glm::mat4 Scene::Camera::make_projection() const {
 
 //-------------------------
 
+void Scene::NameTable::clear() {
+	strings.assign(1, std::string());
+	ids.clear();
+	ids.emplace(std::string(), 0);
+}
+
+uint32_t Scene::NameTable::intern(std::string const &name) {
+	auto ret = ids.emplace(name, uint32_t(strings.size()));
+	if (ret.second) strings.emplace_back(name);
+	return ret.first->second;
+}
+
+uint32_t Scene::NameTable::find(std::string const &name) const {
+	auto f = ids.find(name);
+	if (f == ids.end()) return -1U;
+	return f->second;
+}
+
+//strip a Blender-style ".NNN" duplicate suffix:
+static std::string name_family(std::string const &name) {
+	auto dot = name.rfind('.');
+	if (dot == std::string::npos || dot + 1 == name.size()) return name;
+	for (auto c = name.begin() + dot + 1; c != name.end(); ++c) {
+		if (!(*c >= '0' && *c <= '9')) return name;
+	}
+	return name.substr(0, dot);
+}
+
+void Scene::set_name(Transform *transform, std::string const &name) {
+	assert(transform);
+
+	//remove from old index entries (if any):
+	auto unindex = [transform](std::unordered_map< uint32_t, std::vector< Transform * > > &index, uint32_t id) {
+		auto f = index.find(id);
+		if (f == index.end()) return;
+		auto &list = f->second;
+		list.erase(std::remove(list.begin(), list.end(), transform), list.end());
+		if (list.empty()) index.erase(f);
+	};
+	if (transform->name_id != 0) {
+		unindex(transforms_by_name, transform->name_id);
+		unindex(transforms_by_family, names.find(name_family(names[transform->name_id])));
+	}
+
+	transform->name_id = names.intern(name);
+	if (transform->name_id == 0) return; //empty names aren't indexed
+
+	transforms_by_name[transform->name_id].emplace_back(transform);
+	transforms_by_family[names.intern(name_family(name))].emplace_back(transform);
+}
+
+Scene::Transform *Scene::lookup(std::string const &name) const {
+	auto f = transforms_by_name.find(names.find(name));
+	if (f == transforms_by_name.end()) return nullptr;
+	assert(!f->second.empty());
+	return f->second[0];
+}
+
+std::vector< Scene::Transform * > const &Scene::lookup_family(std::string const &family) const {
+	static std::vector< Transform * > const empty;
+	auto f = transforms_by_family.find(names.find(family));
+	if (f == transforms_by_family.end()) return empty;
+	return f->second;
+}
+
+Scene::Clip const *Scene::lookup_clip(std::string const &name) const {
+	for (auto const &clip : clips) {
+		if (clip.name == name) return &clip;
+	}
+	return nullptr;
+}
+
+//-------------------------
+
 
 void Scene::draw(Camera const &camera) const {
 	assert(camera.transform);
@@ -89,31 +175,73 @@ void Scene::draw(Camera const &camera) const {
 
 void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light) const {
 
-	//Iterate through all drawables, sending each one to OpenGL:
-	for (auto const &drawable : drawables) {
-		//Reference to drawable's pipeline for convenience:
+	//for level-of-detail selection: clip.w is view depth, and the length of the clip-space y row
+	// is the projection's y scale (assuming world_to_clip is a projection times a rigid transform):
+	glm::vec4 depth_row = glm::vec4(world_to_clip[0][3], world_to_clip[1][3], world_to_clip[2][3], world_to_clip[3][3]);
+	float y_scale = glm::length(glm::vec3(world_to_clip[0][1], world_to_clip[1][1], world_to_clip[2][1]));
+
+	//pick a level of detail for a drawable (returns the range to draw):
+	struct Range {
+		GLenum type;
+		GLuint start;
+		GLuint count;
+	};
+	auto select_lod = [&](Drawable const &drawable, glm::mat4x3 const &object_to_world) -> Range {
 		Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
 
-		//skip any drawables without a shader program set:
-		if (pipeline.program == 0) continue;
-		//skip any drawables that don't reference any vertex array:
-		if (pipeline.vao == 0) continue;
-		//skip any drawables that don't contain any vertices:
-		if (pipeline.count == 0) continue;
+		GLenum type = pipeline.type;
+		GLuint start = pipeline.start;
+		GLuint count = pipeline.count;
+		if (!drawable.lods.empty() && drawable.min.x <= drawable.max.x) {
+			//projected size of the bounding sphere (in viewport heights):
+			glm::vec3 center = object_to_world * glm::vec4(0.5f * (drawable.min + drawable.max), 1.0f);
+			glm::vec3 half = 0.5f * (drawable.max - drawable.min);
+			float scale = std::max(glm::length(object_to_world[0]), std::max(glm::length(object_to_world[1]), glm::length(object_to_world[2])));
+			float radius = glm::length(half) * scale;
+			float depth = glm::dot(depth_row, glm::vec4(center, 1.0f));
+			float size = (depth > radius ? radius * y_scale / depth : std::numeric_limits< float >::infinity());
+
+			//threshold below which 'level' is drawn:
+			auto threshold = [this](uint32_t level) {
+				return lod_screen_size / float(1u << std::min(level - 1u, 31u));
+			};
+
+			uint32_t level = std::min(drawable.lod_level, uint32_t(drawable.lods.size()));
+			while (level > 0 && size > threshold(level) * (1.0f + lod_hysteresis)) --level;
+			while (level < drawable.lods.size() && size < threshold(level + 1) * (1.0f - lod_hysteresis)) ++level;
+			drawable.lod_level = level;
+
+			if (level > 0 && drawable.lods[level-1].count != 0) {
+				type = drawable.lods[level-1].type;
+				start = drawable.lods[level-1].start;
+				count = drawable.lods[level-1].count;
+			}
+		}
+		return Range{type, start, count};
+	};
 
+	//GL state left by the previous draw, so that runs of drawables with the same program and vertex array don't set them again:
+	GLuint bound_program = 0;
+	GLuint bound_vao = 0;
+	//scratch space for glMultiDrawElements:
+	std::vector< void const * > offsets;
 
+	//send ranges that share a pipeline (see 'same_state', below) to OpenGL:
+	auto draw_ranges = [&](Drawable::Pipeline const &pipeline, glm::mat4x3 const &object_to_world, GLenum type, GLint const *starts, GLsizei const *counts, GLsizei ranges) {
 		//Set shader program:
-		glUseProgram(pipeline.program);
+		if (pipeline.program != bound_program) {
+			glUseProgram(pipeline.program);
+			bound_program = pipeline.program;
+		}
 
 		//Set attribute sources:
-		glBindVertexArray(pipeline.vao);
+		if (pipeline.vao != bound_vao) {
+			glBindVertexArray(pipeline.vao);
+			bound_vao = pipeline.vao;
+		}
 
 		//Configure program uniforms:
 
-		//the object-to-world matrix is used in all three of these uniforms:
-		assert(drawable.transform); //drawables *must* have a transform
-		glm::mat4x3 object_to_world = drawable.transform->make_local_to_world();
-
 		//OBJECT_TO_CLIP takes vertices from object space to clip space:
 		if (pipeline.OBJECT_TO_CLIP_mat4 != -1U) {
 			glm::mat4 object_to_clip = world_to_clip * glm::mat4(object_to_world);
@@ -134,6 +262,14 @@ void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_lig
 			glUniformMatrix3fv(pipeline.NORMAL_TO_LIGHT_mat3, 1, GL_FALSE, glm::value_ptr(normal_to_light));
 		}
 
+		//POSITION_DEQUANTIZE and NORMAL_OCTAHEDRAL decode quantized vertices:
+		if (pipeline.POSITION_DEQUANTIZE_mat4x3 != -1U) {
+			glUniformMatrix4x3fv(pipeline.POSITION_DEQUANTIZE_mat4x3, 1, GL_FALSE, glm::value_ptr(pipeline.position_dequantize));
+		}
+		if (pipeline.NORMAL_OCTAHEDRAL_bool != -1U) {
+			glUniform1i(pipeline.NORMAL_OCTAHEDRAL_bool, pipeline.normal_octahedral ? 1 : 0);
+		}
+
 		//set any requested custom uniforms:
 		if (pipeline.set_uniforms) pipeline.set_uniforms();
 
@@ -145,8 +281,25 @@ void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_lig
 			}
 		}
 
-		//draw the object:
-		glDrawArrays(pipeline.type, pipeline.start, pipeline.count);
+		//draw the object(s):
+		if (pipeline.index_type) {
+			size_t index_size = (pipeline.index_type == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t));
+			if (ranges == 1) {
+				glDrawElements(type, counts[0], pipeline.index_type, (GLbyte *)0 + starts[0] * index_size);
+			} else {
+				offsets.clear();
+				for (GLsizei r = 0; r < ranges; ++r) {
+					offsets.emplace_back((GLbyte *)0 + starts[r] * index_size);
+				}
+				glMultiDrawElements(type, counts, pipeline.index_type, offsets.data(), ranges);
+			}
+		} else {
+			if (ranges == 1) {
+				glDrawArrays(type, starts[0], counts[0]);
+			} else {
+				glMultiDrawArrays(type, starts, counts, ranges);
+			}
+		}
 
 		//un-bind textures:
 		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
@@ -156,9 +309,248 @@ void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_lig
 			}
 		}
 		glActiveTexture(GL_TEXTURE0);
+	};
+
+	//send one drawable to OpenGL:
+	auto draw_drawable = [&](Drawable const &drawable, glm::mat4x3 const &object_to_world) {
+		Range range = select_lod(drawable, object_to_world);
+		GLint start = GLint(range.start);
+		GLsizei count = GLsizei(range.count);
+		draw_ranges(drawable.pipeline, object_to_world, range.type, &start, &count, 1);
+	};
+
+	//runs of consecutive drawables that can be sent with one multi-draw call:
+	// (add_to_run starts a new run unless 'same' says 'drawable' can join the current one; 'send' draws a finished run)
+	Drawable const *run = nullptr; //first drawable in current run
+	glm::mat4x3 run_to_world;
+	GLenum run_type = GL_TRIANGLES;
+	std::vector< GLint > run_starts;
+	std::vector< GLsizei > run_counts;
+	auto flush_run = [&](auto const &send) {
+		if (run) send(*run);
+		run = nullptr;
+		run_starts.clear();
+		run_counts.clear();
+	};
+	auto add_to_run = [&](Drawable const &drawable, glm::mat4x3 const &object_to_world, Range const &range, auto const &same, auto const &send) {
+		if (run && !(range.type == run_type && same(*run, drawable))) flush_run(send);
+		if (!run) {
+			run = &drawable;
+			run_to_world = object_to_world;
+			run_type = range.type;
+		}
+		run_starts.emplace_back(GLint(range.start));
+		run_counts.emplace_back(GLsizei(range.count));
+	};
+
+	//drawables can be sent with one multi-draw call if they use the same transform and pipeline state (and differ only in what they draw):
+	auto same_state = [](Drawable const &a, Drawable const &b) {
+		if (a.transform != b.transform) return false;
+		Drawable::Pipeline const &pa = a.pipeline;
+		Drawable::Pipeline const &pb = b.pipeline;
+		if (pa.set_uniforms || pb.set_uniforms) return false; //(can't be compared)
+		if (pa.program != pb.program || pa.vao != pb.vao || pa.index_type != pb.index_type) return false;
+		if (pa.OBJECT_TO_CLIP_mat4 != pb.OBJECT_TO_CLIP_mat4
+		 || pa.OBJECT_TO_LIGHT_mat4x3 != pb.OBJECT_TO_LIGHT_mat4x3
+		 || pa.NORMAL_TO_LIGHT_mat3 != pb.NORMAL_TO_LIGHT_mat3
+		 || pa.POSITION_DEQUANTIZE_mat4x3 != pb.POSITION_DEQUANTIZE_mat4x3
+		 || pa.NORMAL_OCTAHEDRAL_bool != pb.NORMAL_OCTAHEDRAL_bool) return false;
+		if (pa.POSITION_DEQUANTIZE_mat4x3 != -1U && pa.position_dequantize != pb.position_dequantize) return false;
+		if (pa.NORMAL_OCTAHEDRAL_bool != -1U && pa.normal_octahedral != pb.normal_octahedral) return false;
+		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
+			if (pa.textures[i].texture != pb.textures[i].texture) return false;
+			if (pa.textures[i].texture != 0 && pa.textures[i].target != pb.textures[i].target) return false;
+		}
+		return true;
+	};
+
+	//drawables that can't be drawn are skipped:
+	auto drawable_ok = [](Drawable const &drawable) {
+		//skip drawables that are drawn as part of a static batch:
+		if (drawable.batched) return false;
+		//skip any drawables without a shader program set:
+		if (drawable.pipeline.program == 0) return false;
+		//skip any drawables that don't reference any vertex array:
+		if (drawable.pipeline.vao == 0) return false;
+		//skip any drawables that don't contain any vertices:
+		if (drawable.pipeline.count == 0) return false;
+		return true;
+	};
+
+	//precomputed visibility (checked first, since it is cheapest):
+	auto pvs_hidden = [&](uint32_t index) {
+		if (!visible_set || index >= visible_set_size) return false;
+		return (visible_set[index / 32] & (1u << (index % 32))) == 0;
+	};
 
+	//frustum culling (drawables the BVH doesn't track are always drawn):
+	std::vector< Drawable const * > on_screen;
+	if (bvh) {
+		bvh->query_frustum(world_to_clip, &on_screen);
+		std::sort(on_screen.begin(), on_screen.end());
+	}
+	auto off_screen = [&](Drawable const &drawable) {
+		if (!bvh || !bvh->tracks(&drawable)) return false;
+		return !std::binary_search(on_screen.begin(), on_screen.end(), &drawable);
+	};
+
+	//CPU occlusion culling: rasterize occluders, then test drawable boxes before submitting them:
+	if (software_occlusion) software_occlusion->render(world_to_clip);
+	auto software_hidden = [&](Drawable const &drawable, glm::mat4x3 const &object_to_world) {
+		if (!software_occlusion) return false;
+		if (!(drawable.min.x <= drawable.max.x)) return false; //no bounds to test
+		return !software_occlusion->visible(world_to_clip * glm::mat4(object_to_world), drawable.min, drawable.max);
+	};
+
+	if (occlusion) occlusion->begin_frame();
+
+	//Depth prepass: lay down the depth of everything first, reading only positions, so that the passes below
+	// (drawn with GL_LEQUAL) run the full shader about once per pixel instead of once per overlapping surface:
+	GLint depth_func = GL_LESS;
+	if (depth_prepass && depth_prepass->program) {
+		Drawable::Pipeline depth = *depth_prepass; //(vao, index type, and decoding are filled in per run)
+		auto same_depth_state = [](Drawable const &a, Drawable const &b) {
+			return a.transform == b.transform
+				&& a.pipeline.depth_vao == b.pipeline.depth_vao
+				&& a.pipeline.index_type == b.pipeline.index_type
+				&& a.pipeline.position_dequantize == b.pipeline.position_dequantize;
+		};
+		auto send_depth_run = [&](Drawable const &first) {
+			depth.vao = first.pipeline.depth_vao;
+			depth.index_type = first.pipeline.index_type;
+			depth.position_dequantize = first.pipeline.position_dequantize;
+			draw_ranges(depth, run_to_world, run_type, run_starts.data(), run_counts.data(), GLsizei(run_starts.size()));
+		};
+
+		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+		uint32_t index = 0;
+		for (auto const &drawable : drawables) {
+			if (pvs_hidden(index++)) continue;
+			if (!drawable_ok(drawable) || drawable.pipeline.depth_vao == 0) continue;
+			if (off_screen(drawable)) continue;
+			assert(drawable.transform); //drawables *must* have a transform
+			glm::mat4x3 object_to_world = drawable.transform->make_local_to_world();
+			if (software_hidden(drawable, object_to_world)) continue;
+			//an occlusion query against a drawable's own depth would always pass, so leave out the drawables that will be queried:
+			if (occlusion && drawable.min.x <= drawable.max.x) {
+				OcclusionCulling::State &state = occlusion->state(drawable);
+				if (!state.visible || occlusion->want_visible_query(state)) continue;
+			}
+			add_to_run(drawable, object_to_world, select_lod(drawable, object_to_world), same_depth_state, send_depth_run);
+		}
+		flush_run(send_depth_run);
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+		glGetIntegerv(GL_DEPTH_FUNC, &depth_func);
+		glDepthFunc(GL_LEQUAL);
 	}
 
+	//runs of consecutive drawables with the same state -- e.g., static batches, or drawables sharing a transform -- are sent with one multi-draw call:
+	auto send_run = [&](Drawable const &first) {
+		draw_ranges(first.pipeline, run_to_world, run_type, run_starts.data(), run_counts.data(), GLsizei(run_starts.size()));
+	};
+
+	if (!occlusion) {
+		//Iterate through all drawables, sending them to OpenGL:
+		uint32_t index = 0;
+		for (auto const &drawable : drawables) {
+			if (pvs_hidden(index++)) continue;
+			if (!drawable_ok(drawable)) continue;
+			if (off_screen(drawable)) continue;
+			assert(drawable.transform); //drawables *must* have a transform
+			glm::mat4x3 object_to_world = drawable.transform->make_local_to_world();
+			if (software_hidden(drawable, object_to_world)) continue;
+			add_to_run(drawable, object_to_world, select_lod(drawable, object_to_world), same_state, send_run);
+		}
+		flush_run(send_run);
+	} else {
+		//Occlusion culling (see OcclusionCulling.hpp for an overview):
+		// (begin_frame was called above, before the depth prepass)
+		OcclusionCulling &culling = *occlusion;
+
+		struct Hidden {
+			Drawable const *drawable;
+			glm::mat4x3 object_to_world;
+			OcclusionCulling::State *state;
+		};
+		std::vector< Hidden > hidden;
+
+		//first pass: draw drawables that were visible last frame (these are the likely occluders; ones not being queried are gathered into runs):
+		uint32_t index = 0;
+		for (auto const &drawable : drawables) {
+			if (pvs_hidden(index++)) continue;
+			if (!drawable_ok(drawable)) continue;
+			if (off_screen(drawable)) continue;
+			assert(drawable.transform); //drawables *must* have a transform
+			glm::mat4x3 object_to_world = drawable.transform->make_local_to_world();
+			if (software_hidden(drawable, object_to_world)) continue;
+
+			//drawables without bounds can't be tested:
+			if (!(drawable.min.x <= drawable.max.x)) {
+				add_to_run(drawable, object_to_world, select_lod(drawable, object_to_world), same_state, send_run);
+				continue;
+			}
+			culling.stats.tested += 1;
+
+			OcclusionCulling::State &state = culling.state(drawable);
+
+			//boxes that cross the near plane would have their proxies clipped, so treat them as visible:
+			bool near_clipped = false;
+			glm::mat4 object_to_clip = world_to_clip * glm::mat4(object_to_world);
+			for (uint32_t c = 0; c < 8 && !near_clipped; ++c) {
+				glm::vec4 corner = object_to_clip * glm::vec4(
+					(c & 1 ? drawable.max.x : drawable.min.x),
+					(c & 2 ? drawable.max.y : drawable.min.y),
+					(c & 4 ? drawable.max.z : drawable.min.z),
+					1.0f);
+				if (corner.z < -corner.w) near_clipped = true;
+			}
+
+			if (state.visible || near_clipped) {
+				if (culling.want_visible_query(state)) {
+					//(a query must count only this drawable's samples, so it is drawn on its own)
+					flush_run(send_run);
+					glBeginQuery(GL_ANY_SAMPLES_PASSED, state.query);
+					draw_drawable(drawable, object_to_world);
+					glEndQuery(GL_ANY_SAMPLES_PASSED);
+					state.pending = true;
+					culling.stats.queries += 1;
+				} else {
+					add_to_run(drawable, object_to_world, select_lod(drawable, object_to_world), same_state, send_run);
+				}
+			} else {
+				hidden.emplace_back(Hidden{&drawable, object_to_world, &state});
+			}
+		}
+
+		flush_run(send_run);
+
+		//second pass: test drawables that were hidden last frame against the depth buffer:
+		for (auto const &h : hidden) {
+			if (!h.state->pending) {
+				glBeginQuery(GL_ANY_SAMPLES_PASSED, h.state->query);
+				culling.draw_proxy(world_to_clip * glm::mat4(h.object_to_world), h.drawable->min, h.drawable->max);
+				bound_program = bound_vao = 0; //(proxies are drawn with their own program and vertex array)
+				glEndQuery(GL_ANY_SAMPLES_PASSED);
+				h.state->pending = true;
+				culling.stats.queries += 1;
+			}
+			culling.stats.culled += 1; //(its latest query result failed)
+			//draw only if the (newest) query passes -- without waiting on the CPU; if the GPU doesn't have the
+			// result yet, NO_WAIT draws anyway, so a drawable is never missing for a frame:
+			if (culling.conditional_render) {
+				glBeginConditionalRender(h.state->query, GL_QUERY_NO_WAIT);
+				draw_drawable(*h.drawable, h.object_to_world);
+				glEndConditionalRender();
+				culling.stats.conditional += 1;
+			}
+		}
+
+		culling.end_frame();
+	}
+
+	if (depth_prepass && depth_prepass->program) glDepthFunc(GLenum(depth_func));
+
 	glUseProgram(0);
 	glBindVertexArray(0);
 
@@ -166,14 +558,49 @@ void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_lig
 }
 
 
-void Scene::load(std::string const &filename,
-	std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable) {
+//Scene files are parsed in place from a memory mapping (see ChunkFile.hpp):
+namespace {
+	//walks the chunks of an in-memory buffer (same format as read_chunk in read_write_chunk.hpp; used for snapshots):
+	struct ChunkCursor {
+		char const *at;
+		char const *end;
 
-	std::ifstream file(filename, std::ios::binary);
+		//validate the next chunk header and return its payload:
+		void next(std::string const &magic, char const **payload, size_t *size) {
+			struct ChunkHeader {
+				char magic[4];
+				uint32_t size;
+			};
+			static_assert(sizeof(ChunkHeader) == 8, "header is packed");
 
-	std::vector< char > names;
-	read_chunk(file, "str0", &names);
+			if (size_t(end - at) < sizeof(ChunkHeader)) {
+				throw std::runtime_error("Failed to read chunk header");
+			}
+			ChunkHeader header;
+			std::memcpy(&header, at, sizeof(header));
+			if (std::string(header.magic, 4) != magic) {
+				throw std::runtime_error("Unexpected magic number in chunk");
+			}
+			at += sizeof(ChunkHeader);
+			if (size_t(end - at) < header.size) {
+				throw std::runtime_error("Failed to read chunk data.");
+			}
+			*payload = at;
+			*size = header.size;
+			at += header.size;
+		}
+	};
+
+	//(views chunks of snapshots -- see ChunkView in ChunkFile.hpp)
+	template< typename T >
+	void view_chunk(ChunkCursor &cursor, std::string const &magic, ChunkView< T > *to) {
+		char const *payload;
+		size_t size;
+		cursor.next(magic, &payload, &size);
+		to->view_bytes(payload, size);
+	}
 
+	//scene file entries:
 	struct HierarchyEntry {
 		uint32_t parent;
 		uint32_t name_begin;
@@ -183,8 +610,6 @@ void Scene::load(std::string const &filename,
 		glm::vec3 scale;
 	};
 	static_assert(sizeof(HierarchyEntry) == 4 + 4 + 4 + 4*3 + 4*4 + 4*3, "HierarchyEntry is packed.");
-	std::vector< HierarchyEntry > hierarchy;
-	read_chunk(file, "xfh0", &hierarchy);
 
 	struct MeshEntry {
 		uint32_t transform;
@@ -192,8 +617,6 @@ void Scene::load(std::string const &filename,
 		uint32_t name_end;
 	};
 	static_assert(sizeof(MeshEntry) == 4 + 4 + 4, "MeshEntry is packed.");
-	std::vector< MeshEntry > meshes;
-	read_chunk(file, "msh0", &meshes);
 
 	struct CameraEntry {
 		uint32_t transform;
@@ -202,8 +625,6 @@ void Scene::load(std::string const &filename,
 		float clip_near, clip_far;
 	};
 	static_assert(sizeof(CameraEntry) == 4 + 4 + 4 + 4 + 4, "CameraEntry is packed.");
-	std::vector< CameraEntry > loaded_cameras;
-	read_chunk(file, "cam0", &loaded_cameras);
 
 	struct LightEntry {
 		uint32_t transform;
@@ -214,8 +635,104 @@ void Scene::load(std::string const &filename,
 		float fov;
 	};
 	static_assert(sizeof(LightEntry) == 4 + 1 + 3 + 4 + 4 + 4, "LightEntry is packed.");
-	std::vector< LightEntry > loaded_lights;
-	read_chunk(file, "lmp0", &loaded_lights);
+
+	//baked drawables (optional; written by bake-scene.cpp):
+	struct BakedHeader {
+		uint32_t total_vertices; //MeshBuffer::total_vertices of baked-against .pnct
+		uint32_t index_hash; //MeshBuffer::index_hash of baked-against .pnct
+	};
+	static_assert(sizeof(BakedHeader) == 4 + 4, "BakedHeader is packed.");
+
+	struct BakedEntry {
+		uint32_t transform;
+		uint32_t type; //GLenum
+		uint32_t start, count;
+		glm::vec3 min, max;
+	};
+	static_assert(sizeof(BakedEntry) == 4 + 4 + 4 + 4 + 4*3 + 4*3, "BakedEntry is packed.");
+
+	//(optional) levels of detail for baked drawables, in level order:
+	struct BakedLOD {
+		uint32_t drawable; //index into baked entries
+		uint32_t type; //GLenum
+		uint32_t start, count;
+	};
+	static_assert(sizeof(BakedLOD) == 4 + 4 + 4 + 4, "BakedLOD is packed.");
+
+	//animation clips (optional; written by export-scene.py for objects with actions):
+	struct ClipEntry {
+		uint32_t name_begin, name_end;
+		float duration; //seconds
+		uint32_t track_begin, track_end; //range of track entries
+	};
+	static_assert(sizeof(ClipEntry) == 4 + 4 + 4 + 4 + 4, "ClipEntry is packed.");
+
+	struct TrackEntry {
+		uint32_t transform;
+		uint32_t channel; //'p', 'r', or 's'
+		uint32_t key_begin, key_end; //range of key entries
+	};
+	static_assert(sizeof(TrackEntry) == 4 + 4 + 4 + 4, "TrackEntry is packed.");
+
+	struct KeyEntry {
+		float time; //seconds from start of clip
+		glm::vec4 value; //xyz for position/scale, quaternion xyzw for rotation
+	};
+	static_assert(sizeof(KeyEntry) == 4 + 4*4, "KeyEntry is packed.");
+}
+
+void Scene::load(std::string const &filename,
+	std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable,
+	Baked const *baked) {
+
+	ChunkFile file(filename);
+
+	ChunkView< char > strings;
+	file.view("str0", &strings);
+
+	//names are views into the str0 chunk:
+	auto get_name = [&strings](uint32_t begin, uint32_t end) {
+		return std::string_view(strings.data() + begin, end - begin);
+	};
+
+	ChunkView< HierarchyEntry > hierarchy;
+	file.view("xfh0", &hierarchy);
+
+	ChunkView< MeshEntry > meshes;
+	file.view("msh0", &meshes);
+
+	ChunkView< CameraEntry > loaded_cameras;
+	file.view("cam0", &loaded_cameras);
+
+	ChunkView< LightEntry > loaded_lights;
+	file.view("lmp0", &loaded_lights);
+
+	//baked drawables (optional):
+	ChunkView< BakedHeader > baked_header;
+	ChunkView< BakedEntry > baked_entries;
+	ChunkView< BakedLOD > baked_lods;
+
+	if (file.find("dwh0")) {
+		file.view("dwh0", &baked_header);
+		file.view("dwb0", &baked_entries);
+		if (file.find("dwl0")) {
+			file.view("dwl0", &baked_lods);
+		}
+		if (baked_header.size() != 1) {
+			throw std::runtime_error("scene file '" + filename + "' contains malformed baked drawable header");
+		}
+	}
+
+	//animation clips (optional):
+	ChunkView< ClipEntry > clip_entries;
+	ChunkView< TrackEntry > track_entries;
+	ChunkView< KeyEntry > key_entries;
+
+	if (file.find("acl0")) {
+		file.view("acl0", &clip_entries);
+		file.view("atr0", &track_entries);
+		file.view("akf0", &key_entries);
+	}
 
 
 	//--------------------------------
@@ -234,8 +751,8 @@ void Scene::load(std::string const &filename,
 			t->parent = hierarchy_transforms[h.parent];
 		}
 
-		if (h.name_begin <= h.name_end && h.name_end <= names.size()) {
-			t->name = std::string(names.begin() + h.name_begin, names.begin() + h.name_end);
+		if (h.name_begin <= h.name_end && h.name_end <= strings.size()) {
+			set_name(t, std::string(get_name(h.name_begin, h.name_end)));
 		} else {
 				throw std::runtime_error("scene file '" + filename + "' contains hierarchy entry with invalid name indices");
 		}
@@ -248,14 +765,74 @@ void Scene::load(std::string const &filename,
 	}
 	assert(hierarchy_transforms.size() == hierarchy.size());
 
+	//use baked drawables if they match the mesh buffer the caller is using:
+	bool use_baked = false;
+	if (baked && baked_header.size() == 1) {
+		if (baked_header[0].total_vertices == baked->meshes.total_vertices && baked_header[0].index_hash == baked->meshes.index_hash) {
+			use_baked = true;
+		} else {
+			std::cerr << "WARNING: baked drawables in scene file '" << filename << "' do not match mesh buffer; looking up meshes by name instead." << std::endl;
+		}
+	}
+
+	if (use_baked) {
+		//baked ranges are of indices if the mesh buffer is indexed:
+		GLuint total = (baked->meshes.index_type ? baked->meshes.total_indices : baked->meshes.total_vertices);
+		//...and are offset by the buffer's place in shared buffers (if it is in a GeometryArena):
+		GLuint base = (baked->meshes.index_type ? baked->meshes.index_base : baked->meshes.vertex_base);
+		for (auto const &b : baked_entries) {
+			if (b.transform >= hierarchy_transforms.size()) {
+				throw std::runtime_error("scene file '" + filename + "' contains baked drawable with invalid transform index (" + std::to_string(b.transform) + ")");
+			}
+			if (!(b.start <= total && b.count <= total - b.start)) {
+				throw std::runtime_error("scene file '" + filename + "' contains baked drawable with out-of-range vertices");
+			}
+			drawables.emplace_back(hierarchy_transforms[b.transform]);
+			Drawable &drawable = drawables.back();
+			drawable.min = b.min;
+			drawable.max = b.max;
+			drawable.pipeline = baked->pipeline;
+			drawable.pipeline.type = GLenum(b.type);
+			drawable.pipeline.start = base + b.start;
+			drawable.pipeline.count = b.count;
+			drawable.pipeline.index_type = baked->meshes.index_type;
+			if (baked->meshes.quantized) {
+				//(bake-scene stores quantized meshes' boxes as their bounds)
+				drawable.pipeline.position_dequantize = dequantize_matrix(QuantizationBox{b.min, b.max});
+				drawable.pipeline.normal_octahedral = true;
+			}
+		}
+		if (baked_lods.size()) {
+			std::vector< Drawable * > baked_drawables;
+			baked_drawables.reserve(baked_entries.size());
+			auto d = drawables.end();
+			std::advance(d, -std::ptrdiff_t(baked_entries.size()));
+			for (; d != drawables.end(); ++d) baked_drawables.emplace_back(&*d);
+			for (auto const &l : baked_lods) {
+				if (l.drawable >= baked_drawables.size()) {
+					throw std::runtime_error("scene file '" + filename + "' contains baked LOD with invalid drawable index (" + std::to_string(l.drawable) + ")");
+				}
+				if (!(l.start <= total && l.count <= total - l.start)) {
+					throw std::runtime_error("scene file '" + filename + "' contains baked LOD with out-of-range vertices");
+				}
+				Drawable::LOD lod;
+				lod.type = GLenum(l.type);
+				lod.start = base + l.start;
+				lod.count = l.count;
+				baked_drawables[l.drawable]->lods.emplace_back(lod);
+			}
+		}
+	}
+
 	for (auto const &m : meshes) {
+		if (use_baked) break; //drawables were already made from baked data
 		if (m.transform >= hierarchy_transforms.size()) {
 			throw std::runtime_error("scene file '" + filename + "' contains mesh entry with invalid transform index (" + std::to_string(m.transform) + ")");
 		}
-		if (!(m.name_begin <= m.name_end && m.name_end <= names.size())) {
+		if (!(m.name_begin <= m.name_end && m.name_end <= strings.size())) {
 			throw std::runtime_error("scene file '" + filename + "' contains mesh entry with invalid name indices");
 		}
-		std::string name = std::string(names.begin() + m.name_begin, names.begin() + m.name_end);
+		std::string name = std::string(get_name(m.name_begin, m.name_end));
 
 		if (on_drawable) {
 			on_drawable(*this, hierarchy_transforms[m.transform], name);
@@ -301,10 +878,62 @@ void Scene::load(std::string const &filename,
 		light->spot_fov = l.fov / 180.0f * 3.1415926f; //FOV is stored in degrees; convert to radians.
 	}
 
+	for (auto const &c : clip_entries) {
+		if (!(c.name_begin <= c.name_end && c.name_end <= strings.size())) {
+			throw std::runtime_error("scene file '" + filename + "' contains clip entry with invalid name indices");
+		}
+		if (!(c.track_begin <= c.track_end && c.track_end <= track_entries.size())) {
+			throw std::runtime_error("scene file '" + filename + "' contains clip entry with invalid track indices");
+		}
+		clips.emplace_back();
+		Clip *clip = &clips.back();
+		clip->name = std::string(get_name(c.name_begin, c.name_end));
+		clip->duration = c.duration;
+		clip->tracks.reserve(c.track_end - c.track_begin);
+		for (uint32_t t = c.track_begin; t < c.track_end; ++t) {
+			TrackEntry const &e = track_entries[t];
+			if (e.transform >= hierarchy_transforms.size()) {
+				throw std::runtime_error("scene file '" + filename + "' contains track entry with invalid transform index (" + std::to_string(e.transform) + ")");
+			}
+			if (!(e.channel == 'p' || e.channel == 'r' || e.channel == 's')) {
+				throw std::runtime_error("scene file '" + filename + "' contains track entry with unknown channel (" + std::to_string(e.channel) + ")");
+			}
+			if (!(e.key_begin < e.key_end && e.key_end <= key_entries.size())) {
+				throw std::runtime_error("scene file '" + filename + "' contains track entry with invalid key indices");
+			}
+			clip->tracks.emplace_back(hierarchy_transforms[e.transform]);
+			Clip::Track *track = &clip->tracks.back();
+			track->channel = static_cast< Clip::Track::Channel >(e.channel);
+			track->times.reserve(e.key_end - e.key_begin);
+			track->values.reserve(e.key_end - e.key_begin);
+			for (uint32_t k = e.key_begin; k < e.key_end; ++k) {
+				if (k > e.key_begin && !(key_entries[k].time >= key_entries[k-1].time)) {
+					throw std::runtime_error("scene file '" + filename + "' contains track with out-of-order key times");
+				}
+				track->times.emplace_back(key_entries[k].time);
+				track->values.emplace_back(key_entries[k].value);
+			}
+		}
+	}
+
 	//load any extra that a subclass wants:
-	load_extra(file, names, hierarchy_transforms);
+	// (chunks other than the ones read above, in file order and the format of read_write_chunk.hpp, whatever the file's format)
+	std::vector< char > extra;
+	for (ChunkFile::Entry const &entry : file.entries) {
+		bool known = false;
+		for (char const *magic : {"str0", "xfh0", "msh0", "cam0", "lmp0", "dwh0", "dwb0", "dwl0", "acl0", "atr0", "akf0"}) {
+			if (std::memcmp(entry.magic, magic, 4) == 0) known = true;
+		}
+		if (known) continue;
+		char *payload = append_chunk(std::string(entry.magic, 4), size_t(entry.raw_size), &extra);
+		file.decode(entry, payload);
+	}
+	extra.insert(extra.end(), file.data + (file.size - file.trailing), file.data + file.size);
+	MemoryBuf rest_buf(extra.data(), extra.data() + extra.size());
+	std::istream rest(&rest_buf);
+	load_extra(rest, std::vector< char >(strings.begin(), strings.end()), hierarchy_transforms);
 
-	if (file.peek() != EOF) {
+	if (rest.peek() != EOF) {
 		std::cerr << "WARNING: trailing data in scene file '" << filename << "'" << std::endl;
 	}
 
@@ -312,10 +941,380 @@ void Scene::load(std::string const &filename,
 
 }
 
+void Scene::save(std::string const &filename, MeshBuffer const *meshes) const {
+	//transforms by position in 'transforms' ("list index"), and sorted (pointer, list index) pairs for looking them up:
+	std::vector< Transform const * > list;
+	list.reserve(transforms.size());
+	std::vector< std::pair< Transform const *, uint32_t > > list_index;
+	list_index.reserve(transforms.size());
+	for (auto const &t : transforms) {
+		list_index.emplace_back(&t, uint32_t(list.size()));
+		list.emplace_back(&t);
+	}
+	std::sort(list_index.begin(), list_index.end());
+	auto list_index_of = [&](Transform const *t) -> uint32_t {
+		auto f = std::lower_bound(list_index.begin(), list_index.end(), std::make_pair(t, 0U));
+		if (f == list_index.end() || f->first != t) {
+			throw std::runtime_error("Can't save scene '" + filename + "': it refers to a transform that isn't in the scene.");
+		}
+		return f->second;
+	};
+	std::vector< uint32_t > parent(list.size()); //list index of each transform's parent (-1U for none)
+	for (uint32_t i = 0; i < list.size(); ++i) {
+		parent[i] = (list[i]->parent ? list_index_of(list[i]->parent) : -1U);
+	}
+
+	//transforms are written parents-first (as load() requires):
+	std::vector< uint32_t > order; //list indices, in file order
+	order.reserve(list.size());
+	std::vector< uint32_t > file_index(list.size(), -1U); //file index of each transform, by list index
+	std::vector< uint32_t > chain; //(a transform and its not-yet-written ancestors)
+	for (uint32_t i = 0; i < list.size(); ++i) {
+		chain.clear();
+		for (uint32_t a = i; a != -1U && file_index[a] == -1U; a = parent[a]) {
+			if (chain.size() == list.size()) {
+				throw std::runtime_error("Can't save scene '" + filename + "': its transform parents form a cycle.");
+			}
+			chain.emplace_back(a);
+		}
+		for (auto c = chain.rbegin(); c != chain.rend(); ++c) {
+			file_index[*c] = uint32_t(order.size());
+			order.emplace_back(*c);
+		}
+	}
+	auto index_of = [&](Transform const *t) {
+		return file_index[list_index_of(t)];
+	};
+
+	//each name is written to the string table once:
+	std::vector< char > strings;
+	std::vector< std::pair< uint32_t, uint32_t > > name_ranges(names.strings.size(), std::make_pair(-1U, -1U));
+	auto add_name = [&](uint32_t name_id) {
+		auto &range = name_ranges[name_id];
+		if (range.first == -1U) {
+			std::string const &name = names[name_id];
+			range.first = uint32_t(strings.size());
+			strings.insert(strings.end(), name.begin(), name.end());
+			range.second = uint32_t(strings.size());
+		}
+		return range;
+	};
+
+	std::vector< HierarchyEntry > hierarchy;
+	hierarchy.reserve(order.size());
+	for (uint32_t i : order) {
+		Transform const *t = list[i];
+		auto range = add_name(t->name_id);
+		hierarchy.emplace_back(HierarchyEntry{
+			(parent[i] != -1U ? file_index[parent[i]] : -1U), range.first, range.second,
+			t->position, t->rotation, t->scale
+		});
+	}
+
+	std::vector< CameraEntry > camera_entries;
+	camera_entries.reserve(cameras.size());
+	for (auto const &c : cameras) {
+		CameraEntry entry;
+		entry.transform = index_of(c.transform);
+		std::memcpy(entry.type, "pers", 4);
+		entry.data = c.fovy / 3.1415926f * 180.0f; //FOV is stored in degrees
+		entry.clip_near = c.near;
+		entry.clip_far = std::numeric_limits< float >::infinity(); //(cameras use infinite perspective matrices)
+		camera_entries.emplace_back(entry);
+	}
+
+	std::vector< LightEntry > light_entries;
+	light_entries.reserve(lights.size());
+	for (auto const &l : lights) {
+		//energy is stored as an 8-bit color times a scalar:
+		float energy = std::max(l.energy.r, std::max(l.energy.g, l.energy.b));
+		glm::vec3 color = (energy > 0.0f ? l.energy / energy : glm::vec3(1.0f));
+		LightEntry entry;
+		entry.transform = index_of(l.transform);
+		entry.type = char(l.type);
+		entry.color = glm::u8vec3(glm::round(glm::clamp(color, 0.0f, 1.0f) * 255.0f));
+		entry.energy = energy;
+		entry.distance = 0.0f;
+		entry.fov = l.spot_fov / 3.1415926f * 180.0f; //FOV is stored in degrees
+		light_entries.emplace_back(entry);
+	}
+
+	//drawables are written by mesh name (msh0), and also as baked drawables (dwh0, dwb0, dwl0) for loaders with a matching buffer:
+	std::vector< MeshEntry > mesh_entries;
+	std::vector< BakedHeader > baked_header;
+	std::vector< BakedEntry > baked_entries;
+	std::vector< BakedLOD > baked_lods;
+	if (meshes) {
+		//meshes sorted by the range they draw, to find drawables' names:
+		typedef std::tuple< GLenum, GLuint, GLuint > Range;
+		std::vector< std::pair< Range, uint32_t > > by_range;
+		by_range.reserve(meshes->size());
+		for (uint32_t i = 0; i < meshes->size(); ++i) {
+			Mesh const &mesh = meshes->meshes[i];
+			by_range.emplace_back(Range(mesh.type, mesh.start, mesh.count), i);
+		}
+		std::sort(by_range.begin(), by_range.end());
+
+		//(ranges are stored relative to the file, not the buffer's place in a GeometryArena)
+		GLuint base = (meshes->index_type ? meshes->index_base : meshes->vertex_base);
+		GLuint total = (meshes->index_type ? meshes->total_indices : meshes->total_vertices);
+		auto in_buffer = [&](GLuint start, GLuint count) {
+			return start >= base && start - base <= total && count <= total - (start - base);
+		};
+
+		baked_header.emplace_back(BakedHeader{meshes->total_vertices, meshes->index_hash});
+		for (auto const &d : drawables) {
+			if (d.batch) continue; //(the drawables a static batch merged are written instead)
+
+			Range range(d.pipeline.type, d.pipeline.start, d.pipeline.count);
+			auto f = std::lower_bound(by_range.begin(), by_range.end(), std::make_pair(range, 0U));
+			if (f == by_range.end() || f->first != range || d.pipeline.index_type != meshes->index_type) {
+				throw std::runtime_error("Can't save scene '" + filename + "': a drawable (on transform '" + name(*d.transform) + "') doesn't draw a mesh of the mesh buffer.");
+			}
+			std::string const &mesh_name = meshes->names[f->second];
+			MeshEntry mesh_entry;
+			mesh_entry.transform = index_of(d.transform);
+			mesh_entry.name_begin = uint32_t(strings.size());
+			strings.insert(strings.end(), mesh_name.begin(), mesh_name.end());
+			mesh_entry.name_end = uint32_t(strings.size());
+			mesh_entries.emplace_back(mesh_entry);
+
+			uint32_t index = uint32_t(baked_entries.size());
+			baked_entries.emplace_back(BakedEntry{
+				mesh_entry.transform, uint32_t(d.pipeline.type), d.pipeline.start - base, d.pipeline.count,
+				d.min, d.max
+			});
+			for (auto const &lod : d.lods) {
+				if (!in_buffer(lod.start, lod.count)) {
+					throw std::runtime_error("Can't save scene '" + filename + "': a drawable (on transform '" + name(*d.transform) + "') has a level of detail outside the mesh buffer.");
+				}
+				baked_lods.emplace_back(BakedLOD{index, uint32_t(lod.type), lod.start - base, lod.count});
+			}
+		}
+	}
+
+	std::vector< ClipEntry > clip_entries;
+	std::vector< TrackEntry > track_entries;
+	std::vector< KeyEntry > key_entries;
+	for (auto const &c : clips) {
+		ClipEntry clip;
+		clip.name_begin = uint32_t(strings.size());
+		strings.insert(strings.end(), c.name.begin(), c.name.end());
+		clip.name_end = uint32_t(strings.size());
+		clip.duration = c.duration;
+		clip.track_begin = uint32_t(track_entries.size());
+		for (auto const &t : c.tracks) {
+			TrackEntry track;
+			track.transform = index_of(t.transform);
+			track.channel = uint32_t(t.channel);
+			track.key_begin = uint32_t(key_entries.size());
+			for (size_t k = 0; k < t.times.size(); ++k) {
+				key_entries.emplace_back(KeyEntry{t.times[k], t.values[k]});
+			}
+			track.key_end = uint32_t(key_entries.size());
+			track_entries.emplace_back(track);
+		}
+		clip.track_end = uint32_t(track_entries.size());
+		clip_entries.emplace_back(clip);
+	}
+
+	//assemble the file (in the v2 format of ChunkFile.hpp, so chunks can be found without reading the ones before them):
+	ChunkFileWriter writer;
+	writer.add("str0", strings);
+	writer.add("xfh0", hierarchy);
+	writer.add("msh0", mesh_entries);
+	writer.add("cam0", camera_entries);
+	writer.add("lmp0", light_entries);
+	if (meshes) {
+		writer.add("dwh0", baked_header);
+		writer.add("dwb0", baked_entries);
+		if (!baked_lods.empty()) writer.add("dwl0", baked_lods);
+	}
+	if (!clip_entries.empty()) {
+		writer.add("acl0", clip_entries);
+		writer.add("atr0", track_entries);
+		writer.add("akf0", key_entries);
+	}
+
+	std::ofstream out(filename, std::ios::binary);
+	writer.write(&out);
+	if (!out) {
+		throw std::runtime_error("Failed to write scene file '" + filename + "'.");
+	}
+}
+
+//Snapshot chunks:
+namespace {
+	struct TransformState {
+		uint32_t parent; //index, or -1U for none
+		glm::vec3 position;
+		glm::quat rotation;
+		glm::vec3 scale;
+	};
+	static_assert(sizeof(TransformState) == 4 + 4*3 + 4*4 + 4*3, "TransformState is packed.");
+
+	struct DrawableState {
+		uint32_t transform;
+		uint32_t type; //GLenum
+		uint32_t start, count;
+		glm::vec3 min, max;
+		uint32_t lod_level;
+		uint32_t batched;
+	};
+	static_assert(sizeof(DrawableState) == 4 + 4 + 4 + 4 + 4*3 + 4*3 + 4 + 4, "DrawableState is packed.");
+
+	struct CameraState {
+		uint32_t transform;
+		float fovy, aspect, near;
+	};
+	static_assert(sizeof(CameraState) == 4 + 4 + 4 + 4, "CameraState is packed.");
+
+	struct LightState {
+		uint32_t transform;
+		uint32_t type; //Light::Type
+		glm::vec3 energy;
+		float spot_fov;
+	};
+	static_assert(sizeof(LightState) == 4 + 4 + 4*3 + 4, "LightState is packed.");
+}
+
+void Scene::snapshot(Snapshot *into_) const {
+	assert(into_);
+	Snapshot &into = *into_;
+
+	//sorted (pointer, index) pairs, for looking up transform indices:
+	auto &index = into.transform_index;
+	index.clear();
+	for (auto const &t : transforms) {
+		index.emplace_back(&t, uint32_t(index.size()));
+	}
+	std::sort(index.begin(), index.end());
+	auto index_of = [&index](Transform const *t) -> uint32_t {
+		if (t == nullptr) return -1U;
+		auto f = std::lower_bound(index.begin(), index.end(), std::make_pair(t, 0U));
+		assert(f != index.end() && f->first == t);
+		return f->second;
+	};
+
+	into.data.clear();
+
+	char *at = append_chunk("xfs0", transforms.size() * sizeof(TransformState), &into.data);
+	for (auto const &t : transforms) {
+		TransformState state{index_of(t.parent), t.position, t.rotation, t.scale};
+		std::memcpy(at, &state, sizeof(state));
+		at += sizeof(state);
+	}
+
+	at = append_chunk("dws0", drawables.size() * sizeof(DrawableState), &into.data);
+	for (auto const &d : drawables) {
+		DrawableState state{index_of(d.transform), uint32_t(d.pipeline.type), d.pipeline.start, d.pipeline.count,
+			d.min, d.max, d.lod_level, uint32_t(d.batched)};
+		std::memcpy(at, &state, sizeof(state));
+		at += sizeof(state);
+	}
+
+	at = append_chunk("cms0", cameras.size() * sizeof(CameraState), &into.data);
+	for (auto const &c : cameras) {
+		CameraState state{index_of(c.transform), c.fovy, c.aspect, c.near};
+		std::memcpy(at, &state, sizeof(state));
+		at += sizeof(state);
+	}
+
+	at = append_chunk("lts0", lights.size() * sizeof(LightState), &into.data);
+	for (auto const &l : lights) {
+		LightState state{index_of(l.transform), uint32_t(l.type), l.energy, l.spot_fov};
+		std::memcpy(at, &state, sizeof(state));
+		at += sizeof(state);
+	}
+}
+
+void Scene::restore(Snapshot const &from) {
+	ChunkCursor cursor{from.data.data(), from.data.data() + from.data.size()};
+
+	ChunkView< TransformState > transform_states;
+	view_chunk(cursor, "xfs0", &transform_states);
+	ChunkView< DrawableState > drawable_states;
+	view_chunk(cursor, "dws0", &drawable_states);
+	ChunkView< CameraState > camera_states;
+	view_chunk(cursor, "cms0", &camera_states);
+	ChunkView< LightState > light_states;
+	view_chunk(cursor, "lts0", &light_states);
+
+	if (transform_states.size() != transforms.size()
+	 || drawable_states.size() != drawables.size()
+	 || camera_states.size() != cameras.size()
+	 || light_states.size() != lights.size()) {
+		throw std::runtime_error("Scene snapshot has different numbers of objects than the scene being restored.");
+	}
+
+	//index -> transform:
+	auto &list = restore_transforms;
+	list.clear();
+	for (auto &t : transforms) {
+		list.emplace_back(&t);
+	}
+	auto transform_at = [&list](uint32_t i) -> Transform * {
+		if (i == -1U) return nullptr;
+		if (i >= list.size()) throw std::runtime_error("Scene snapshot contains invalid transform index.");
+		return list[i];
+	};
+
+	//(validate all transform references first, so a bad snapshot leaves the scene unchanged)
+	for (auto const &s : transform_states) transform_at(s.parent);
+	for (auto const &s : drawable_states) if (!transform_at(s.transform)) throw std::runtime_error("Scene snapshot contains drawable without transform.");
+	for (auto const &s : camera_states) if (!transform_at(s.transform)) throw std::runtime_error("Scene snapshot contains camera without transform.");
+	for (auto const &s : light_states) if (!transform_at(s.transform)) throw std::runtime_error("Scene snapshot contains light without transform.");
+
+	{
+		auto s = transform_states.begin();
+		for (auto &t : transforms) {
+			t.parent = transform_at(s->parent);
+			t.position = s->position;
+			t.rotation = s->rotation;
+			t.scale = s->scale;
+			++s;
+		}
+	}
+	{
+		auto s = drawable_states.begin();
+		for (auto &d : drawables) {
+			d.transform = transform_at(s->transform);
+			d.pipeline.type = GLenum(s->type);
+			d.pipeline.start = s->start;
+			d.pipeline.count = s->count;
+			d.min = s->min;
+			d.max = s->max;
+			d.lod_level = s->lod_level;
+			d.batched = (s->batched != 0);
+			++s;
+		}
+	}
+	{
+		auto s = camera_states.begin();
+		for (auto &c : cameras) {
+			c.transform = transform_at(s->transform);
+			c.fovy = s->fovy;
+			c.aspect = s->aspect;
+			c.near = s->near;
+			++s;
+		}
+	}
+	{
+		auto s = light_states.begin();
+		for (auto &l : lights) {
+			l.transform = transform_at(s->transform);
+			l.type = static_cast< Light::Type >(s->type);
+			l.energy = s->energy;
+			l.spot_fov = s->spot_fov;
+			++s;
+		}
+	}
+}
+
 //-------------------------
 
-Scene::Scene(std::string const &filename, std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable) {
-	load(filename, on_drawable);
+Scene::Scene(std::string const &filename, std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable, Baked const *baked) {
+	load(filename, on_drawable, baked);
 }
 
 Scene::Scene(Scene const &other) {
@@ -339,9 +1338,10 @@ void Scene::set(Scene const &other, std::unordered_map< Transform const *, Trans
 
 	//Copy transforms and store mapping:
 	transforms.clear();
+	names = other.names;
 	for (auto const &t : other.transforms) {
 		transforms.emplace_back();
-		transforms.back().name = t.name;
+		transforms.back().name_id = t.name_id;
 		transforms.back().position = t.position;
 		transforms.back().rotation = t.rotation;
 		transforms.back().scale = t.scale;
@@ -357,6 +1357,20 @@ void Scene::set(Scene const &other, std::unordered_map< Transform const *, Trans
 		t.parent = transform_to_transform.at(t.parent);
 	}
 
+	//copy other's name index, updating transform pointers:
+	transforms_by_name = other.transforms_by_name;
+	for (auto &[id, list] : transforms_by_name) {
+		for (auto &t : list) t = transform_to_transform.at(t);
+	}
+	transforms_by_family = other.transforms_by_family;
+	for (auto &[id, list] : transforms_by_family) {
+		for (auto &t : list) t = transform_to_transform.at(t);
+	}
+
+	lod_screen_size = other.lod_screen_size;
+	lod_hysteresis = other.lod_hysteresis;
+	depth_prepass = other.depth_prepass;
+
 	//copy other's drawables, updating transform pointers:
 	drawables = other.drawables;
 	for (auto &d : drawables) {
@@ -374,4 +1388,12 @@ void Scene::set(Scene const &other, std::unordered_map< Transform const *, Trans
 	for (auto &l : lights) {
 		l.transform = transform_to_transform.at(l.transform);
 	}
+
+	//copy other's clips, updating transform pointers:
+	clips = other.clips;
+	for (auto &c : clips) {
+		for (auto &t : c.tracks) {
+			t.transform = transform_to_transform.at(t.transform);
+		}
+	}
 }
@@ -16,16 +16,23 @@
 #include <glm/gtc/quaternion.hpp>
 
 #include <list>
+#include <limits>
 #include <memory>
 #include <functional>
 #include <string>
 #include <vector>
 #include <unordered_map>
 
+struct MeshBuffer;
+struct DrawableBVH;
+struct OcclusionCulling;
+struct SoftwareOcclusion;
+
 struct Scene {
 	struct Transform {
 		//Transform names are useful for debugging and looking up locations in a loaded scene:
-		std::string name;
+		// (names are interned in the owning Scene's 'names' table; use Scene::name() to read them back)
+		uint32_t name_id = 0;
 
 		//The core function of a transform is to store a transformation in the world:
 		glm::vec3 position = glm::vec3(0.0f, 0.0f, 0.0f);
@@ -54,22 +61,40 @@ struct Scene {
 		Drawable(Transform *transform_) : transform(transform_) { assert(transform); }
 		Transform * transform;
 
+		//Bounding box of the drawn vertices, in the transform's local space:
+		// (left empty [min > max] if not known)
+		glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+		glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+
 		//Contains all the data needed to run the OpenGL pipeline:
 		struct Pipeline {
 			GLuint program = 0; //shader program; passed to glUseProgram
 
 			//attributes:
 			GLuint vao = 0; //attrib->buffer mapping; passed to glBindVertexArray
+			//(optional) vertex array for Scene::depth_prepass's program -- i.e., made with make_vao_for_program for a
+			// program that reads only Position, so it binds the MeshBuffer's packed position stream; drawables without one aren't prepassed:
+			GLuint depth_vao = 0;
 
 			GLenum type = GL_TRIANGLES; //what sort of primitive to draw; passed to glDrawArrays
 			GLuint start = 0; //first vertex to draw; passed to glDrawArrays
 			GLuint count = 0; //number of vertices to draw; passed to glDrawArrays
 
+			//(optional) indexed drawing: if index_type is set (GL_UNSIGNED_SHORT or GL_UNSIGNED_INT),
+			// start and count are instead a range of indices in the vao's element array buffer; passed to glDrawElements
+			GLenum index_type = 0;
+
 			//uniforms:
 			GLuint OBJECT_TO_CLIP_mat4 = -1U; //uniform location for object to clip space matrix
 			GLuint OBJECT_TO_LIGHT_mat4x3 = -1U; //uniform location for object to light space (== world space) matrix
 			GLuint NORMAL_TO_LIGHT_mat3 = -1U; //uniform location for normal to light space (== world space) matrix
 
+			//(optional) decoding for quantized MeshBuffers (see Mesh.hpp); set from Mesh::dequantize and MeshBuffer::quantized:
+			GLuint POSITION_DEQUANTIZE_mat4x3 = -1U; //uniform location for stored position to object space matrix
+			GLuint NORMAL_OCTAHEDRAL_bool = -1U; //uniform location for flag that normals are octahedral-encoded
+			glm::mat4x3 position_dequantize = glm::mat4x3(1.0f);
+			bool normal_octahedral = false;
+
 			std::function< void() > set_uniforms; //(optional) function to set any other useful uniforms
 
 			//texture objects to bind for the first TextureCount textures:
@@ -79,6 +104,22 @@ struct Scene {
 				GLenum target = GL_TEXTURE_2D;
 			} textures[TextureCount];
 		} pipeline;
+
+		//Optional lower levels of detail, drawn instead of pipeline.type/start/count when the drawable is small on screen:
+		// (lods[0] is level 1; coarser levels come later; selection needs min/max bounds -- see Scene::lod_screen_size)
+		// (ranges are indices if pipeline.index_type is set)
+		struct LOD {
+			GLenum type = GL_TRIANGLES;
+			GLuint start = 0;
+			GLuint count = 0;
+		};
+		std::vector< LOD > lods;
+		mutable uint32_t lod_level = 0; //level drawn most recently (0 == pipeline's own range); used for hysteresis
+
+		//set on drawables that have been merged into a static batch (see StaticBatch.hpp); draw() skips these:
+		bool batched = false;
+		//set on the drawables a static batch makes (which draw from the batch's own vertex buffer, not a MeshBuffer):
+		bool batch = false;
 	};
 
 	struct Camera {
@@ -116,11 +157,102 @@ struct Scene {
 		float spot_fov = glm::radians(45.0f); //spot cone fov (in radians)
 	};
 
+	struct Clip {
+		//a 'Clip' is a named, keyframed animation of some transforms:
+		// (play clips with an AnimationSampler -- see Animation.hpp)
+		std::string name;
+		float duration = 0.0f; //in seconds
+
+		struct Track {
+			//a 'Track' animates one channel of a transform:
+			Track(Transform *transform_) : transform(transform_) { assert(transform); }
+			Transform * transform;
+
+			enum Channel : char {
+				Position = 'p',
+				Rotation = 'r',
+				Scale = 's'
+			} channel = Position;
+
+			//keys, interpolated linearly (slerp for rotations) between times and held before the first/after the last:
+			std::vector< float > times; //in seconds, non-decreasing
+			std::vector< glm::vec4 > values; //xyz for position and scale; quaternion xyzw for rotation
+		};
+		std::vector< Track > tracks;
+	};
+
 	//Scenes, of course, may have many of the above objects:
 	std::list< Transform > transforms;
 	std::list< Drawable > drawables;
 	std::list< Camera > cameras;
 	std::list< Light > lights;
+	std::list< Clip > clips;
+
+	//Scene-wide string table that Transform::name_id indexes into:
+	struct NameTable {
+		NameTable() { clear(); }
+		//returns id of name, adding it to the table if needed:
+		uint32_t intern(std::string const &name);
+		//returns id of name, or -1U if name has never been interned:
+		uint32_t find(std::string const &name) const;
+		std::string const &operator[](uint32_t id) const { return strings.at(id); }
+		//reset to just the empty name (which is always id 0):
+		void clear();
+
+		std::vector< std::string > strings;
+		std::unordered_map< std::string, uint32_t > ids;
+	} names;
+
+	std::string const &name(Transform const &transform) const { return names[transform.name_id]; }
+
+	//Name index, maintained by load(), set(), and set_name():
+	// 'family' is the name with any trailing Blender-style duplicate suffix removed (e.g. "Swan.012" -> "Swan")
+	std::unordered_map< uint32_t, std::vector< Transform * > > transforms_by_name;
+	std::unordered_map< uint32_t, std::vector< Transform * > > transforms_by_family;
+
+	//look up the first transform with a given name:
+	// returns nullptr if no such transform exists
+	Transform *lookup(std::string const &name) const;
+	//look up all transforms in a name family (e.g., "Swan" finds "Swan", "Swan.001", "Swan.012", ...):
+	std::vector< Transform * > const &lookup_family(std::string const &family) const;
+	//look up a clip by name:
+	// returns nullptr if no such clip exists
+	Clip const *lookup_clip(std::string const &name) const;
+
+	//name (or rename) a transform and add it to the name index:
+	// (transforms created by hand are unnamed -- and unindexed -- until this is called)
+	void set_name(Transform *transform, std::string const &name);
+
+	//Level-of-detail selection (for drawables with lods):
+	// level i >= 1 is drawn once the drawable's projected bounding sphere diameter falls below
+	//  lod_screen_size / 2^(i-1) viewport heights; thresholds are widened by +/- lod_hysteresis (as a fraction)
+	//  in the direction away from the current level, so drawables near a threshold don't flicker between levels.
+	float lod_screen_size = 0.25f;
+	float lod_hysteresis = 0.1f;
+
+	//(optional) occlusion culling state; if set, draw() skips drawables hidden behind others using GPU queries:
+	// (not copied by set(); one OcclusionCulling per scene and view)
+	OcclusionCulling *occlusion = nullptr;
+
+	//(optional) CPU occlusion culler; if set, draw() rasterizes its occluders and skips drawables whose boxes they hide:
+	// (not copied by set())
+	SoftwareOcclusion *software_occlusion = nullptr;
+
+	//(optional) bounding volume hierarchy over drawables; if set, draw() skips the drawables it tracks whose boxes are outside the view frustum:
+	// (not copied by set(); refit it -- DrawableBVH::update() -- after moving transforms, and track drawables added later)
+	DrawableBVH const *bvh = nullptr;
+
+	//(optional) potentially visible set: if set, draw() skips drawables[i] (for i < visible_set_size) unless bit i is set:
+	// (e.g., a row of a PVS -- see PVS.hpp)
+	uint32_t const *visible_set = nullptr;
+	uint32_t visible_set_size = 0;
+
+	//(optional) depth prepass: if set, draw() first draws every drawable with a depth_vao using this pipeline's
+	// program (positions only, color writes off), then draws as usual with GL_LEQUAL, so hidden surfaces aren't shaded:
+	// (only program, OBJECT_TO_CLIP_mat4, POSITION_DEQUANTIZE_mat4x3, and set_uniforms are used -- see DepthProgram.hpp)
+	// (color writes are turned back on and the depth function is restored afterward; programs should declare 'invariant gl_Position')
+	// (drawables hidden last frame or due an occlusion query this frame aren't prepassed, so queries don't see their own depth)
+	Drawable::Pipeline const *depth_prepass = nullptr;
 
 	//The "draw" function provides a convenient way to pass all the things in a scene to OpenGL:
 	void draw(Camera const &camera) const;
@@ -128,22 +260,60 @@ struct Scene {
 	//..sometimes, you want to draw with a custom projection matrix and/or light space:
 	void draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light = glm::mat4x3(1.0f)) const;
 
+	//Scene files may contain "baked" drawables (written by scenes/bake-scene) with mesh names
+	// already resolved to vertex ranges and bounds in a specific .pnct file:
+	struct Baked {
+		MeshBuffer const &meshes; //mesh buffer the scene should have been baked against (checked at load)
+		Drawable::Pipeline const &pipeline; //pipeline template for baked drawables (vao should already be set)
+	};
+
 	//add transforms/objects/cameras from a scene file to this scene:
 	// the 'on_drawable' callback gives your code a chance to look up mesh data and make Drawables:
+	// if 'baked' is supplied and the file contains drawables baked against baked->meshes,
+	//  drawables are made directly from baked->pipeline and 'on_drawable' is not called
 	// throws on file format errors
 	void load(std::string const &filename,
-		std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable = nullptr
+		std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable = nullptr,
+		Baked const *baked = nullptr
 	);
 
 	//this function is called to read extra chunks from the scene file after the main chunks are read:
+	// ('from' holds the chunks load() doesn't use, in file order and the sequential format of read_write_chunk.hpp)
 	// this is useful if you, e.g., subclassing scene to represent a game level/area
 	virtual void load_extra(std::istream &from, std::vector< char > const &str0, std::vector< Transform * > const &xfh0) { }
 
+	//write this scene as a scene file (readable by load()), assembled in memory and written all at once:
+	// drawables are written by mesh name -- so each must draw a mesh of 'meshes' -- and also as baked drawables
+	//  (see bake-scene.cpp) against 'meshes', which load() uses instead when given a matching buffer
+	// drawables made by a static batch are not written (the drawables they merged are, so reloading draws the same things)
+	// if 'meshes' is null, drawables are not written
+	// throws on write errors, or if a drawable doesn't draw a mesh of 'meshes'
+	void save(std::string const &filename, MeshBuffer const *meshes = nullptr) const;
+
+	//in-memory checkpoint of the changeable state of a scene's transforms, drawables, cameras, and lights:
+	// (stored as chunks in the format of read_write_chunk.hpp; buffers are reused, so after the first
+	//  snapshot() into a given Snapshot -- or restore() into a given Scene -- neither allocates)
+	struct Snapshot {
+		std::vector< char > data;
+		//scratch space for snapshot() (sorted transform pointers with their indices):
+		std::vector< std::pair< Transform const *, uint32_t > > transform_index;
+	};
+	void snapshot(Snapshot *into) const;
+
+	//restore a snapshot taken of this scene (or of a scene it was copied from or to with set()):
+	// throws if the scene now has a different number of transforms, drawables, cameras, or lights
+	// note: names, clips, and drawable pipelines (other than vertex ranges and bounds) are not part of snapshots
+	// (a snapshot can be restored any number of times, into any scene with matching counts)
+	void restore(Snapshot const &from);
+
+	//scratch space for restore() (transforms, by index):
+	std::vector< Transform * > restore_transforms;
+
 	//empty scene:
 	Scene() = default;
 
 	//load a scene:
-	Scene(std::string const &filename, std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable);
+	Scene(std::string const &filename, std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable, Baked const *baked = nullptr);
 
 	//copy a scene (with proper pointer fixup):
 	Scene(Scene const &); //...as a constructor
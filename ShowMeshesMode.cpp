@@ -24,6 +24,7 @@ ShowMeshesMode::ShowMeshesMode(MeshBuffer const &buffer_) : buffer(buffer_) {
 
 		scene_drawable->pipeline = show_meshes_program_pipeline;
 		scene_drawable->pipeline.vao = vao;
+		scene_drawable->pipeline.normal_octahedral = buffer.quantized;
 		//these will be updated by the mesh selection code:
 		scene_drawable->pipeline.type = GL_TRIANGLES;
 		scene_drawable->pipeline.start = 0;
@@ -152,51 +153,55 @@ void ShowMeshesMode::draw(glm::uvec2 const &drawable_size) {
 }
 
 void ShowMeshesMode::select_prev_mesh() {
-	auto f = buffer.meshes.find(current_mesh_name);
-	if (f != buffer.meshes.end()) --f;
-	if (f == buffer.meshes.end()) f = buffer.meshes.begin();
-
-	if (f != buffer.meshes.end()) {
-		current_mesh_name = f->first;
-		scene_drawable->pipeline.type = f->second.type;
-		scene_drawable->pipeline.start = f->second.start;
-		scene_drawable->pipeline.count = f->second.count;
-		current_mesh_min = f->second.min;
-		current_mesh_max = f->second.max;
+	//meshes are stepped through in file order:
+	MeshBuffer::Handle f = buffer.find(current_mesh_name);
+	if (f && f.index > 0) f.index -= 1;
+	if (!f && buffer.size() > 0) f.index = 0;
+
+	if (f) {
+		Mesh const &mesh = buffer[f];
+		current_mesh_name = buffer.name(f);
+		scene_drawable->pipeline.type = mesh.type;
+		scene_drawable->pipeline.start = mesh.start;
+		scene_drawable->pipeline.count = mesh.count;
+		scene_drawable->pipeline.index_type = mesh.index_type;
+		scene_drawable->pipeline.position_dequantize = mesh.dequantize;
+		current_mesh_min = mesh.min;
+		current_mesh_max = mesh.max;
 	} else {
 		current_mesh_name = "";
 		scene_drawable->pipeline.type = GL_TRIANGLES;
 		scene_drawable->pipeline.start = 0;
 		scene_drawable->pipeline.count = 0;
+		scene_drawable->pipeline.index_type = 0;
+		scene_drawable->pipeline.position_dequantize = glm::mat4x3(1.0f);
 		current_mesh_min = glm::vec3(0.0f);
 		current_mesh_max = glm::vec3(0.0f);
 	}
 }
 
 void ShowMeshesMode::select_next_mesh() {
-	auto f = buffer.meshes.find(current_mesh_name);
-	if (f != buffer.meshes.end()) ++f;
-	if (f == buffer.meshes.end()) {
-		auto temp = buffer.meshes.rbegin();
-		if (temp != buffer.meshes.rend()) {
-			++temp;
-			f = temp.base();
-			assert(f != buffer.meshes.end());
-		}
-	}
-
-	if (f != buffer.meshes.end()) {
-		current_mesh_name = f->first;
-		scene_drawable->pipeline.type = f->second.type;
-		scene_drawable->pipeline.start = f->second.start;
-		scene_drawable->pipeline.count = f->second.count;
-		current_mesh_min = f->second.min;
-		current_mesh_max = f->second.max;
+	MeshBuffer::Handle f = buffer.find(current_mesh_name);
+	if (f && f.index + 1 < buffer.size()) f.index += 1;
+	if (!f && buffer.size() > 0) f.index = buffer.size() - 1;
+
+	if (f) {
+		Mesh const &mesh = buffer[f];
+		current_mesh_name = buffer.name(f);
+		scene_drawable->pipeline.type = mesh.type;
+		scene_drawable->pipeline.start = mesh.start;
+		scene_drawable->pipeline.count = mesh.count;
+		scene_drawable->pipeline.index_type = mesh.index_type;
+		scene_drawable->pipeline.position_dequantize = mesh.dequantize;
+		current_mesh_min = mesh.min;
+		current_mesh_max = mesh.max;
 	} else {
 		current_mesh_name = "";
 		scene_drawable->pipeline.type = GL_TRIANGLES;
 		scene_drawable->pipeline.start = 0;
 		scene_drawable->pipeline.count = 0;
+		scene_drawable->pipeline.index_type = 0;
+		scene_drawable->pipeline.position_dequantize = glm::mat4x3(1.0f);
 		current_mesh_min = glm::vec3(0.0f);
 		current_mesh_max = glm::vec3(0.0f);
 	}
@@ -3,9 +3,11 @@
 #include "gl_compile_program.hpp"
 #include "gl_errors.hpp"
 
+#include <glm/gtc/type_ptr.hpp>
+
 Scene::Drawable::Pipeline show_scene_program_pipeline;
 
-Load< ShowSceneProgram > show_scene_program(LoadTagEarly, []() -> ShowSceneProgram * {
+Load< ShowSceneProgram > show_scene_program(LoadOnGLThread, {}, []() -> ShowSceneProgram * {
 	auto *ret = new ShowSceneProgram();
 
 	show_scene_program_pipeline.program = ret->program;
@@ -13,6 +15,8 @@ Load< ShowSceneProgram > show_scene_program(LoadTagEarly, []() -> ShowSceneProgr
 	show_scene_program_pipeline.OBJECT_TO_CLIP_mat4 = ret->OBJECT_TO_CLIP_mat4;
 	show_scene_program_pipeline.OBJECT_TO_LIGHT_mat4x3 = ret->OBJECT_TO_LIGHT_mat4x3;
 	show_scene_program_pipeline.NORMAL_TO_LIGHT_mat3 = ret->NORMAL_TO_LIGHT_mat3;
+	show_scene_program_pipeline.POSITION_DEQUANTIZE_mat4x3 = ret->POSITION_DEQUANTIZE_mat4x3;
+	show_scene_program_pipeline.NORMAL_OCTAHEDRAL_bool = ret->NORMAL_OCTAHEDRAL_bool;
 
 	return ret;
 });
@@ -25,6 +29,8 @@ ShowSceneProgram::ShowSceneProgram() {
 		"uniform mat4 OBJECT_TO_CLIP;\n"
 		"uniform mat4x3 OBJECT_TO_LIGHT;\n"
 		"uniform mat3 NORMAL_TO_LIGHT;\n"
+		"uniform mat4x3 POSITION_DEQUANTIZE;\n" //identity unless mesh is quantized
+		"uniform bool NORMAL_OCTAHEDRAL;\n" //if set, Normal.xy is an octahedral encoding
 		"in vec4 Position;\n"
 		"in vec3 Normal;\n"
 		"in vec4 Color;\n"
@@ -33,10 +39,16 @@ ShowSceneProgram::ShowSceneProgram() {
 		"out vec3 normal;\n"
 		"out vec4 color;\n"
 		"out vec2 texCoord;\n"
+		"vec3 octahedral_decode(vec2 e) {\n"
+		"	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));\n"
+		"	if (n.z < 0.0) n.xy = (1.0 - abs(e.yx)) * vec2(e.x >= 0.0 ? 1.0 : -1.0, e.y >= 0.0 ? 1.0 : -1.0);\n"
+		"	return normalize(n);\n"
+		"}\n"
 		"void main() {\n"
-		"	gl_Position = OBJECT_TO_CLIP * Position;\n"
-		"	position = OBJECT_TO_LIGHT * Position;\n"
-		"	normal = NORMAL_TO_LIGHT * Normal;\n"
+		"	vec4 p = vec4(POSITION_DEQUANTIZE * Position, 1.0);\n"
+		"	gl_Position = OBJECT_TO_CLIP * p;\n"
+		"	position = OBJECT_TO_LIGHT * p;\n"
+		"	normal = NORMAL_TO_LIGHT * (NORMAL_OCTAHEDRAL ? octahedral_decode(Normal.xy) : Normal);\n"
 		"	color = Color;\n"
 		"	texCoord = TexCoord;\n"
 		"}\n"
@@ -83,8 +95,16 @@ ShowSceneProgram::ShowSceneProgram() {
 	OBJECT_TO_CLIP_mat4 = glGetUniformLocation(program, "OBJECT_TO_CLIP");
 	OBJECT_TO_LIGHT_mat4x3 = glGetUniformLocation(program, "OBJECT_TO_LIGHT");
 	NORMAL_TO_LIGHT_mat3 = glGetUniformLocation(program, "NORMAL_TO_LIGHT");
+	POSITION_DEQUANTIZE_mat4x3 = glGetUniformLocation(program, "POSITION_DEQUANTIZE");
+	NORMAL_OCTAHEDRAL_bool = glGetUniformLocation(program, "NORMAL_OCTAHEDRAL");
 
 	INSPECT_MODE_int = glGetUniformLocation(program, "INSPECT_MODE");
+
+	//default to unquantized vertices (Scene::draw sets these per drawable):
+	glUseProgram(program);
+	glUniformMatrix4x3fv(POSITION_DEQUANTIZE_mat4x3, 1, GL_FALSE, glm::value_ptr(glm::mat4x3(1.0f)));
+	glUniform1i(NORMAL_OCTAHEDRAL_bool, 0);
+	glUseProgram(0);
 }
 
 ShowSceneProgram::~ShowSceneProgram() {
@@ -0,0 +1,295 @@
+#include "SoftwareOcclusion.hpp"
+
+#include "Mesh.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SOFTWARE_OCCLUSION_SSE2
+#include <emmintrin.h>
+#endif
+
+SoftwareOcclusion::SoftwareOcclusion(uint32_t width_, uint32_t height_, uint32_t threads) {
+	if (width_ == 0 || height_ == 0) throw std::runtime_error("SoftwareOcclusion needs a non-empty depth buffer.");
+	width = (width_ + TileSize - 1) / TileSize * TileSize;
+	height = (height_ + TileSize - 1) / TileSize * TileSize;
+	tiles_x = width / TileSize;
+	tiles_y = height / TileSize;
+	depth.assign(size_t(width) * height, 0.0f);
+	tile_depth.assign(size_t(tiles_x) * tiles_y, 0.0f);
+
+	if (threads == 0) {
+		threads = std::max(1u, std::min(4u, std::thread::hardware_concurrency()));
+	}
+	//(no point in having more bands than tile rows)
+	threads = std::min(threads, tiles_y);
+
+	for (uint32_t band = 1; band < threads; ++band) {
+		workers.emplace_back([this, band]() {
+			uint32_t seen = 0;
+			while (true) {
+				{
+					std::unique_lock< std::mutex > lock(mutex);
+					wake.wait(lock, [&]() { return quit || generation != seen; });
+					if (quit) return;
+					seen = generation;
+				}
+				uint32_t bands = band_count();
+				rasterize_band(tiles_y * band / bands * TileSize, tiles_y * (band + 1) / bands * TileSize);
+				{
+					std::unique_lock< std::mutex > lock(mutex);
+					remaining -= 1;
+					if (remaining == 0) done.notify_one();
+				}
+			}
+		});
+	}
+}
+
+SoftwareOcclusion::~SoftwareOcclusion() {
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		quit = true;
+	}
+	wake.notify_all();
+	for (auto &worker : workers) {
+		worker.join();
+	}
+}
+
+void SoftwareOcclusion::add_occluder(Scene::Drawable const &drawable, MeshBuffer const &buffer) {
+	Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
+	if (pipeline.type != GL_TRIANGLES) {
+		throw std::runtime_error("SoftwareOcclusion occluders must be triangle lists.");
+	}
+	//(buffers in a GeometryArena offset starts by their place in the shared buffers; CPU copies aren't offset)
+	GLuint base = (pipeline.index_type ? buffer.index_base : buffer.vertex_base);
+	if (pipeline.start < base) {
+		throw std::runtime_error("SoftwareOcclusion occluder range is outside of its mesh buffer.");
+	}
+	GLuint start = pipeline.start - base;
+	if (pipeline.index_type) {
+		if (!(start <= buffer.indices.size() && pipeline.count <= buffer.indices.size() - start)) {
+			throw std::runtime_error("SoftwareOcclusion occluder index range is outside of its mesh buffer.");
+		}
+		occluders.emplace_back(Occluder{&drawable, buffer.positions.data(), buffer.indices.data() + start, pipeline.count / 3 * 3});
+	} else {
+		if (!(start <= buffer.positions.size() && pipeline.count <= buffer.positions.size() - start)) {
+			throw std::runtime_error("SoftwareOcclusion occluder vertex range is outside of its mesh buffer.");
+		}
+		occluders.emplace_back(Occluder{&drawable, buffer.positions.data() + start, nullptr, pipeline.count / 3 * 3});
+	}
+}
+
+void SoftwareOcclusion::clear_occluders() {
+	occluders.clear();
+}
+
+void SoftwareOcclusion::render(glm::mat4 const &world_to_clip) {
+	stats = Stats();
+
+	//------ transform, clip against the near plane, and set up occluder triangles ------
+	triangles.clear();
+
+	glm::vec2 pixels = glm::vec2(width, height);
+	auto emit = [&](glm::vec4 const &a, glm::vec4 const &b, glm::vec4 const &c) {
+		Triangle tri;
+		glm::vec4 const *v[3] = {&a, &b, &c};
+		float y_min = std::numeric_limits< float >::infinity();
+		float y_max = -std::numeric_limits< float >::infinity();
+		float x_min = std::numeric_limits< float >::infinity();
+		float x_max = -std::numeric_limits< float >::infinity();
+		for (uint32_t i = 0; i < 3; ++i) {
+			float inv_w = 1.0f / v[i]->w;
+			tri.p[i] = (glm::vec2(v[i]->x, v[i]->y) * inv_w * 0.5f + 0.5f) * pixels;
+			tri.z[i] = inv_w;
+			x_min = std::min(x_min, tri.p[i].x);
+			x_max = std::max(x_max, tri.p[i].x);
+			y_min = std::min(y_min, tri.p[i].y);
+			y_max = std::max(y_max, tri.p[i].y);
+		}
+		if (x_max < 0.0f || y_max < 0.0f || x_min > pixels.x || y_min > pixels.y) return; //off screen
+		tri.y0 = int32_t(std::max(0.0f, std::floor(y_min)));
+		tri.y1 = int32_t(std::min(pixels.y, std::ceil(y_max)));
+		if (tri.y0 >= tri.y1) return;
+		triangles.emplace_back(tri);
+	};
+
+	for (auto const &occluder : occluders) {
+		assert(occluder.drawable->transform);
+		glm::mat4 object_to_clip = world_to_clip * glm::mat4(occluder.drawable->transform->make_local_to_world());
+		for (uint32_t i = 0; i + 2 < occluder.count; i += 3) {
+			glm::vec4 in[3];
+			for (uint32_t j = 0; j < 3; ++j) {
+				uint32_t v = (occluder.indices ? occluder.indices[i+j] : i+j);
+				in[j] = object_to_clip * glm::vec4(occluder.positions[v], 1.0f);
+			}
+			//clip against the near plane (z >= -w), giving a polygon of up to four vertices:
+			glm::vec4 out[4];
+			uint32_t out_count = 0;
+			for (uint32_t j = 0; j < 3; ++j) {
+				glm::vec4 const &a = in[j];
+				glm::vec4 const &b = in[(j + 1) % 3];
+				float da = a.z + a.w;
+				float db = b.z + b.w;
+				if (da >= 0.0f) out[out_count++] = a;
+				if ((da >= 0.0f) != (db >= 0.0f)) {
+					out[out_count++] = a + (b - a) * (da / (da - db));
+				}
+			}
+			if (out_count >= 3) emit(out[0], out[1], out[2]);
+			if (out_count == 4) emit(out[0], out[2], out[3]);
+		}
+	}
+	stats.triangles = uint32_t(triangles.size());
+
+	//------ rasterize (in parallel bands) ------
+	run_bands();
+}
+
+void SoftwareOcclusion::run_bands() {
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		generation += 1;
+		remaining = uint32_t(workers.size());
+	}
+	wake.notify_all();
+
+	//this thread handles band zero:
+	rasterize_band(0, tiles_y * 1 / band_count() * TileSize);
+
+	std::unique_lock< std::mutex > lock(mutex);
+	done.wait(lock, [&]() { return remaining == 0; });
+}
+
+void SoftwareOcclusion::rasterize_band(uint32_t y_begin, uint32_t y_end) {
+	std::fill(depth.begin() + size_t(y_begin) * width, depth.begin() + size_t(y_end) * width, 0.0f);
+
+	for (auto const &tri : triangles) {
+		int32_t y0 = std::max(tri.y0, int32_t(y_begin));
+		int32_t y1 = std::min(tri.y1, int32_t(y_end));
+		if (y0 >= y1) continue;
+
+		//edge functions E(x,y) = A*x + B*y + C, positive inside (for either winding):
+		float area = (tri.p[1].x - tri.p[0].x) * (tri.p[2].y - tri.p[0].y) - (tri.p[1].y - tri.p[0].y) * (tri.p[2].x - tri.p[0].x);
+		if (!(std::abs(area) > 1e-8f)) continue; //degenerate (or NaN)
+		float sign = (area > 0.0f ? 1.0f : -1.0f);
+		float A[3], B[3], C[3];
+		for (uint32_t i = 0; i < 3; ++i) {
+			glm::vec2 const &a = tri.p[(i + 1) % 3];
+			glm::vec2 const &b = tri.p[(i + 2) % 3];
+			//edge opposite vertex i, so E_i / area is vertex i's barycentric weight:
+			A[i] = sign * (a.y - b.y);
+			B[i] = sign * (b.x - a.x);
+			C[i] = sign * (a.x * b.y - a.y * b.x);
+		}
+		//depth plane z(x,y) = zA*x + zB*y + zC:
+		float inv_area = 1.0f / std::abs(area);
+		float zA = (A[0] * tri.z[0] + A[1] * tri.z[1] + A[2] * tri.z[2]) * inv_area;
+		float zB = (B[0] * tri.z[0] + B[1] * tri.z[1] + B[2] * tri.z[2]) * inv_area;
+		float zC = (C[0] * tri.z[0] + C[1] * tri.z[1] + C[2] * tri.z[2]) * inv_area;
+
+		float x_min = std::min(tri.p[0].x, std::min(tri.p[1].x, tri.p[2].x));
+		float x_max = std::max(tri.p[0].x, std::max(tri.p[1].x, tri.p[2].x));
+		int32_t x0 = int32_t(std::max(0.0f, std::floor(x_min))) & ~3; //(aligned to four pixels)
+		int32_t x1 = int32_t(std::min(float(width), std::ceil(x_max)));
+
+		for (int32_t y = y0; y < y1; ++y) {
+			float py = float(y) + 0.5f;
+			float *row = depth.data() + size_t(y) * width;
+#ifdef SOFTWARE_OCCLUSION_SSE2
+			__m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+			__m128 zero = _mm_setzero_ps();
+			__m128 e_row[3], e_dx[3];
+			for (uint32_t i = 0; i < 3; ++i) {
+				e_row[i] = _mm_set1_ps(B[i] * py + C[i]);
+				e_dx[i] = _mm_set1_ps(A[i]);
+			}
+			__m128 z_row = _mm_set1_ps(zB * py + zC);
+			__m128 z_dx = _mm_set1_ps(zA);
+			for (int32_t x = x0; x < x1; x += 4) {
+				__m128 px = _mm_add_ps(_mm_set1_ps(float(x)), offsets);
+				__m128 inside = _mm_cmpge_ps(_mm_add_ps(e_row[0], _mm_mul_ps(e_dx[0], px)), zero);
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(e_row[1], _mm_mul_ps(e_dx[1], px)), zero));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(e_row[2], _mm_mul_ps(e_dx[2], px)), zero));
+				if (_mm_movemask_ps(inside) == 0) continue;
+				__m128 z = _mm_add_ps(z_row, _mm_mul_ps(z_dx, px));
+				__m128 old = _mm_loadu_ps(row + x);
+				__m128 nearer = _mm_max_ps(old, z);
+				_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old)));
+			}
+#else
+			for (int32_t x = x0; x < x1; ++x) {
+				float px = float(x) + 0.5f;
+				if (A[0] * px + B[0] * py + C[0] < 0.0f) continue;
+				if (A[1] * px + B[1] * py + C[1] < 0.0f) continue;
+				if (A[2] * px + B[2] * py + C[2] < 0.0f) continue;
+				row[x] = std::max(row[x], zA * px + zB * py + zC);
+			}
+#endif
+		}
+	}
+
+	//update tile summaries for this band:
+	for (uint32_t ty = y_begin / TileSize; ty < y_end / TileSize; ++ty) {
+		for (uint32_t tx = 0; tx < tiles_x; ++tx) {
+			float farthest = std::numeric_limits< float >::infinity();
+			for (uint32_t y = ty * TileSize; y < (ty + 1) * TileSize; ++y) {
+				float const *row = depth.data() + size_t(y) * width + tx * TileSize;
+				for (uint32_t x = 0; x < TileSize; ++x) {
+					farthest = std::min(farthest, row[x]);
+				}
+			}
+			tile_depth[ty * tiles_x + tx] = farthest;
+		}
+	}
+}
+
+bool SoftwareOcclusion::visible(glm::mat4 const &object_to_clip, glm::vec3 const &min, glm::vec3 const &max) const {
+	stats.tested += 1;
+
+	//screen rectangle and nearest depth of the box:
+	glm::vec2 lo = glm::vec2( std::numeric_limits< float >::infinity());
+	glm::vec2 hi = glm::vec2(-std::numeric_limits< float >::infinity());
+	float nearest = 0.0f;
+	for (uint32_t c = 0; c < 8; ++c) {
+		glm::vec4 corner = object_to_clip * glm::vec4(
+			(c & 1 ? max.x : min.x),
+			(c & 2 ? max.y : min.y),
+			(c & 4 ? max.z : min.z),
+			1.0f);
+		if (corner.z < -corner.w) return true; //crosses the near plane
+		float inv_w = 1.0f / corner.w;
+		glm::vec2 p = (glm::vec2(corner.x, corner.y) * inv_w * 0.5f + 0.5f) * glm::vec2(width, height);
+		lo = glm::min(lo, p);
+		hi = glm::max(hi, p);
+		nearest = std::max(nearest, inv_w);
+	}
+
+	int32_t x0 = int32_t(std::max(0.0f, std::floor(lo.x)));
+	int32_t y0 = int32_t(std::max(0.0f, std::floor(lo.y)));
+	int32_t x1 = int32_t(std::min(float(width), std::floor(hi.x) + 1.0f));
+	int32_t y1 = int32_t(std::min(float(height), std::floor(hi.y) + 1.0f));
+	if (x0 >= x1 || y0 >= y1) return true; //off screen -- not this culler's business
+
+	for (int32_t ty = y0 / int32_t(TileSize); ty <= (y1 - 1) / int32_t(TileSize); ++ty) {
+		for (int32_t tx = x0 / int32_t(TileSize); tx <= (x1 - 1) / int32_t(TileSize); ++tx) {
+			if (tile_depth[ty * tiles_x + tx] > nearest) continue; //whole tile is in front of the box
+			int32_t py0 = std::max(y0, ty * int32_t(TileSize));
+			int32_t py1 = std::min(y1, (ty + 1) * int32_t(TileSize));
+			int32_t px0 = std::max(x0, tx * int32_t(TileSize));
+			int32_t px1 = std::min(x1, (tx + 1) * int32_t(TileSize));
+			for (int32_t y = py0; y < py1; ++y) {
+				float const *row = depth.data() + size_t(y) * width;
+				for (int32_t x = px0; x < px1; ++x) {
+					if (!(row[x] > nearest)) return true;
+				}
+			}
+		}
+	}
+
+	stats.culled += 1;
+	return false;
+}
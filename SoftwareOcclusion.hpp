@@ -0,0 +1,94 @@
+#pragma once
+
+/*
+ * SoftwareOcclusion is a CPU occlusion culler: it rasterizes a few large
+ *  "occluder" drawables into a small depth buffer, then tests drawable
+ *  bounding boxes against that buffer so hidden drawables are never sent to
+ *  the GPU. Cost depends only on occluder triangle count and buffer size, and
+ *  it never waits on the GPU (compare OcclusionCulling, which uses GPU queries).
+ *
+ * To use, register occluders (their triangles are read from MeshBuffer::positions and ::indices)
+ *  and point Scene::software_occlusion at this object; Scene::draw calls render()
+ *  once per draw and skips drawables for which visible() returns false.
+ *
+ * The depth buffer stores 1/w (larger is nearer), which interpolates linearly
+ *  in screen space; an 8x8-pixel tile summary (farthest depth in each tile)
+ *  lets most box tests finish without touching pixels.
+ *
+ * Rasterization is split into horizontal bands across worker threads, and
+ *  inner loops run four pixels at a time with SSE2 (where available).
+ *
+ */
+
+#include "Scene.hpp"
+
+#include <glm/glm.hpp>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct MeshBuffer;
+
+struct SoftwareOcclusion {
+	//width is rounded up to a multiple of the tile size; threads == 0 picks based on hardware
+	SoftwareOcclusion(uint32_t width = 256, uint32_t height = 128, uint32_t threads = 0);
+	~SoftwareOcclusion();
+
+	SoftwareOcclusion(SoftwareOcclusion const &) = delete;
+	SoftwareOcclusion &operator=(SoftwareOcclusion const &) = delete;
+
+	//occluders are drawables whose triangles (pipeline.start/count in 'buffer', indexed or not) hide what is behind them:
+	// note: both the drawable and buffer must outlive this object (or be removed with clear_occluders)
+	void add_occluder(Scene::Drawable const &drawable, MeshBuffer const &buffer);
+	void clear_occluders();
+
+	//rasterize all occluders as seen through world_to_clip:
+	void render(glm::mat4 const &world_to_clip);
+
+	//could an object-space box be visible after the last render()?
+	bool visible(glm::mat4 const &object_to_clip, glm::vec3 const &min, glm::vec3 const &max) const;
+
+	//counters since the last render():
+	struct Stats {
+		uint32_t triangles = 0; //occluder triangles rasterized
+		mutable uint32_t tested = 0; //boxes tested
+		mutable uint32_t culled = 0; //boxes found to be hidden
+	} stats;
+
+	//-- internals ---
+	enum : uint32_t { TileSize = 8 };
+	uint32_t width, height;
+	uint32_t tiles_x, tiles_y;
+	std::vector< float > depth; //width x height, 1/w of nearest occluder (0 == nothing)
+	std::vector< float > tile_depth; //tiles_x x tiles_y, farthest (smallest) depth value in each tile
+
+	struct Occluder {
+		Scene::Drawable const *drawable;
+		glm::vec3 const *positions; //triangle list (or, if indices is set, vertices it indexes)
+		uint32_t const *indices; //(optional) triangle list of indices into positions
+		uint32_t count;
+	};
+	std::vector< Occluder > occluders;
+
+	//screen-space triangle, ready for rasterization:
+	struct Triangle {
+		glm::vec2 p[3]; //pixel coordinates
+		glm::vec3 z; //1/w at each vertex
+		int32_t y0, y1; //row range (inclusive begin, exclusive end)
+	};
+	std::vector< Triangle > triangles;
+
+	void rasterize_band(uint32_t y_begin, uint32_t y_end);
+
+	//worker threads (each call to run_bands() has every thread -- including the caller -- rasterize one band):
+	void run_bands();
+	std::vector< std::thread > workers;
+	std::mutex mutex;
+	std::condition_variable wake, done;
+	uint32_t generation = 0;
+	uint32_t remaining = 0;
+	bool quit = false;
+	uint32_t band_count() const { return uint32_t(workers.size()) + 1; }
+};
@@ -0,0 +1,239 @@
+#include "StaticBatch.hpp"
+
+#include "gl_errors.hpp"
+
+#include <glm/gtc/matrix_inverse.hpp>
+
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <tuple>
+#include <vector>
+
+StaticBatch::StaticBatch(Scene &scene, MeshBuffer const &meshes, std::function< bool(Scene::Drawable const &) > const &is_static, float chunk_size) {
+	if (!(chunk_size > 0.0f)) throw std::runtime_error("StaticBatch chunk size must be positive.");
+
+	//batching requires an interleaved buffer with float positions (as written by export-meshes.py);
+	// quantized buffers are decoded to that layout, since merged vertices are no longer inside any one mesh's box:
+	struct Vertex {
+		glm::vec3 Position;
+		glm::vec3 Normal;
+		glm::u8vec4 Color;
+		glm::vec2 TexCoord;
+	};
+	static_assert(sizeof(Vertex) == 3*4+3*4+4*1+2*4, "Vertex is packed.");
+	if (meshes.quantized) {
+		vertices.Position = MeshBuffer::Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Position));
+		vertices.Normal = MeshBuffer::Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Normal));
+		vertices.Color = MeshBuffer::Attrib(4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), offsetof(Vertex, Color));
+		vertices.TexCoord = MeshBuffer::Attrib(2, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, TexCoord));
+	} else {
+		//merged vertices use the same attribute layout as the source:
+		vertices.Position = meshes.Position;
+		vertices.Normal = meshes.Normal;
+		vertices.Color = meshes.Color;
+		vertices.TexCoord = meshes.TexCoord;
+	}
+	if (vertices.Position.size != 3 || vertices.Position.type != GL_FLOAT) {
+		throw std::runtime_error("StaticBatch needs a MeshBuffer with 3-float positions.");
+	}
+	GLsizei stride = vertices.Position.stride;
+	for (MeshBuffer::Attrib const *attrib : {&vertices.Normal, &vertices.Color, &vertices.TexCoord}) {
+		if (attrib->size != 0 && attrib->stride != stride) {
+			throw std::runtime_error("StaticBatch needs a MeshBuffer with interleaved attributes.");
+		}
+	}
+	bool transform_normals = (vertices.Normal.size == 3 && vertices.Normal.type == GL_FLOAT);
+	//(merged positions are also uploaded packed -- from vertices.positions -- for position-only programs)
+	vertices.PackedPosition = MeshBuffer::Attrib(3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), 0);
+
+	//drawables with the same pipeline state in the same grid cell are merged:
+	struct Key {
+		GLuint program;
+		GLuint OBJECT_TO_CLIP_mat4, OBJECT_TO_LIGHT_mat4x3, NORMAL_TO_LIGHT_mat3;
+		GLuint textures[Scene::Drawable::Pipeline::TextureCount];
+		GLenum targets[Scene::Drawable::Pipeline::TextureCount];
+		glm::ivec3 cell;
+
+		bool operator<(Key const &o) const {
+			auto tie = [](Key const &k) {
+				return std::tie(k.program, k.OBJECT_TO_CLIP_mat4, k.OBJECT_TO_LIGHT_mat4x3, k.NORMAL_TO_LIGHT_mat3,
+					k.textures[0], k.textures[1], k.textures[2], k.textures[3],
+					k.targets[0], k.targets[1], k.targets[2], k.targets[3],
+					k.cell.x, k.cell.y, k.cell.z);
+			};
+			return tie(*this) < tie(o);
+		}
+	};
+	static_assert(Scene::Drawable::Pipeline::TextureCount == 4, "Key comparison assumes four textures.");
+
+	struct Group {
+		std::vector< Scene::Drawable * > members;
+		glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+		glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+	};
+	std::map< Key, Group > groups;
+
+	for (auto &drawable : scene.drawables) {
+		Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
+		if (drawable.batched) continue;
+		if (pipeline.program == 0 || pipeline.vao == 0 || pipeline.count == 0) continue;
+		if (pipeline.type != GL_TRIANGLES) continue;
+		if (pipeline.set_uniforms) continue;
+		if (!drawable.lods.empty()) continue;
+		if (!(drawable.min.x <= drawable.max.x && drawable.min.y <= drawable.max.y && drawable.min.z <= drawable.max.z)) continue;
+		//(buffers in a GeometryArena offset starts by their place in the shared buffers; CPU copies aren't offset)
+		GLuint base = (pipeline.index_type ? meshes.index_base : meshes.vertex_base);
+		if (pipeline.start < base || uint64_t(pipeline.start - base) + pipeline.count > (pipeline.index_type ? meshes.indices.size() : meshes.positions.size())) {
+			throw std::runtime_error("StaticBatch given a drawable whose vertex range is outside its MeshBuffer.");
+		}
+		if (!is_static(drawable)) continue;
+
+		//world-space bounds of the drawable:
+		glm::mat4x3 to_world = drawable.transform->make_local_to_world();
+		glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+		glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+		for (uint32_t c = 0; c < 8; ++c) {
+			glm::vec3 corner = glm::vec3(
+				(c & 1 ? drawable.max.x : drawable.min.x),
+				(c & 2 ? drawable.max.y : drawable.min.y),
+				(c & 4 ? drawable.max.z : drawable.min.z)
+			);
+			glm::vec3 world = to_world * glm::vec4(corner, 1.0f);
+			min = glm::min(min, world);
+			max = glm::max(max, world);
+		}
+
+		Key key;
+		key.program = pipeline.program;
+		key.OBJECT_TO_CLIP_mat4 = pipeline.OBJECT_TO_CLIP_mat4;
+		key.OBJECT_TO_LIGHT_mat4x3 = pipeline.OBJECT_TO_LIGHT_mat4x3;
+		key.NORMAL_TO_LIGHT_mat3 = pipeline.NORMAL_TO_LIGHT_mat3;
+		for (uint32_t i = 0; i < Scene::Drawable::Pipeline::TextureCount; ++i) {
+			key.textures[i] = pipeline.textures[i].texture;
+			key.targets[i] = pipeline.textures[i].target;
+		}
+		key.cell = glm::ivec3(glm::floor(0.5f * (min + max) / chunk_size));
+
+		Group &group = groups[key];
+		group.members.emplace_back(&drawable);
+		group.min = glm::min(group.min, min);
+		group.max = glm::max(group.max, max);
+	}
+
+	//a group of one gains nothing from merging:
+	for (auto g = groups.begin(); g != groups.end(); /* later */) {
+		if (g->second.members.size() < 2) g = groups.erase(g);
+		else ++g;
+	}
+	if (groups.empty()) return;
+
+	//source vertices come from the MeshBuffer's CPU copy (reading back 'buffer' would stall the pipeline):
+	size_t source_stride = (meshes.quantized ? sizeof(QuantizedVertex) : size_t(stride));
+	if (meshes.vertex_data.size() != meshes.positions.size() * source_stride) {
+		throw std::runtime_error("StaticBatch needs a MeshBuffer loaded with keep_vertex_data (a CPU copy of its vertices).");
+	}
+	//(quantized vertices are decoded once to the float layout)
+	std::vector< uint8_t > decoded;
+	if (meshes.quantized) {
+		decoded.resize(meshes.positions.size() * size_t(stride));
+		for (size_t i = 0; i < meshes.positions.size(); ++i) {
+			QuantizedVertex q;
+			std::memcpy(&q, &meshes.vertex_data[i * sizeof(QuantizedVertex)], sizeof(QuantizedVertex));
+			Vertex v;
+			v.Position = meshes.positions[i]; //(already dequantized)
+			v.Normal = octahedral_decode(q.Normal);
+			v.Color = q.Color;
+			v.TexCoord = glm::vec2(half_to_float(q.TexCoord.x), half_to_float(q.TexCoord.y));
+			std::memcpy(&decoded[i * sizeof(Vertex)], &v, sizeof(Vertex));
+		}
+	}
+	std::vector< uint8_t > const &source = (meshes.quantized ? decoded : meshes.vertex_data);
+
+	size_t total = 0;
+	for (auto const &[key, group] : groups) {
+		for (Scene::Drawable const *drawable : group.members) {
+			total += drawable->pipeline.count;
+		}
+	}
+
+	std::vector< uint8_t > data(total * size_t(stride));
+	vertices.positions.reserve(total);
+
+	//(buffer is created now so vertex arrays can reference it; data is uploaded once it is filled in)
+	glGenBuffers(1, &vertices.buffer);
+	glGenBuffers(1, &vertices.position_buffer);
+
+	//the batch drawables are drawn with an identity transform:
+	scene.transforms.emplace_back();
+	Scene::Transform *identity = &scene.transforms.back();
+	scene.set_name(identity, "StaticBatch");
+
+	GLuint next = 0;
+	for (auto const &[key, group] : groups) {
+		GLuint start = next;
+		for (Scene::Drawable *drawable : group.members) {
+			Scene::Drawable::Pipeline const &pipeline = drawable->pipeline;
+			glm::mat4x3 to_world = drawable->transform->make_local_to_world();
+			glm::mat3 normal_to_world = glm::inverseTranspose(glm::mat3(to_world));
+			//mirroring transforms flip triangle winding, so swap two vertices of each triangle to keep front faces front:
+			bool flip = glm::determinant(glm::mat3(to_world)) < 0.0f;
+
+			GLuint base = (pipeline.index_type ? meshes.index_base : meshes.vertex_base);
+			for (GLuint v = 0; v < pipeline.count; ++v) {
+				GLuint element = pipeline.start - base + v;
+				if (flip && v % 3 == 1) element += 1;
+				else if (flip && v % 3 == 2) element -= 1;
+				GLuint src = (pipeline.index_type ? meshes.indices[element] : element);
+				uint8_t *dst = &data[size_t(next + v) * stride];
+				std::memcpy(dst, &source[size_t(src) * stride], stride);
+
+				glm::vec3 position = to_world * glm::vec4(meshes.positions[src], 1.0f);
+				std::memcpy(dst + vertices.Position.offset, &position, sizeof(position));
+				vertices.positions.emplace_back(position);
+
+				if (transform_normals) {
+					glm::vec3 normal;
+					std::memcpy(&normal, dst + vertices.Normal.offset, sizeof(normal));
+					normal = glm::normalize(normal_to_world * normal);
+					std::memcpy(dst + vertices.Normal.offset, &normal, sizeof(normal));
+				}
+			}
+			next += pipeline.count;
+
+			drawable->batched = true;
+			merged += 1;
+		}
+
+		//make a drawable for the whole group, using the first member's pipeline as a template:
+		scene.drawables.emplace_back(identity);
+		Scene::Drawable &batch = scene.drawables.back();
+		batch.min = group.min;
+		batch.max = group.max;
+		batch.pipeline = group.members[0]->pipeline;
+		batch.pipeline.start = start;
+		batch.pipeline.count = next - start;
+		batch.pipeline.index_type = 0; //(indexed drawables are expanded into triangle lists when merged)
+		batch.pipeline.position_dequantize = glm::mat4x3(1.0f); //(merged vertices are never quantized)
+		batch.pipeline.normal_octahedral = false;
+		batch.batch = true;
+
+		batch.pipeline.vao = vertices.make_vao_for_program(key.program); //(cached by 'vertices')
+		//(members were prepassed with their own buffer's depth vertex array; the batch needs one for its buffer)
+		if (batch.pipeline.depth_vao != 0) {
+			batch.pipeline.depth_vao = (scene.depth_prepass ? vertices.make_vao_for_program(scene.depth_prepass->program) : 0);
+		}
+
+		batches += 1;
+	}
+	assert(next == total);
+
+	//upload merged vertices:
+	glBindBuffer(GL_ARRAY_BUFFER, vertices.buffer);
+	glBufferData(GL_ARRAY_BUFFER, data.size(), data.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, vertices.position_buffer);
+	glBufferData(GL_ARRAY_BUFFER, vertices.positions.size() * sizeof(glm::vec3), vertices.positions.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	GL_ERRORS();
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+/*
+ * StaticBatch merges drawables that never move into a few large drawables,
+ *  so that many static props cost a handful of draw calls instead of one each.
+ *
+ * At construction, every static drawable (as decided by the 'is_static' callback)
+ *  has its vertices (from its MeshBuffer's CPU copy -- see MeshBuffer::vertex_data) transformed to world space
+ *  and appended to a shared vertex buffer. Drawables are grouped by pipeline
+ *  (program, textures, and uniform locations) and by a coarse world-space grid
+ *  cell, so each batch keeps bounds tight enough for culling.
+ *
+ * The original drawables stay in the scene (so pointers and indices stay valid)
+ *  but are marked 'batched', which makes Scene::draw skip them. New drawables --
+ *  one per batch, attached to a new identity transform, and marked 'batch' -- are appended to the scene.
+ *
+ * Not batched: drawables without bounds, with LODs, with a set_uniforms callback
+ *  (which can't be compared), or whose primitive type isn't GL_TRIANGLES.
+ *
+ */
+
+#include "Mesh.hpp"
+#include "Scene.hpp"
+
+#include <functional>
+#include <map>
+
+struct StaticBatch {
+	//merge static drawables of 'scene' (which must all draw vertices from 'meshes', loaded with keep_vertex_data):
+	// note: must outlive the scene's use of the batch drawables (it owns their vertex buffer and vertex arrays)
+	StaticBatch(Scene &scene, MeshBuffer const &meshes, std::function< bool(Scene::Drawable const &) > const &is_static, float chunk_size = 16.0f);
+
+	StaticBatch(StaticBatch const &) = delete;
+	StaticBatch &operator=(StaticBatch const &) = delete;
+
+	uint32_t merged = 0; //number of drawables merged
+	uint32_t batches = 0; //number of drawables they were merged into
+
+	//-- internals ---
+	MeshBuffer vertices; //merged, world-space vertices (same layout as the source MeshBuffer, or the float layout if it is quantized; also owns the batches' vertex arrays)
+};
@@ -7,7 +7,7 @@
 #include "gl_compile_program.hpp"
 #include "gl_errors.hpp"
 
-Load< TextureProgram > texture_program(LoadTagEarly, []() -> TextureProgram const * {
+Load< TextureProgram > texture_program(LoadOnGLThread, {}, []() -> TextureProgram const * {
 
 	TextureProgram *ret = new TextureProgram();
 	return ret;
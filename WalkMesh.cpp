@@ -1,12 +1,11 @@
 #include "WalkMesh.hpp"
 
-#include "read_write_chunk.hpp"
+#include "ChunkFile.hpp"
 
 #include <glm/gtx/norm.hpp>
 #include <glm/gtx/string_cast.hpp>
 
 #include <iostream>
-#include <fstream>
 #include <algorithm>
 #include <string>
 
@@ -25,6 +24,15 @@ WalkMesh::WalkMesh(std::vector< glm::vec3 > const &vertices_, std::vector< glm::
 		do_next(tri.z, tri.x, tri.y);
 	}
 
+	//construct edge_triangle map (maps each edge to its triangle's index):
+	edge_triangle.reserve(triangles.size()*3);
+	for (uint32_t t = 0; t < triangles.size(); ++t) {
+		glm::uvec3 const &tri = triangles[t];
+		edge_triangle.emplace(glm::uvec2(tri.x, tri.y), t);
+		edge_triangle.emplace(glm::uvec2(tri.y, tri.z), t);
+		edge_triangle.emplace(glm::uvec2(tri.z, tri.x), t);
+	}
+
 	//DEBUG: are vertex normals consistent with geometric normals?
 	for (auto const &tri : triangles) {
 		glm::vec3 const &a = vertices[tri.x];
@@ -212,19 +220,20 @@ bool WalkMesh::cross_edge(WalkPoint const &start, WalkPoint *end_, glm::quat *ro
 
 
 WalkMeshes::WalkMeshes(std::string const &filename) {
-	std::ifstream file(filename, std::ios::binary);
+	ChunkFile file(filename);
 
-	std::vector< glm::vec3 > vertices;
-	read_chunk(file, "p...", &vertices);
+	//(chunks are viewed in place; each walkmesh copies out its own part)
+	ChunkView< glm::vec3 > vertices;
+	file.view("p...", &vertices);
 
-	std::vector< glm::vec3 > normals;
-	read_chunk(file, "n...", &normals);
+	ChunkView< glm::vec3 > normals;
+	file.view("n...", &normals);
 
-	std::vector< glm::uvec3 > triangles;
-	read_chunk(file, "tri0", &triangles);
+	ChunkView< glm::uvec3 > triangles;
+	file.view("tri0", &triangles);
 
-	std::vector< char > names;
-	read_chunk(file, "str0", &names);
+	ChunkView< char > names;
+	file.view("str0", &names);
 
 	struct IndexEntry {
 		uint32_t name_begin, name_end;
@@ -232,10 +241,10 @@ WalkMeshes::WalkMeshes(std::string const &filename) {
 		uint32_t triangle_begin, triangle_end;
 	};
 
-	std::vector< IndexEntry > index;
-	read_chunk(file, "idxA", &index);
+	ChunkView< IndexEntry > index;
+	file.view("idxA", &index);
 
-	if (file.peek() != EOF) {
+	if (file.trailing) {
 		std::cerr << "WARNING: trailing data in walkmesh file '" << filename << "'" << std::endl;
 	}
 
@@ -27,9 +27,19 @@ struct WalkMesh {
 	//This "next vertex" map includes [a,b]->c, [b,c]->a, and [c,a]->b for each triangle (a,b,c), and is useful for checking what's over an edge from a given point:
 	std::unordered_map< glm::uvec2, uint32_t > next_vertex;
 
+	//Maps each (directed) edge to the index of the triangle it belongs to:
+	std::unordered_map< glm::uvec2, uint32_t > edge_triangle;
+
 	//Construct new WalkMesh and build next_vertex structure:
 	WalkMesh(std::vector< glm::vec3 > const &vertices_, std::vector< glm::vec3 > const &normals_, std::vector< glm::uvec3 > const &triangles_);
 
+	//index (in 'triangles') of the triangle a walkpoint is on, or -1U if not on this mesh:
+	uint32_t triangle_index(WalkPoint const &wp) const {
+		auto f = edge_triangle.find(glm::uvec2(wp.indices.x, wp.indices.y));
+		if (f == edge_triangle.end()) return -1U;
+		return f->second;
+	}
+
 	//used to initialize walking -- finds the closest point on the walk mesh:
 	// (should only need to call this at the start of a level)
 	WalkPoint nearest_walk_point(glm::vec3 const &world_point) const;
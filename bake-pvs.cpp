@@ -0,0 +1,375 @@
+//bake-pvs precomputes which drawables of a scene can be seen from each triangle of a walkmesh,
+// and writes the result as a PVS file (see PVS.hpp for the format).
+//
+//Usage:
+//  bake-pvs <in.scene> <meshes.pnct> <walkmeshes.w> <walkmesh name> <out.pvs> [eye height]
+//
+//For each walkmesh triangle, eyes are placed 'eye height' (default 0.8, as in PlayMode) above
+// a few points on the triangle; a drawable is visible if a ray from some eye reaches one of
+// its sample points (triangle centroids) before hitting any other geometry.
+//Sets are then grown by each triangle's edge neighbors, to cover viewpoints between samples.
+
+#include "Scene.hpp"
+#include "WalkMesh.hpp"
+#include "PVS.hpp"
+#include "ChunkFile.hpp"
+#include "quantize.hpp"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+
+//triangles of all drawables in world space, with a simple bounding volume hierarchy for ray casts:
+struct RayScene {
+	struct Triangle {
+		glm::vec3 a, b, c;
+		uint32_t drawable;
+	};
+	std::vector< Triangle > triangles;
+
+	struct Node {
+		glm::vec3 min, max;
+		uint32_t begin, end; //triangle range (leaves)
+		uint32_t child = -1U; //first child (second is child + 1); -1U for leaves
+	};
+	std::vector< Node > nodes;
+
+	void build() {
+		nodes.clear();
+		nodes.emplace_back();
+		build_node(0, 0, uint32_t(triangles.size()));
+	}
+
+	void build_node(uint32_t index, uint32_t begin, uint32_t end) {
+		glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+		glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+		for (uint32_t t = begin; t < end; ++t) {
+			for (glm::vec3 const &p : {triangles[t].a, triangles[t].b, triangles[t].c}) {
+				min = glm::min(min, p);
+				max = glm::max(max, p);
+			}
+		}
+		nodes[index].min = min;
+		nodes[index].max = max;
+		nodes[index].begin = begin;
+		nodes[index].end = end;
+		if (end - begin <= 4) return;
+
+		//split at the median along the longest axis:
+		glm::vec3 size = max - min;
+		uint32_t axis = (size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2));
+		uint32_t mid = (begin + end) / 2;
+		std::nth_element(triangles.begin() + begin, triangles.begin() + mid, triangles.begin() + end, [axis](Triangle const &x, Triangle const &y) {
+			return (x.a[axis] + x.b[axis] + x.c[axis]) < (y.a[axis] + y.b[axis] + y.c[axis]);
+		});
+		uint32_t child = uint32_t(nodes.size());
+		nodes[index].child = child;
+		nodes.emplace_back();
+		nodes.emplace_back();
+		build_node(child, begin, mid);
+		build_node(child + 1, mid, end);
+	}
+
+	//closest hit along origin + t * dir for t in (0, max_t); returns drawable index or -1U:
+	uint32_t cast(glm::vec3 const &origin, glm::vec3 const &dir, float max_t) const {
+		glm::vec3 inv_dir = 1.0f / dir;
+		uint32_t hit = -1U;
+		float best = max_t;
+		uint32_t stack[64];
+		uint32_t top = 0;
+		stack[top++] = 0;
+		while (top) {
+			Node const &node = nodes[stack[--top]];
+			//slab test:
+			glm::vec3 t0 = (node.min - origin) * inv_dir;
+			glm::vec3 t1 = (node.max - origin) * inv_dir;
+			glm::vec3 lo = glm::min(t0, t1);
+			glm::vec3 hi = glm::max(t0, t1);
+			float enter = std::max(std::max(lo.x, lo.y), std::max(lo.z, 0.0f));
+			float exit = std::min(std::min(hi.x, hi.y), std::min(hi.z, best));
+			if (!(enter <= exit)) continue;
+
+			if (node.child != -1U) {
+				if (top + 2 > 64) throw std::runtime_error("ray cast stack overflow");
+				stack[top++] = node.child;
+				stack[top++] = node.child + 1;
+				continue;
+			}
+			for (uint32_t i = node.begin; i < node.end; ++i) {
+				//Moller-Trumbore:
+				Triangle const &tri = triangles[i];
+				glm::vec3 e1 = tri.b - tri.a;
+				glm::vec3 e2 = tri.c - tri.a;
+				glm::vec3 p = glm::cross(dir, e2);
+				float det = glm::dot(e1, p);
+				if (std::abs(det) < 1e-12f) continue;
+				float inv_det = 1.0f / det;
+				glm::vec3 s = origin - tri.a;
+				float u = glm::dot(s, p) * inv_det;
+				if (u < 0.0f || u > 1.0f) continue;
+				glm::vec3 q = glm::cross(s, e1);
+				float v = glm::dot(dir, q) * inv_det;
+				if (v < 0.0f || u + v > 1.0f) continue;
+				float t = glm::dot(e2, q) * inv_det;
+				if (t > 0.0f && t < best) {
+					best = t;
+					hit = tri.drawable;
+				}
+			}
+		}
+		return hit;
+	}
+};
+
+}
+
+int main(int argc, char **argv) {
+	if (argc != 6 && argc != 7) {
+		std::cerr << "Usage:\n\t" << argv[0] << " <in.scene> <meshes.pnct> <walkmeshes.w> <walkmesh name> <out.pvs> [eye height]" << std::endl;
+		return 1;
+	}
+	std::string scene_file = argv[1];
+	std::string meshes_file = argv[2];
+	std::string walkmeshes_file = argv[3];
+	std::string walkmesh_name = argv[4];
+	std::string out_file = argv[5];
+	float eye_height = (argc == 7 ? std::stof(argv[6]) : 0.8f);
+
+	try {
+		auto before = std::chrono::high_resolution_clock::now();
+
+		//------ read mesh positions (same format as MeshBuffer's constructor) ------
+		struct Vertex {
+			glm::vec3 Position;
+			glm::vec3 Normal;
+			glm::u8vec4 Color;
+			glm::vec2 TexCoord;
+		};
+		static_assert(sizeof(Vertex) == 3*4+3*4+4*1+2*4, "Vertex is packed.");
+
+		struct IndexEntry {
+			uint32_t name_begin, name_end;
+			uint32_t vertex_begin, vertex_end;
+		};
+		static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
+
+		//(indexed files -- written by cook-meshes -- also have indices, which are expanded back to triangle lists here)
+		struct IndexRange {
+			uint32_t index_begin, index_end;
+		};
+		static_assert(sizeof(IndexRange) == 8, "Index range should be packed");
+
+		std::vector< Vertex > vertices;
+		std::vector< char > mesh_strings;
+		std::vector< IndexEntry > index;
+		{
+			ChunkFile file(meshes_file);
+			//(quantized files -- written by cook-meshes --quantize -- are decoded once their boxes have been read)
+			std::vector< QuantizedVertex > quantized;
+			bool is_quantized = (file.find("pncq") != nullptr);
+			if (is_quantized) file.read("pncq", &quantized);
+			else file.read("pnct", &vertices);
+			file.read("str0", &mesh_strings);
+			file.read("idx0", &index);
+			std::vector< uint32_t > indices;
+			std::vector< IndexRange > ranges;
+			if (file.find("ind0")) {
+				file.read("ind0", &indices);
+				file.read("inr0", &ranges);
+				if (ranges.size() != index.size()) {
+					throw std::runtime_error("index ranges don't match index entries");
+				}
+			}
+			if (is_quantized) {
+				std::vector< QuantizationBox > boxes;
+				file.read("qbx0", &boxes);
+				if (boxes.size() != index.size()) {
+					throw std::runtime_error("quantization boxes don't match index entries");
+				}
+				vertices.assign(quantized.size(), Vertex{});
+				for (uint32_t i = 0; i < index.size(); ++i) {
+					if (!(index[i].vertex_begin <= index[i].vertex_end && index[i].vertex_end <= quantized.size())) {
+						throw std::runtime_error("index entry has out-of-range vertex start/count");
+					}
+					for (uint32_t v = index[i].vertex_begin; v < index[i].vertex_end; ++v) {
+						vertices[v].Position = dequantize_position(quantized[v].Position, boxes[i]);
+					}
+				}
+			}
+			if (!ranges.empty()) {
+				std::vector< Vertex > expanded;
+				expanded.reserve(indices.size());
+				for (uint32_t i = 0; i < index.size(); ++i) {
+					if (!(ranges[i].index_begin <= ranges[i].index_end && ranges[i].index_end <= indices.size())) {
+						throw std::runtime_error("index range is out of range");
+					}
+					index[i].vertex_begin = uint32_t(expanded.size());
+					for (uint32_t j = ranges[i].index_begin; j < ranges[i].index_end; ++j) {
+						if (indices[j] >= vertices.size()) throw std::runtime_error("index is out of range");
+						expanded.emplace_back(vertices[indices[j]]);
+					}
+					index[i].vertex_end = uint32_t(expanded.size());
+				}
+				vertices = std::move(expanded);
+			}
+		}
+		std::map< std::string, IndexEntry > mesh_ranges;
+		for (auto const &entry : index) {
+			if (!(entry.name_begin <= entry.name_end && entry.name_end <= mesh_strings.size())) {
+				throw std::runtime_error("index entry has out-of-range name begin/end");
+			}
+			if (!(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= vertices.size())) {
+				throw std::runtime_error("index entry has out-of-range vertex start/count");
+			}
+			//first mesh with a given name wins, as in MeshBuffer:
+			mesh_ranges.emplace(std::string(mesh_strings.begin() + entry.name_begin, mesh_strings.begin() + entry.name_end), entry);
+		}
+
+		//------ load scene, making one drawable per mesh entry (as PlayMode does) ------
+		Scene scene;
+		scene.load(scene_file, [&](Scene &scene, Scene::Transform *transform, std::string const &mesh_name) {
+			auto f = mesh_ranges.find(mesh_name);
+			if (f == mesh_ranges.end()) {
+				throw std::runtime_error("Mesh '" + mesh_name + "' (referenced by '" + scene_file + "') doesn't exist in '" + meshes_file + "'.");
+			}
+			scene.drawables.emplace_back(transform);
+			scene.drawables.back().pipeline.start = f->second.vertex_begin;
+			scene.drawables.back().pipeline.count = f->second.vertex_end - f->second.vertex_begin;
+		});
+
+		WalkMeshes walkmeshes(walkmeshes_file);
+		WalkMesh const &walkmesh = walkmeshes.lookup(walkmesh_name);
+
+		//------ gather world-space triangles and per-drawable sample points ------
+		RayScene rays;
+		std::vector< std::vector< glm::vec3 > > targets(scene.drawables.size());
+		{
+			uint32_t d = 0;
+			for (auto const &drawable : scene.drawables) {
+				glm::mat4x3 to_world = drawable.transform->make_local_to_world();
+				uint32_t start = drawable.pipeline.start;
+				uint32_t count = drawable.pipeline.count / 3 * 3;
+				std::vector< glm::vec3 > centroids;
+				for (uint32_t v = start; v < start + count; v += 3) {
+					RayScene::Triangle tri;
+					tri.a = to_world * glm::vec4(vertices[v+0].Position, 1.0f);
+					tri.b = to_world * glm::vec4(vertices[v+1].Position, 1.0f);
+					tri.c = to_world * glm::vec4(vertices[v+2].Position, 1.0f);
+					tri.drawable = d;
+					rays.triangles.emplace_back(tri);
+					centroids.emplace_back((tri.a + tri.b + tri.c) / 3.0f);
+				}
+				//keep (up to) a fixed number of evenly-strided samples per drawable:
+				uint32_t const MaxTargets = 64;
+				uint32_t stride = std::max(1u, uint32_t(centroids.size()) / MaxTargets);
+				for (uint32_t i = 0; i < centroids.size(); i += stride) {
+					targets[d].emplace_back(centroids[i]);
+				}
+				++d;
+			}
+		}
+		rays.build();
+
+		//------ compute visibility from each walkmesh triangle ------
+		uint32_t drawable_count = uint32_t(scene.drawables.size());
+		uint32_t words_per_row = (drawable_count + 31) / 32;
+		uint32_t triangle_count = uint32_t(walkmesh.triangles.size());
+		std::vector< uint32_t > sets(size_t(triangle_count) * words_per_row, 0);
+
+		for (uint32_t t = 0; t < triangle_count; ++t) {
+			glm::uvec3 const &tri = walkmesh.triangles[t];
+			uint32_t *set = sets.data() + size_t(t) * words_per_row;
+
+			//eyes above the centroid and above points pulled in from each corner:
+			std::vector< glm::vec3 > eyes;
+			for (glm::vec3 w : {glm::vec3(1.0f / 3.0f), glm::vec3(0.8f, 0.1f, 0.1f), glm::vec3(0.1f, 0.8f, 0.1f), glm::vec3(0.1f, 0.1f, 0.8f)}) {
+				WalkPoint wp(tri, w);
+				eyes.emplace_back(walkmesh.to_world_point(wp) + eye_height * walkmesh.to_world_smooth_normal(wp));
+			}
+
+			for (uint32_t d = 0; d < drawable_count; ++d) {
+				bool visible = false;
+				for (auto const &eye : eyes) {
+					for (auto const &target : targets[d]) {
+						glm::vec3 to = target - eye;
+						float dist = glm::length(to);
+						if (dist < 1e-6f) { visible = true; break; }
+						//(cast slightly past the target so the target's own triangle is hit)
+						uint32_t hit = rays.cast(eye, to / dist, dist * 1.001f + 1e-4f);
+						if (hit == d) { visible = true; break; }
+					}
+					if (visible) break;
+				}
+				if (visible) set[d / 32] |= (1u << (d % 32));
+			}
+		}
+
+		//grow each set by its edge neighbors' sets:
+		std::vector< uint32_t > grown = sets;
+		for (uint32_t t = 0; t < triangle_count; ++t) {
+			glm::uvec3 const &tri = walkmesh.triangles[t];
+			for (glm::uvec2 edge : {glm::uvec2(tri.y, tri.x), glm::uvec2(tri.z, tri.y), glm::uvec2(tri.x, tri.z)}) {
+				auto f = walkmesh.edge_triangle.find(edge);
+				if (f == walkmesh.edge_triangle.end()) continue;
+				for (uint32_t w = 0; w < words_per_row; ++w) {
+					grown[size_t(t) * words_per_row + w] |= sets[size_t(f->second) * words_per_row + w];
+				}
+			}
+		}
+
+		//------ share identical rows and write ------
+		std::vector< uint32_t > row_index(triangle_count);
+		std::vector< uint32_t > rows;
+		std::map< std::vector< uint32_t >, uint32_t > unique;
+		for (uint32_t t = 0; t < triangle_count; ++t) {
+			std::vector< uint32_t > row(grown.begin() + size_t(t) * words_per_row, grown.begin() + size_t(t + 1) * words_per_row);
+			auto ret = unique.emplace(row, uint32_t(unique.size()));
+			if (ret.second) rows.insert(rows.end(), row.begin(), row.end());
+			row_index[t] = ret.first->second;
+		}
+
+		struct Header {
+			uint32_t triangle_count;
+			uint32_t drawable_count;
+			uint32_t words_per_row;
+		};
+		static_assert(sizeof(Header) == 4 + 4 + 4, "PVS header is packed.");
+		std::vector< Header > header{ Header{triangle_count, drawable_count, words_per_row} };
+
+		ChunkFileWriter writer;
+		writer.add("pvh0", header);
+		writer.add("pvi0", row_index);
+		writer.add("pvs0", rows);
+		std::ofstream out(out_file, std::ios::binary);
+		writer.write(&out);
+		if (!out) {
+			throw std::runtime_error("Failed to write '" + out_file + "'.");
+		}
+
+		//report:
+		uint64_t total = 0;
+		for (uint32_t t = 0; t < triangle_count; ++t) {
+			for (uint32_t w = 0; w < words_per_row; ++w) {
+				uint32_t bits = grown[size_t(t) * words_per_row + w];
+				while (bits) { total += 1; bits &= bits - 1; }
+			}
+		}
+		auto after = std::chrono::high_resolution_clock::now();
+		std::cout << "Baked PVS for " << triangle_count << " walkmesh triangles x " << drawable_count << " drawables ("
+			<< unique.size() << " unique sets, average " << (triangle_count ? double(total) / triangle_count : 0.0) << " visible) to '" << out_file << "' in "
+			<< std::chrono::duration< double >(after - before).count() << "s." << std::endl;
+	} catch (std::exception &e) {
+		std::cerr << "ERROR: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,271 @@
+//bake-scene resolves the mesh names in a .scene file against a .pnct file ahead of time,
+// so that Scene::load can make drawables without per-mesh name lookups.
+//
+//Usage:
+//  bake-scene [--compress] <in.scene> <meshes.pnct> <out.scene>
+//
+//The output is the input scene (in the v2 format of ChunkFile.hpp) with two (or three) extra chunks after "lmp0":
+// dwh0 < BakedHeader > -- identifies the .pnct that was baked against (see MeshBuffer::index_hash)
+// dwb0 < BakedEntry > * -- transform index, vertex range (index range, for indexed .pnct files), and bounds (quantization box, for quantized .pnct files) for each mesh entry
+// dwl0 < BakedLOD > * -- vertex ranges of "Name.LOD1", "Name.LOD2", ... meshes for each entry (only if any exist)
+//Any other chunks (e.g., for Scene::load_extra) are copied through unchanged, after these.
+//Re-baking an already-baked scene replaces its baked chunks.
+//With --compress, chunks are stored LZ4 compressed (see ChunkFileWriter::add_compressed).
+
+#include "Mesh.hpp"
+#include "ChunkFile.hpp"
+
+#include <glm/glm.hpp>
+
+#include <fstream>
+#include <iostream>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+int main(int argc, char **argv) {
+	std::vector< std::string > args(argv + 1, argv + argc);
+	bool compress = false;
+	if (!args.empty() && args[0] == "--compress") {
+		compress = true;
+		args.erase(args.begin());
+	}
+	if (args.size() != 3) {
+		std::cerr << "Usage:\n\t" << argv[0] << " [--compress] <in.scene> <meshes.pnct> <out.scene>" << std::endl;
+		return 1;
+	}
+	std::string in_file = args[0];
+	std::string meshes_file = args[1];
+	std::string out_file = args[2];
+
+	try {
+		//------ read meshes (same format as MeshBuffer's constructor) ------
+		struct Vertex {
+			glm::vec3 Position;
+			glm::vec3 Normal;
+			glm::u8vec4 Color;
+			glm::vec2 TexCoord;
+		};
+		static_assert(sizeof(Vertex) == 3*4+3*4+4*1+2*4, "Vertex is packed.");
+
+		struct IndexEntry {
+			uint32_t name_begin, name_end;
+			uint32_t vertex_begin, vertex_end;
+		};
+		static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
+
+		//(indexed files -- written by cook-meshes -- also have index ranges, which are what get baked)
+		struct IndexRange {
+			uint32_t index_begin, index_end;
+		};
+		static_assert(sizeof(IndexRange) == 8, "Index range should be packed");
+
+		std::vector< Vertex > vertices;
+		std::vector< char > mesh_strings;
+		std::vector< IndexEntry > index;
+		std::vector< uint32_t > indices;
+		std::vector< IndexRange > ranges;
+		//(quantized files -- written by cook-meshes --quantize -- have quantized vertices and a box per index entry, which is baked as its bounds)
+		bool quantized = false;
+		std::vector< QuantizedVertex > quantized_vertices;
+		std::vector< QuantizationBox > boxes;
+		{
+			ChunkFile file(meshes_file);
+			quantized = (file.find("pncq") != nullptr);
+			if (quantized) file.read("pncq", &quantized_vertices);
+			else file.read("pnct", &vertices);
+			file.read("str0", &mesh_strings);
+			file.read("idx0", &index);
+			if (file.find("ind0")) {
+				file.read("ind0", &indices);
+				file.read("inr0", &ranges);
+				if (ranges.size() != index.size()) {
+					throw std::runtime_error("index ranges don't match index entries");
+				}
+			}
+			if (quantized) {
+				file.read("qbx0", &boxes);
+				if (boxes.size() != index.size()) {
+					throw std::runtime_error("quantization boxes don't match index entries");
+				}
+			}
+		}
+		size_t total_vertices = (quantized ? quantized_vertices.size() : vertices.size());
+
+		struct BakedMesh {
+			uint32_t start = 0, count = 0;
+			glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+			glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+		};
+		std::map< std::string, BakedMesh > baked_meshes;
+		for (uint32_t i = 0; i < index.size(); ++i) {
+			IndexEntry const &entry = index[i];
+			if (!(entry.name_begin <= entry.name_end && entry.name_end <= mesh_strings.size())) {
+				throw std::runtime_error("index entry has out-of-range name begin/end");
+			}
+			if (!(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= total_vertices)) {
+				throw std::runtime_error("index entry has out-of-range vertex start/count");
+			}
+			BakedMesh mesh;
+			if (ranges.empty()) {
+				mesh.start = entry.vertex_begin;
+				mesh.count = entry.vertex_end - entry.vertex_begin;
+			} else {
+				if (!(ranges[i].index_begin <= ranges[i].index_end && ranges[i].index_end <= indices.size())) {
+					throw std::runtime_error("index range is out of range");
+				}
+				mesh.start = ranges[i].index_begin;
+				mesh.count = ranges[i].index_end - ranges[i].index_begin;
+			}
+			if (quantized) {
+				mesh.min = boxes[i].min;
+				mesh.max = boxes[i].max;
+			} else {
+				for (uint32_t v = entry.vertex_begin; v < entry.vertex_end; ++v) {
+					mesh.min = glm::min(mesh.min, vertices[v].Position);
+					mesh.max = glm::max(mesh.max, vertices[v].Position);
+				}
+			}
+			//first mesh with a given name wins, as in MeshBuffer:
+			baked_meshes.emplace(std::string(mesh_strings.begin() + entry.name_begin, mesh_strings.begin() + entry.name_end), mesh);
+		}
+
+		//------ read scene (chunks are passed through as raw -- decoded -- bytes) ------
+		std::vector< char > str0, xfh0, msh0, cam0, lmp0;
+		struct Chunk {
+			ChunkFile::Entry entry;
+			std::vector< char > data;
+		};
+		std::vector< Chunk > rest; //chunks that aren't read or baked here
+		{
+			ChunkFile file(in_file);
+			file.read("str0", &str0);
+			file.read("xfh0", &xfh0);
+			file.read("msh0", &msh0);
+			file.read("cam0", &cam0);
+			file.read("lmp0", &lmp0);
+
+			//any existing baked chunks are skipped:
+			if (file.find("dwh0")) {
+				std::cout << "Replacing existing baked drawables." << std::endl;
+			}
+
+			for (ChunkFile::Entry const &entry : file.entries) {
+				std::string magic(entry.magic, 4);
+				if (magic == "str0" || magic == "xfh0" || magic == "msh0" || magic == "cam0" || magic == "lmp0") continue;
+				if (magic == "dwh0" || magic == "dwb0" || magic == "dwl0") continue;
+				rest.emplace_back(Chunk{entry, std::vector< char >()});
+				file.read(entry, &rest.back().data);
+			}
+			if (file.trailing) {
+				std::cerr << "WARNING: dropping trailing data in '" << in_file << "'." << std::endl;
+			}
+		} //(file is unmapped here, so baking in place works)
+
+		//------ resolve mesh entries ------
+		struct MeshEntry {
+			uint32_t transform;
+			uint32_t name_begin;
+			uint32_t name_end;
+		};
+		static_assert(sizeof(MeshEntry) == 4 + 4 + 4, "MeshEntry is packed.");
+		if (msh0.size() % sizeof(MeshEntry) != 0) {
+			throw std::runtime_error("Size of msh0 chunk not divisible by element size");
+		}
+		std::vector< MeshEntry > mesh_entries(msh0.size() / sizeof(MeshEntry));
+		if (!mesh_entries.empty()) std::memcpy(mesh_entries.data(), msh0.data(), msh0.size());
+
+		struct BakedHeader {
+			uint32_t total_vertices;
+			uint32_t index_hash;
+		};
+		static_assert(sizeof(BakedHeader) == 4 + 4, "BakedHeader is packed.");
+
+		struct BakedEntry {
+			uint32_t transform;
+			uint32_t type; //GLenum
+			uint32_t start, count;
+			glm::vec3 min, max;
+		};
+		static_assert(sizeof(BakedEntry) == 4 + 4 + 4 + 4 + 4*3 + 4*3, "BakedEntry is packed.");
+
+		struct BakedLOD {
+			uint32_t drawable; //index into entries
+			uint32_t type; //GLenum
+			uint32_t start, count;
+		};
+		static_assert(sizeof(BakedLOD) == 4 + 4 + 4 + 4, "BakedLOD is packed.");
+
+		std::vector< BakedHeader > header(1);
+		header[0].total_vertices = uint32_t(total_vertices);
+		header[0].index_hash = MeshBuffer::hash_index(mesh_strings.data(), mesh_strings.size(), index.data(), index.size() * sizeof(IndexEntry), ranges.data(), ranges.size() * sizeof(IndexRange), boxes.data(), boxes.size() * sizeof(QuantizationBox));
+
+		std::vector< BakedEntry > entries;
+		entries.reserve(mesh_entries.size());
+		std::vector< BakedLOD > lods;
+		for (auto const &m : mesh_entries) {
+			if (!(m.name_begin <= m.name_end && m.name_end <= str0.size())) {
+				throw std::runtime_error("scene file '" + in_file + "' contains mesh entry with invalid name indices");
+			}
+			std::string name(str0.begin() + m.name_begin, str0.begin() + m.name_end);
+			auto f = baked_meshes.find(name);
+			if (f == baked_meshes.end()) {
+				throw std::runtime_error("Mesh '" + name + "' (referenced by '" + in_file + "') doesn't exist in '" + meshes_file + "'.");
+			}
+			BakedEntry entry;
+			entry.transform = m.transform;
+			entry.type = GL_TRIANGLES;
+			entry.start = f->second.start;
+			entry.count = f->second.count;
+			entry.min = f->second.min;
+			entry.max = f->second.max;
+			entries.emplace_back(entry);
+
+			//LOD chain, as grouped by MeshBuffer::lookup_lods():
+			for (uint32_t level = 1; ; ++level) {
+				auto l = baked_meshes.find(name + ".LOD" + std::to_string(level));
+				if (l == baked_meshes.end()) break;
+				BakedLOD lod;
+				lod.drawable = uint32_t(entries.size() - 1);
+				lod.type = GL_TRIANGLES;
+				lod.start = l->second.start;
+				lod.count = l->second.count;
+				lods.emplace_back(lod);
+			}
+		}
+
+		//------ write baked scene ------
+		ChunkFileWriter writer;
+		//(with --compress, chunks of 32-bit values are shuffled by 4 bytes)
+		auto add = [&writer,&compress](std::string const &magic, auto const &from, uint16_t shuffle) {
+			if (compress) writer.add_compressed(magic, from, shuffle);
+			else writer.add(magic, from);
+		};
+		add("str0", str0, 0);
+		add("xfh0", xfh0, 4);
+		add("msh0", msh0, 4);
+		add("cam0", cam0, 4);
+		add("lmp0", lmp0, 4);
+		add("dwh0", header, 4);
+		add("dwb0", entries, 4);
+		if (!lods.empty()) add("dwl0", lods, 4);
+		for (Chunk const &chunk : rest) {
+			if (compress) writer.add_compressed(std::string(chunk.entry.magic, 4), chunk.data.data(), chunk.data.size(), 0, chunk.entry.alignment);
+			else writer.add(std::string(chunk.entry.magic, 4), chunk.data.data(), chunk.data.size(), chunk.entry.alignment);
+		}
+
+		std::ofstream out(out_file, std::ios::binary);
+		writer.write(&out);
+		if (!out) {
+			throw std::runtime_error("Failed to write '" + out_file + "'.");
+		}
+
+		std::cout << "Baked " << entries.size() << " drawables (with " << lods.size() << " LODs) from '" << in_file << "' against '" << meshes_file << "' to '" << out_file << "'." << std::endl;
+	} catch (std::exception &e) {
+		std::cerr << "ERROR: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,483 @@
+//cook-meshes converts a .pnct file (as written by export-meshes.py) to an indexed .pnct file,
+// which MeshBuffer draws with glDrawElements.
+//
+//Usage:
+//  cook-meshes [--quantize] [--compress] <in.pnct> <out.pnct> [cache size]
+//
+//Each mesh is cooked separately:
+// - (with --quantize) vertices are snapped to the quantized layout (see quantize.hpp);
+// - identical vertices are welded;
+// - triangles are reordered for the post-transform vertex cache ("Linear-Speed Vertex Cache
+//   Optimisation", Tom Forsyth, 2006), using an LRU cache model of [cache size] (default 32) entries;
+// - vertices are reordered by first use, so vertex fetch walks the buffer mostly in order.
+//
+//The output has the same "pnct", "str0", and "idx0" chunks as the input (with "idx0" vertex ranges now
+// covering each mesh's welded vertices), plus:
+// ind0 < uint32_t > * -- indices (absolute, i.e., into the whole "pnct" chunk)
+// inr0 < IndexRange > * -- range of indices for each "idx0" entry
+//With --quantize, "pnct" is replaced by "pncq" (QuantizedVertex) and there is one more chunk:
+// qbx0 < QuantizationBox > * -- box that positions are relative to for each "idx0" entry
+//   (the bounds of the mesh, or -- for "Name" and "Name.LOD<n>" meshes -- of the whole LOD chain,
+//    since MeshBuffer draws LODs with their base mesh's dequantization)
+//The output is written in the v2 format of ChunkFile.hpp (input may be in either format).
+//With --compress, chunks are stored LZ4 compressed, byte-shuffled by the size of their scalars
+// (see ChunkFileWriter::add_compressed); MeshBuffer decodes them in parallel when loading.
+//Cooking an already-cooked file re-cooks it (so cooking in place is fine).
+
+#include "ChunkFile.hpp"
+#include "quantize.hpp"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct Vertex {
+	glm::vec3 Position;
+	glm::vec3 Normal;
+	glm::u8vec4 Color;
+	glm::vec2 TexCoord;
+};
+static_assert(sizeof(Vertex) == 3*4+3*4+4*1+2*4, "Vertex is packed.");
+
+struct IndexEntry {
+	uint32_t name_begin, name_end;
+	uint32_t vertex_begin, vertex_end;
+};
+static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
+
+struct IndexRange {
+	uint32_t index_begin, index_end;
+};
+static_assert(sizeof(IndexRange) == 8, "Index range should be packed");
+
+//vertices are welded only if they are bit-for-bit identical:
+struct VertexBytesHash {
+	size_t operator()(Vertex const &v) const {
+		uint32_t hash = 0x811c9dc5;
+		unsigned char const *data = reinterpret_cast< unsigned char const * >(&v);
+		for (size_t i = 0; i < sizeof(Vertex); ++i) {
+			hash = (hash ^ data[i]) * 0x01000193;
+		}
+		return hash;
+	}
+};
+struct VertexBytesEqual {
+	bool operator()(Vertex const &a, Vertex const &b) const {
+		return std::memcmp(&a, &b, sizeof(Vertex)) == 0;
+	}
+};
+
+//reorder a triangle list (of vertices [0,vertex_count)) for an LRU post-transform cache of cache_size entries:
+static std::vector< uint32_t > optimize_triangle_order(std::vector< uint32_t > const &indices, uint32_t vertex_count, uint32_t cache_size) {
+	uint32_t triangle_count = uint32_t(indices.size() / 3);
+
+	//scoring as suggested in Forsyth's article:
+	float const CacheDecayPower = 1.5f;
+	float const LastTriScore = 0.75f;
+	float const ValenceBoostScale = 2.0f;
+	float const ValenceBoostPower = 0.5f;
+
+	struct VertexData {
+		int32_t cache_position = -1;
+		float score = 0.0f;
+		uint32_t remaining = 0; //triangles not yet emitted
+		uint32_t triangles_begin = 0; //into vertex_triangles
+	};
+	std::vector< VertexData > vertices(vertex_count);
+	for (uint32_t i : indices) vertices[i].remaining += 1;
+
+	//each vertex's (remaining) triangles, packed; emitted triangles are swapped past 'remaining':
+	std::vector< uint32_t > vertex_triangles(indices.size());
+	{
+		uint32_t offset = 0;
+		for (auto &v : vertices) {
+			v.triangles_begin = offset;
+			offset += v.remaining;
+		}
+		std::vector< uint32_t > fill(vertex_count, 0);
+		for (uint32_t t = 0; t < triangle_count; ++t) {
+			for (uint32_t j = 0; j < 3; ++j) {
+				uint32_t v = indices[3*t+j];
+				vertex_triangles[vertices[v].triangles_begin + fill[v]++] = t;
+			}
+		}
+	}
+
+	auto vertex_score = [&](VertexData const &v) {
+		if (v.remaining == 0) return -1.0f;
+		float score = 0.0f;
+		if (v.cache_position < 0) {
+			//not in cache
+		} else if (v.cache_position < 3) {
+			//used by the last triangle; fixed score so triangles sharing an edge aren't favored over others:
+			score = LastTriScore;
+		} else {
+			float scaler = 1.0f / float(cache_size - 3);
+			score = std::pow(1.0f - float(v.cache_position - 3) * scaler, CacheDecayPower);
+		}
+		//favor vertices with few triangles left, to avoid leaving lonely triangles behind:
+		score += ValenceBoostScale * std::pow(float(v.remaining), -ValenceBoostPower);
+		return score;
+	};
+
+	for (auto &v : vertices) v.score = vertex_score(v);
+
+	std::vector< float > triangle_scores(triangle_count);
+	std::vector< bool > emitted(triangle_count, false);
+	for (uint32_t t = 0; t < triangle_count; ++t) {
+		triangle_scores[t] = vertices[indices[3*t+0]].score + vertices[indices[3*t+1]].score + vertices[indices[3*t+2]].score;
+	}
+
+	std::vector< uint32_t > cache; //most recently used first
+	cache.reserve(cache_size + 3);
+
+	std::vector< uint32_t > out;
+	out.reserve(indices.size());
+
+	uint32_t best = -1U;
+	uint32_t scan = 0; //for finding a starting triangle when the cache has nothing to offer
+	while (out.size() < indices.size()) {
+		if (best == -1U) {
+			float best_score = -1.0f;
+			for (uint32_t t = scan; t < triangle_count; ++t) {
+				if (emitted[t]) continue;
+				if (best == -1U) scan = t;
+				if (triangle_scores[t] > best_score) {
+					best_score = triangle_scores[t];
+					best = t;
+				}
+			}
+			assert(best != -1U);
+		}
+
+		//emit the triangle:
+		emitted[best] = true;
+		for (uint32_t j = 0; j < 3; ++j) {
+			uint32_t v = indices[3*best+j];
+			out.emplace_back(v);
+
+			//remove from vertex's remaining triangles:
+			VertexData &data = vertices[v];
+			uint32_t *list = &vertex_triangles[data.triangles_begin];
+			for (uint32_t k = 0; k < data.remaining; ++k) {
+				if (list[k] == best) {
+					std::swap(list[k], list[data.remaining - 1]);
+					break;
+				}
+			}
+			data.remaining -= 1;
+
+			//move to front of cache:
+			auto f = std::find(cache.begin(), cache.end(), v);
+			if (f != cache.end()) cache.erase(f);
+			cache.insert(cache.begin(), v);
+		}
+
+		//update scores of cached vertices (including ones about to fall out of the cache):
+		for (uint32_t i = 0; i < cache.size(); ++i) {
+			vertices[cache[i]].cache_position = (i < cache_size ? int32_t(i) : -1);
+			vertices[cache[i]].score = vertex_score(vertices[cache[i]]);
+		}
+		if (cache.size() > cache_size) cache.resize(cache_size);
+
+		//re-score triangles touching the cache, and pick the next triangle from among them:
+		best = -1U;
+		float best_score = -1.0f;
+		for (uint32_t v : cache) {
+			VertexData const &data = vertices[v];
+			for (uint32_t k = 0; k < data.remaining; ++k) {
+				uint32_t t = vertex_triangles[data.triangles_begin + k];
+				float score = vertices[indices[3*t+0]].score + vertices[indices[3*t+1]].score + vertices[indices[3*t+2]].score;
+				triangle_scores[t] = score;
+				if (score > best_score) {
+					best_score = score;
+					best = t;
+				}
+			}
+		}
+	}
+
+	return out;
+}
+
+//average cache miss ratio (transformed vertices per triangle) with a FIFO cache of the given size:
+static float acmr(std::vector< uint32_t > const &indices, uint32_t cache_size) {
+	if (indices.size() < 3) return 0.0f;
+	std::vector< uint32_t > fifo;
+	uint32_t misses = 0;
+	for (uint32_t i : indices) {
+		if (std::find(fifo.begin(), fifo.end(), i) != fifo.end()) continue;
+		misses += 1;
+		fifo.emplace_back(i);
+		if (fifo.size() > cache_size) fifo.erase(fifo.begin());
+	}
+	return float(misses) / float(indices.size() / 3);
+}
+
+int main(int argc, char **argv) {
+	std::vector< std::string > args(argv + 1, argv + argc);
+	bool quantize = false;
+	bool compress = false;
+	while (!args.empty() && (args[0] == "--quantize" || args[0] == "--compress")) {
+		if (args[0] == "--quantize") quantize = true;
+		else compress = true;
+		args.erase(args.begin());
+	}
+	if (args.size() != 2 && args.size() != 3) {
+		std::cerr << "Usage:\n\t" << argv[0] << " [--quantize] [--compress] <in.pnct> <out.pnct> [cache size]" << std::endl;
+		return 1;
+	}
+	std::string in_file = args[0];
+	std::string out_file = args[1];
+	uint32_t cache_size = (args.size() == 3 ? uint32_t(std::stoul(args[2])) : 32);
+	if (cache_size < 4) {
+		std::cerr << "Cache size must be at least 4." << std::endl;
+		return 1;
+	}
+
+	try {
+		//------ read meshes (same format as MeshBuffer's constructor) ------
+		std::vector< Vertex > vertices;
+		std::vector< char > strings;
+		std::vector< IndexEntry > index;
+		std::vector< uint32_t > indices;
+		std::vector< IndexRange > ranges;
+		size_t in_bytes = 0;
+		{
+			ChunkFile file(in_file);
+			bool in_quantized = (file.find("pncq") != nullptr);
+			std::vector< QuantizedVertex > quantized;
+			if (in_quantized) file.read("pncq", &quantized);
+			else file.read("pnct", &vertices);
+			in_bytes = (in_quantized ? quantized.size() * sizeof(QuantizedVertex) : vertices.size() * sizeof(Vertex));
+			file.read("str0", &strings);
+			file.read("idx0", &index);
+			if (file.find("ind0")) {
+				file.read("ind0", &indices);
+				file.read("inr0", &ranges);
+				if (ranges.size() != index.size()) {
+					throw std::runtime_error("index ranges don't match index entries");
+				}
+			}
+			if (in_quantized) {
+				//decode (re-cooking a quantized file):
+				std::vector< QuantizationBox > boxes;
+				file.read("qbx0", &boxes);
+				if (boxes.size() != index.size()) {
+					throw std::runtime_error("quantization boxes don't match index entries");
+				}
+				vertices.assign(quantized.size(), Vertex{});
+				for (uint32_t i = 0; i < index.size(); ++i) {
+					if (!(index[i].vertex_begin <= index[i].vertex_end && index[i].vertex_end <= quantized.size())) {
+						throw std::runtime_error("index entry has out-of-range vertex start/count");
+					}
+					for (uint32_t v = index[i].vertex_begin; v < index[i].vertex_end; ++v) {
+						QuantizedVertex const &q = quantized[v];
+						vertices[v].Position = dequantize_position(q.Position, boxes[i]);
+						vertices[v].Normal = octahedral_decode(q.Normal);
+						vertices[v].Color = q.Color;
+						vertices[v].TexCoord = glm::vec2(half_to_float(q.TexCoord.x), half_to_float(q.TexCoord.y));
+					}
+				}
+			}
+		}
+
+		//------ gather each mesh as a triangle list ------
+		std::vector< std::string > names;
+		std::vector< std::vector< Vertex > > soups;
+		for (uint32_t i = 0; i < index.size(); ++i) {
+			IndexEntry const &entry = index[i];
+			if (!(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= vertices.size())) {
+				throw std::runtime_error("index entry has out-of-range vertex start/count");
+			}
+			names.emplace_back(strings.begin() + std::min< size_t >(entry.name_begin, strings.size()), strings.begin() + std::min< size_t >(entry.name_end, strings.size()));
+
+			soups.emplace_back();
+			std::vector< Vertex > &soup = soups.back();
+			if (ranges.empty()) {
+				soup.assign(vertices.begin() + entry.vertex_begin, vertices.begin() + entry.vertex_end);
+			} else {
+				if (!(ranges[i].index_begin <= ranges[i].index_end && ranges[i].index_end <= indices.size())) {
+					throw std::runtime_error("index range is out of range");
+				}
+				for (uint32_t j = ranges[i].index_begin; j < ranges[i].index_end; ++j) {
+					if (indices[j] >= vertices.size()) throw std::runtime_error("index is out of range");
+					soup.emplace_back(vertices[indices[j]]);
+				}
+			}
+			if (soup.size() % 3 != 0) {
+				throw std::runtime_error("mesh '" + names.back() + "' is not a triangle list");
+			}
+		}
+
+		//------ (optionally) quantize ------
+		std::vector< QuantizationBox > boxes;
+		if (quantize) {
+			//bounds of each mesh:
+			for (auto const &soup : soups) {
+				QuantizationBox box{glm::vec3( std::numeric_limits< float >::infinity()), glm::vec3(-std::numeric_limits< float >::infinity())};
+				for (auto const &v : soup) {
+					box.min = glm::min(box.min, v.Position);
+					box.max = glm::max(box.max, v.Position);
+				}
+				if (soup.empty()) box.min = box.max = glm::vec3(0.0f);
+				boxes.emplace_back(box);
+			}
+
+			//LOD chains ("Name", "Name.LOD1", ...) share one box, the union of their bounds:
+			std::map< std::string, uint32_t > by_name;
+			for (uint32_t i = 0; i < names.size(); ++i) by_name.emplace(names[i], i); //(first wins, as in MeshBuffer)
+			std::map< uint32_t, std::vector< uint32_t > > chains; //base -> LODs
+			for (uint32_t i = 0; i < names.size(); ++i) {
+				auto dot = names[i].rfind(".LOD");
+				if (dot == std::string::npos || dot + 4 == names[i].size()) continue;
+				if (names[i].find_first_not_of("0123456789", dot + 4) != std::string::npos) continue;
+				auto base = by_name.find(names[i].substr(0, dot));
+				if (base == by_name.end()) continue;
+				chains[base->second].emplace_back(i);
+			}
+			for (auto const &[base, lods] : chains) {
+				QuantizationBox box = boxes[base];
+				for (uint32_t lod : lods) {
+					box.min = glm::min(box.min, boxes[lod].min);
+					box.max = glm::max(box.max, boxes[lod].max);
+				}
+				boxes[base] = box;
+				for (uint32_t lod : lods) boxes[lod] = box;
+			}
+
+			//snap vertices to their quantized values (so welding merges vertices that quantize identically):
+			for (uint32_t i = 0; i < soups.size(); ++i) {
+				for (auto &v : soups[i]) {
+					v.Position = dequantize_position(quantize_position(v.Position, boxes[i]), boxes[i]);
+					v.Normal = octahedral_decode(octahedral_encode(v.Normal));
+					v.TexCoord = glm::vec2(half_to_float(float_to_half(v.TexCoord.x)), half_to_float(float_to_half(v.TexCoord.y)));
+				}
+			}
+		}
+
+		//------ cook each mesh ------
+		std::vector< Vertex > out_vertices;
+		std::vector< IndexEntry > out_index;
+		std::vector< uint32_t > out_indices;
+		std::vector< IndexRange > out_ranges;
+
+		float acmr_before = 0.0f, acmr_after = 0.0f; //(triangle-weighted sums)
+		for (uint32_t i = 0; i < index.size(); ++i) {
+			IndexEntry const &entry = index[i];
+			std::string const &name = names[i];
+			std::vector< Vertex > const &soup = soups[i];
+
+			//weld:
+			std::vector< Vertex > welded;
+			std::vector< uint32_t > local;
+			local.reserve(soup.size());
+			{
+				std::unordered_map< Vertex, uint32_t, VertexBytesHash, VertexBytesEqual > ids;
+				ids.reserve(soup.size());
+				for (auto const &v : soup) {
+					auto ret = ids.emplace(v, uint32_t(welded.size()));
+					if (ret.second) welded.emplace_back(v);
+					local.emplace_back(ret.first->second);
+				}
+			}
+			float before = acmr(local, 16);
+
+			//reorder triangles for the post-transform cache:
+			local = optimize_triangle_order(local, uint32_t(welded.size()), cache_size);
+			float after = acmr(local, 16);
+			acmr_before += before * float(local.size() / 3);
+			acmr_after += after * float(local.size() / 3);
+
+			//reorder vertices by first use (for vertex fetch):
+			std::vector< uint32_t > remap(welded.size(), -1U);
+			uint32_t base = uint32_t(out_vertices.size());
+			for (auto &l : local) {
+				if (remap[l] == -1U) {
+					remap[l] = uint32_t(out_vertices.size()) - base;
+					out_vertices.emplace_back(welded[l]);
+				}
+				l = base + remap[l];
+			}
+
+			IndexEntry cooked = entry;
+			cooked.vertex_begin = base;
+			cooked.vertex_end = uint32_t(out_vertices.size());
+			out_index.emplace_back(cooked);
+
+			IndexRange range;
+			range.index_begin = uint32_t(out_indices.size());
+			out_indices.insert(out_indices.end(), local.begin(), local.end());
+			range.index_end = uint32_t(out_indices.size());
+			out_ranges.emplace_back(range);
+
+			std::cout << "  '" << name << "': " << soup.size() << " -> " << (cooked.vertex_end - cooked.vertex_begin) << " vertices; ACMR " << before << " -> " << after << std::endl;
+		}
+
+		//------ write indexed meshes ------
+		ChunkFileWriter writer;
+		//(with --compress, chunks are shuffled by the size of their scalars: 4 for floats and uint32s, 2 for quantized vertices)
+		auto add = [&writer,&compress](std::string const &magic, auto const &from, uint16_t shuffle) {
+			if (compress) writer.add_compressed(magic, from, shuffle);
+			else writer.add(magic, from);
+		};
+		size_t out_bytes = 0;
+		if (quantize) {
+			std::vector< QuantizedVertex > quantized(out_vertices.size());
+			for (uint32_t i = 0; i < out_index.size(); ++i) {
+				for (uint32_t v = out_index[i].vertex_begin; v < out_index[i].vertex_end; ++v) {
+					Vertex const &f = out_vertices[v];
+					QuantizedVertex &q = quantized[v];
+					q.Position = quantize_position(f.Position, boxes[i]);
+					q.Normal = octahedral_encode(f.Normal);
+					q.Color = f.Color;
+					q.TexCoord = glm::u16vec2(float_to_half(f.TexCoord.x), float_to_half(f.TexCoord.y));
+				}
+			}
+			add("pncq", quantized, 2);
+			out_bytes = quantized.size() * sizeof(QuantizedVertex);
+		} else {
+			add("pnct", out_vertices, 4);
+			out_bytes = out_vertices.size() * sizeof(Vertex);
+		}
+		add("str0", strings, 0);
+		add("idx0", out_index, 4);
+		add("ind0", out_indices, 4);
+		add("inr0", out_ranges, 4);
+		if (quantize) {
+			add("qbx0", boxes, 4);
+		}
+		std::ofstream out(out_file, std::ios::binary);
+		writer.write(&out);
+		if (!out) {
+			throw std::runtime_error("Failed to write '" + out_file + "'.");
+		}
+
+		float triangles = float(out_indices.size() / 3);
+		std::cout << "Cooked " << out_index.size() << " meshes from '" << in_file << "' to '" << out_file << "': "
+			<< vertices.size() << " -> " << out_vertices.size() << " vertices (" << in_bytes << " -> " << out_bytes << " bytes), ACMR (16-entry FIFO) "
+			<< (triangles > 0.0f ? acmr_before / triangles : 0.0f) << " -> " << (triangles > 0.0f ? acmr_after / triangles : 0.0f) << "." << std::endl;
+		if (compress) {
+			uint64_t raw = 0, stored = 0;
+			for (auto const &chunk : writer.chunks) {
+				raw += chunk.entry.raw_size;
+				stored += chunk.entry.size;
+			}
+			std::cout << "  compressed chunks: " << raw << " -> " << stored << " bytes." << std::endl;
+		}
+	} catch (std::exception &e) {
+		std::cerr << "ERROR: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
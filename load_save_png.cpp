@@ -1,4 +1,5 @@
 #include "load_save_png.hpp"
+#include "DataFile.hpp"
 
 #include <png.h>
 
@@ -17,11 +18,16 @@ void save_png(std::ostream &to, unsigned int width, unsigned int height, glm::u8
 void load_png(std::string filename, glm::uvec2 *size, std::vector< glm::u8vec4 > *data, OriginLocation origin) {
 	assert(size);
 
-	std::ifstream file(filename.c_str(), std::ios::binary);
-	if (!file) {
+	//(may be in the asset pack; see DataFile.hpp)
+	std::unique_ptr< DataFile > file;
+	try {
+		file = std::make_unique< DataFile >(filename);
+	} catch (std::exception &) {
 		throw std::runtime_error("Failed to open PNG image file '" + filename + "'.");
 	}
-	if (!load_png(file, &size->x, &size->y, data, origin)) {
+	MemoryBuf buf(file->data, file->data + file->size);
+	std::istream from(&buf);
+	if (!load_png(from, &size->x, &size->y, data, origin)) {
 		throw std::runtime_error("Failed to read PNG image from '" + filename + "'.");
 	}
 }
@@ -0,0 +1,160 @@
+#include "lz4_block.hpp"
+
+#include <algorithm>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+
+namespace {
+	constexpr size_t MinMatch = 4;
+	constexpr size_t LastLiterals = 5; //the last five bytes of a block are always literals
+	constexpr size_t MatchStartLimit = 12; //matches must start at least this many bytes before the end of a block
+	constexpr size_t MaxOffset = 65535;
+	constexpr uint32_t HashBits = 16;
+
+	uint32_t read32(uint8_t const *at) {
+		uint32_t ret;
+		std::memcpy(&ret, at, 4);
+		return ret;
+	}
+
+	uint32_t hash32(uint32_t sequence) {
+		return (sequence * 2654435761u) >> (32 - HashBits);
+	}
+
+	//write the part of a length that didn't fit in its token nibble:
+	uint8_t *write_length(uint8_t *op, size_t length) {
+		while (length >= 255) {
+			*op++ = 255;
+			length -= 255;
+		}
+		*op++ = uint8_t(length);
+		return op;
+	}
+
+	//read the rest of a length whose token nibble was 15:
+	bool read_length(uint8_t const **ip_, uint8_t const *iend, size_t *length) {
+		uint8_t const *ip = *ip_;
+		uint8_t b;
+		do {
+			if (ip >= iend) return false;
+			b = *ip++;
+			*length += b;
+		} while (b == 255);
+		*ip_ = ip;
+		return true;
+	}
+}
+
+size_t lz4_compress_bound(size_t size) {
+	return size + size / 255 + 16;
+}
+
+size_t lz4_compress(void const *src_, size_t size, void *dst_) {
+	if (size > LZ4MaxInputSize) return 0;
+
+	uint8_t const *src = reinterpret_cast< uint8_t const * >(src_);
+	uint8_t *op = reinterpret_cast< uint8_t * >(dst_);
+
+	size_t anchor = 0; //start of pending literals
+
+	//emit a sequence -- literals [anchor, literal_end) then (unless match_length is zero) a match:
+	auto emit = [&](size_t literal_end, size_t match_length, size_t offset) {
+		size_t literals = literal_end - anchor;
+		uint8_t *token = op++;
+		*token = uint8_t(std::min< size_t >(literals, 15) << 4);
+		if (literals >= 15) op = write_length(op, literals - 15);
+		if (literals) std::memcpy(op, src + anchor, literals);
+		op += literals;
+
+		if (match_length) {
+			*op++ = uint8_t(offset & 0xff);
+			*op++ = uint8_t(offset >> 8);
+			size_t length = match_length - MinMatch;
+			*token |= uint8_t(std::min< size_t >(length, 15));
+			if (length >= 15) op = write_length(op, length - 15);
+		}
+	};
+
+	if (size > MatchStartLimit) {
+		//most recent position (+1, so zero means empty) of each hashed four-byte sequence:
+		std::vector< uint32_t > table(size_t(1) << HashBits, 0);
+
+		size_t const match_start_limit = size - MatchStartLimit;
+		size_t const match_end_limit = size - LastLiterals;
+
+		size_t ip = 0;
+		size_t misses = 0;
+		while (ip < match_start_limit) {
+			uint32_t sequence = read32(src + ip);
+			uint32_t &slot = table[hash32(sequence)];
+			size_t candidate = slot;
+			slot = uint32_t(ip + 1);
+
+			if (candidate != 0 && ip - (candidate - 1) <= MaxOffset && read32(src + candidate - 1) == sequence) {
+				size_t match = candidate - 1;
+				size_t length = MinMatch;
+				while (ip + length < match_end_limit && src[ip + length] == src[match + length]) ++length;
+
+				emit(ip, length, ip - match);
+				ip += length;
+				anchor = ip;
+				misses = 0;
+			} else {
+				//step faster through data that isn't matching (as the reference compressor does):
+				ip += 1 + (misses++ >> 6);
+			}
+		}
+	}
+
+	//remaining bytes are literals:
+	emit(size, 0, 0);
+
+	return size_t(op - reinterpret_cast< uint8_t * >(dst_));
+}
+
+bool lz4_decompress(void const *src_, size_t size, void *dst_, size_t raw_size) {
+	uint8_t const *ip = reinterpret_cast< uint8_t const * >(src_);
+	uint8_t const *iend = ip + size;
+	uint8_t *dst = reinterpret_cast< uint8_t * >(dst_);
+	uint8_t *op = dst;
+	uint8_t *oend = dst + raw_size;
+
+	while (true) {
+		if (ip >= iend) return false;
+		uint8_t token = *ip++;
+
+		//literals:
+		size_t literals = token >> 4;
+		if (literals == 15 && !read_length(&ip, iend, &literals)) return false;
+		if (literals > size_t(iend - ip) || literals > size_t(oend - op)) return false;
+		if (literals) std::memcpy(op, ip, literals);
+		ip += literals;
+		op += literals;
+
+		//the last sequence is only literals:
+		if (ip == iend) break;
+
+		//match:
+		if (iend - ip < 2) return false;
+		size_t offset = size_t(ip[0]) | (size_t(ip[1]) << 8);
+		ip += 2;
+		if (offset == 0 || offset > size_t(op - dst)) return false;
+
+		size_t length = token & 15;
+		if (length == 15 && !read_length(&ip, iend, &length)) return false;
+		length += MinMatch;
+		if (length > size_t(oend - op)) return false;
+
+		uint8_t const *match = op - offset;
+		if (offset >= length) {
+			std::memcpy(op, match, length);
+		} else {
+			//overlapping match repeats the last 'offset' bytes:
+			for (size_t i = 0; i < length; ++i) op[i] = match[i];
+		}
+		op += length;
+	}
+
+	return op == oend;
+}
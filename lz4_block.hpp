@@ -0,0 +1,25 @@
+#pragma once
+
+//Compressor and decompressor for the LZ4 block format:
+// https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md
+//(blocks only -- no frame header or checksums -- so callers keep track of the decompressed size)
+//
+//The compressor is a simple greedy matcher (close to LZ4's "fast" mode at acceleration 1);
+// its output can be decoded by any LZ4 block decoder, and this decoder reads any LZ4 block.
+
+#include <cstddef>
+
+//largest input lz4_compress accepts (same limit as the reference implementation):
+constexpr size_t LZ4MaxInputSize = 0x7E000000;
+
+//largest compressed size of 'size' bytes of input:
+size_t lz4_compress_bound(size_t size);
+
+//compress 'size' bytes from 'src' into 'dst', which must have room for lz4_compress_bound(size) bytes:
+// returns the compressed size (or 0 if size > LZ4MaxInputSize)
+size_t lz4_compress(void const *src, size_t size, void *dst);
+
+//decompress a block into exactly 'raw_size' bytes at 'dst':
+// returns false if the block is malformed or doesn't decode to exactly raw_size bytes
+// (never reads past src + size or writes past dst + raw_size)
+bool lz4_decompress(void const *src, size_t size, void *dst, size_t raw_size);
@@ -6,6 +6,7 @@
 
 //For asset loading:
 #include "Load.hpp"
+#include "DataReads.hpp"
 
 //For sound init:
 #include "Sound.hpp"
@@ -47,6 +48,9 @@ int main(int argc, char **argv) {
 
 	//------------  initialization ------------
 
+	//Start reading data files (in the background, so the reads overlap window setup and loading):
+	start_data_reads();
+
 	//Initialize SDL library:
 	SDL_Init(SDL_INIT_VIDEO);
 
@@ -0,0 +1,133 @@
+//pack-assets packs the files in a directory into a single asset pack (see AssetPack.hpp),
+// which the game reads its data files from when it is present (see DataFile.hpp).
+//
+//Usage:
+//  pack-assets <directory> <out.pack> [file ...]
+//
+//Files are named by their path relative to <directory> ('/'-separated, as passed to data_path()).
+// (listed files may also start with <directory> -- e.g., as a Makefile lists them -- which is removed)
+//If files are listed, only those are packed; otherwise every file under <directory> is (except <out.pack>).
+//
+//The pack has a directory sorted by name (so lookups are a binary search) and each file's contents
+// start on a page boundary (so slices of the mapped pack are aligned for any use);
+// files with identical contents -- found by a content hash, then compared -- are stored once.
+
+#include "AssetPack.hpp"
+#include "ChunkFile.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+
+//FNV-1a, 64-bit:
+static uint64_t hash_contents(std::vector< char > const &data) {
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (char c : data) {
+		hash = (hash ^ uint8_t(c)) * 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+int main(int argc, char **argv) {
+	if (argc < 3) {
+		std::cerr << "Usage:\n\t" << argv[0] << " <directory> <out.pack> [file ...]" << std::endl;
+		return 1;
+	}
+	std::filesystem::path directory = argv[1];
+	std::string out_file = argv[2];
+	std::vector< std::string > names(argv + 3, argv + argc);
+
+	try {
+		//------ gather file names ------
+		if (names.empty()) {
+			for (auto const &item : std::filesystem::recursive_directory_iterator(directory)) {
+				if (!item.is_regular_file()) continue;
+				if (std::filesystem::exists(out_file) && std::filesystem::equivalent(item.path(), out_file)) continue;
+				names.emplace_back(item.path().lexically_relative(directory).generic_string());
+			}
+		} else {
+			auto forward_slashes = [](std::string path) {
+				std::replace(path.begin(), path.end(), '\\', '/');
+				return path;
+			};
+			std::string prefix = forward_slashes(argv[1]);
+			if (!prefix.empty() && prefix.back() != '/') prefix += '/';
+			for (auto &name : names) {
+				name = forward_slashes(name);
+				if (name.compare(0, prefix.size(), prefix) == 0) name = name.substr(prefix.size());
+			}
+		}
+		std::sort(names.begin(), names.end());
+		if (std::adjacent_find(names.begin(), names.end()) != names.end()) {
+			throw std::runtime_error("A file is listed more than once.");
+		}
+
+		//------ read files, sharing identical contents ------
+		std::vector< std::vector< char > > contents; //distinct contents
+		std::multimap< uint64_t, uint32_t > by_hash; //hash -> index in contents
+		std::vector< uint32_t > file_contents; //index in contents for each name
+		size_t total_bytes = 0;
+		for (auto const &name : names) {
+			std::ifstream file(directory / name, std::ios::binary);
+			if (!file) throw std::runtime_error("Failed to open '" + (directory / name).string() + "'.");
+			std::vector< char > data((std::istreambuf_iterator< char >(file)), std::istreambuf_iterator< char >());
+			total_bytes += data.size();
+
+			uint64_t hash = hash_contents(data);
+			uint32_t index = uint32_t(contents.size());
+			auto range = by_hash.equal_range(hash);
+			for (auto r = range.first; r != range.second; ++r) {
+				if (contents[r->second] == data) {
+					index = r->second;
+					std::cout << "  '" << name << "' has the same contents as an earlier file." << std::endl;
+					break;
+				}
+			}
+			if (index == contents.size()) {
+				by_hash.emplace(hash, index);
+				contents.emplace_back(std::move(data));
+			}
+			file_contents.emplace_back(index);
+		}
+
+		//------ write pack ------
+		std::vector< char > strings;
+		std::vector< AssetPack::PackEntry > entries;
+		for (uint32_t i = 0; i < names.size(); ++i) {
+			AssetPack::PackEntry entry;
+			entry.name_begin = uint32_t(strings.size());
+			strings.insert(strings.end(), names[i].begin(), names[i].end());
+			entry.name_end = uint32_t(strings.size());
+			entry.chunk = 2 + file_contents[i]; //(after "str0" and "pkd0")
+			entry.reserved = 0;
+			entries.emplace_back(entry);
+		}
+
+		ChunkFileWriter writer;
+		writer.add("str0", strings);
+		writer.add("pkd0", entries);
+		size_t packed_bytes = 0;
+		for (auto const &data : contents) {
+			writer.add("file", data, AssetPack::PageSize);
+			packed_bytes += data.size();
+		}
+
+		std::ofstream out(out_file, std::ios::binary);
+		writer.write(&out);
+		if (!out) {
+			throw std::runtime_error("Failed to write '" + out_file + "'.");
+		}
+
+		std::cout << "Packed " << names.size() << " files (" << contents.size() << " distinct; " << total_bytes << " -> " << packed_bytes << " bytes) from '" << directory.string() << "' to '" << out_file << "'." << std::endl;
+	} catch (std::exception &e) {
+		std::cerr << "ERROR: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+/*
+ * Encoding helpers for the quantized .pnct vertex layout (see Mesh.hpp and cook-meshes.cpp):
+ *  - positions are 16-bit unsigned normalized, relative to a per-mesh bounding box;
+ *  - normals are octahedral-encoded in two 16-bit signed normalized values;
+ *  - colors are unchanged (8-bit unsigned normalized);
+ *  - texture coordinates are half-floats.
+ *
+ * The decode functions match what OpenGL (and the shaders, for octahedral
+ *  normals) do with the same bits, so CPU-side copies agree with what is drawn.
+ *
+ */
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+struct QuantizedVertex {
+	glm::u16vec4 Position; //xyz relative to mesh box; w is padding (always zero)
+	glm::i16vec2 Normal; //octahedral encoding
+	glm::u8vec4 Color;
+	glm::u16vec2 TexCoord; //half-floats
+};
+static_assert(sizeof(QuantizedVertex) == 4*2+2*2+4*1+2*2, "QuantizedVertex is packed.");
+
+//box positions are quantized relative to (one per .pnct index entry):
+struct QuantizationBox {
+	glm::vec3 min, max;
+};
+static_assert(sizeof(QuantizationBox) == 4*6, "QuantizationBox is packed.");
+
+//------ positions ------
+
+inline glm::u16vec4 quantize_position(glm::vec3 const &p, QuantizationBox const &box) {
+	glm::u16vec4 q(0);
+	for (uint32_t c = 0; c < 3; ++c) {
+		float size = box.max[c] - box.min[c];
+		if (!(size > 0.0f)) continue; //flat axis: everything is at min
+		float t = std::max(0.0f, std::min(1.0f, (p[c] - box.min[c]) / size));
+		q[c] = uint16_t(std::lround(t * 65535.0f));
+	}
+	return q;
+}
+
+inline glm::vec3 dequantize_position(glm::u16vec4 const &q, QuantizationBox const &box) {
+	return box.min + glm::vec3(q) / 65535.0f * (box.max - box.min);
+}
+
+//the same mapping as a matrix, for shaders (which see normalized positions in [0,1]):
+inline glm::mat4x3 dequantize_matrix(QuantizationBox const &box) {
+	glm::vec3 size = box.max - box.min;
+	return glm::mat4x3(
+		glm::vec3(size.x, 0.0f, 0.0f),
+		glm::vec3(0.0f, size.y, 0.0f),
+		glm::vec3(0.0f, 0.0f, size.z),
+		box.min
+	);
+}
+
+//------ normals ------
+
+inline glm::i16vec2 octahedral_encode(glm::vec3 const &n) {
+	float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+	if (!(l1 > 0.0f)) return glm::i16vec2(0, 32767); //degenerate normal: encode as +z
+	glm::vec2 p = glm::vec2(n.x, n.y) / l1;
+	if (n.z < 0.0f) {
+		//fold the lower hemisphere over the diagonals:
+		p = glm::vec2(
+			(1.0f - std::abs(p.y)) * (p.x >= 0.0f ? 1.0f : -1.0f),
+			(1.0f - std::abs(p.x)) * (p.y >= 0.0f ? 1.0f : -1.0f)
+		);
+	}
+	return glm::i16vec2(
+		int16_t(std::lround(std::max(-1.0f, std::min(1.0f, p.x)) * 32767.0f)),
+		int16_t(std::lround(std::max(-1.0f, std::min(1.0f, p.y)) * 32767.0f))
+	);
+}
+
+inline glm::vec3 octahedral_decode(glm::i16vec2 const &e) {
+	glm::vec2 p = glm::max(glm::vec2(e) / 32767.0f, glm::vec2(-1.0f));
+	glm::vec3 n = glm::vec3(p.x, p.y, 1.0f - std::abs(p.x) - std::abs(p.y));
+	if (n.z < 0.0f) {
+		n.x = (1.0f - std::abs(p.y)) * (p.x >= 0.0f ? 1.0f : -1.0f);
+		n.y = (1.0f - std::abs(p.x)) * (p.y >= 0.0f ? 1.0f : -1.0f);
+	}
+	return glm::normalize(n);
+}
+
+//------ texture coordinates ------
+
+//IEEE 754 binary16, rounding to nearest even:
+inline uint16_t float_to_half(float f) {
+	uint32_t x;
+	std::memcpy(&x, &f, 4);
+	uint16_t sign = uint16_t((x >> 16) & 0x8000);
+	uint32_t exponent = (x >> 23) & 0xff;
+	uint32_t mantissa = x & 0x7fffff;
+
+	if (exponent == 0xff) return uint16_t(sign | 0x7c00 | (mantissa ? 0x200 : 0)); //inf / nan
+	int32_t e = int32_t(exponent) - 127 + 15;
+	if (e >= 0x1f) return uint16_t(sign | 0x7c00); //overflow -> inf
+	if (e <= 0) {
+		//subnormal (or zero):
+		if (e < -10) return sign;
+		mantissa |= 0x800000;
+		uint32_t shift = uint32_t(14 - e);
+		uint32_t half = mantissa >> shift;
+		uint32_t rest = mantissa & ((1u << shift) - 1);
+		uint32_t halfway = 1u << (shift - 1);
+		if (rest > halfway || (rest == halfway && (half & 1))) half += 1;
+		return uint16_t(sign | half);
+	}
+	uint32_t half = (uint32_t(e) << 10) | (mantissa >> 13);
+	uint32_t rest = mantissa & 0x1fff;
+	if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) half += 1; //(carry into exponent is correct, up to inf)
+	return uint16_t(sign | half);
+}
+
+inline float half_to_float(uint16_t h) {
+	uint32_t sign = uint32_t(h & 0x8000) << 16;
+	uint32_t exponent = (h >> 10) & 0x1f;
+	uint32_t mantissa = h & 0x3ff;
+	uint32_t x;
+	if (exponent == 0x1f) {
+		x = sign | 0x7f800000 | (mantissa << 13);
+	} else if (exponent != 0) {
+		x = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+	} else if (mantissa == 0) {
+		x = sign;
+	} else {
+		//subnormal: renormalize
+		exponent = 127 - 15 + 1;
+		while (!(mantissa & 0x400)) {
+			mantissa <<= 1;
+			exponent -= 1;
+		}
+		x = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+	}
+	float f;
+	std::memcpy(&f, &x, 4);
+	return f;
+}
@@ -4,6 +4,10 @@
 #include <vector>
 #include <stdexcept>
 #include <cassert>
+#include <cstring>
+
+//(this is the original, sequential chunk format; ChunkFile.hpp reads it -- and a v2 format with a table of contents -- by tag)
+//(read_chunk zero-fills its array and then copies into it from the stream; ChunkFile::view reads a file's chunks in place instead)
 
 //helper function that reads an array of structures preceded by a simple header:
 //Expected format:
@@ -63,3 +67,28 @@ void write_chunk(std::string const &magic, std::vector< T > const &from, std::os
 	to.write(reinterpret_cast< const char * >(&header), sizeof(header));
 	to.write(reinterpret_cast< const char * >(from.data()), from.size() * sizeof(T));
 }
+
+//helper function to append a chunk header (same format as above) to an in-memory buffer:
+// returns a pointer to 'size' bytes of space for the payload, which the caller should fill in
+// (the pointer is valid until 'to' is next resized; it may not be aligned for anything larger than a char)
+inline char *append_chunk(std::string const &magic, size_t size, std::vector< char > *to_) {
+	assert(magic.size() == 4);
+	assert(to_);
+	auto &to = *to_;
+
+	uint32_t size32 = uint32_t(size);
+	assert(size32 == size && "chunk fits in 32-bit size");
+
+	size_t at = to.size();
+	to.resize(at + 8 + size);
+	std::memcpy(&to[at], magic.data(), 4);
+	std::memcpy(&to[at + 4], &size32, 4);
+	return &to[at + 8];
+}
+
+//helper function to write a chunk of data in the same format as read_chunk to the end of an in-memory buffer:
+template< typename T >
+void write_chunk(std::string const &magic, std::vector< T > const &from, std::vector< char > *to) {
+	char *payload = append_chunk(magic, from.size() * sizeof(T), to);
+	if (!from.empty()) std::memcpy(payload, from.data(), from.size() * sizeof(T));
+}
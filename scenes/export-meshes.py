@@ -14,8 +14,15 @@ for i in range(0,len(sys.argv)):
 	if sys.argv[i] == '--':
 		args = sys.argv[i+1:]
 
+#optional: number of decimated level-of-detail meshes to write after each mesh:
+lod_levels = 0
+lod_ratio = 0.5 #each LOD level keeps this fraction of the previous level's triangles
+if len(args) >= 2 and args[0] == '--lods':
+	lod_levels = int(args[1])
+	args = args[2:]
+
 if len(args) != 2:
-	print("\n\nUsage:\nblender --background --python export-meshes.py -- <infile.blend[:collection]> <outfile.pnct>\nExports the meshes referenced by all objects in the specified collection(s) (default: all objects) to a binary blob.\n")
+	print("\n\nUsage:\nblender --background --python export-meshes.py -- [--lods N] <infile.blend[:collection]> <outfile.pnct>\nExports the meshes referenced by all objects in the specified collection(s) (default: all objects) to a binary blob.\nWith '--lods N', also writes decimated copies of each mesh named 'Name.LOD1' .. 'Name.LODN'.\n")
 	exit(1)
 
 import bpy
@@ -98,15 +105,10 @@ strings = b''
 index = b''
 
 vertex_count = 0
-for obj in bpy.data.objects:
-	if obj.data in to_write:
-		to_write.remove(obj.data)
-	else:
-		continue
 
-	obj.hide_select = False
-	mesh = obj.data
-	name = mesh.name
+#write_mesh triangulates obj's mesh and appends it to data/strings/index under the given name:
+def write_mesh(obj, name):
+	global data, strings, index, vertex_count
 
 	print("Writing '" + name + "'...")
 
@@ -130,6 +132,8 @@ for obj in bpy.data.objects:
 	bpy.ops.mesh.quads_convert_to_tris(quad_method='BEAUTY', ngon_method='BEAUTY')
 	bpy.ops.object.mode_set(mode='OBJECT')
 
+	mesh = obj.data
+
 	#record mesh name, start position and vertex count in the index:
 	name_begin = len(strings)
 	strings += bytes(name, "utf8")
@@ -193,6 +197,30 @@ for obj in bpy.data.objects:
 
 	index += struct.pack('I', vertex_count) #vertex_end
 
+
+for obj in list(bpy.data.objects): #(a snapshot, since LOD copies are linked into the scene inside the loop)
+	if obj.data in to_write:
+		to_write.remove(obj.data)
+	else:
+		continue
+
+	obj.hide_select = False
+	name = obj.data.name
+
+	#make decimated copies for LOD levels before the original gets triangulated:
+	lod_objs = []
+	for level in range(1, lod_levels + 1):
+		lod_obj = obj.copy()
+		lod_obj.data = obj.data.copy()
+		bpy.context.scene.collection.objects.link(lod_obj)
+		decimate = lod_obj.modifiers.new(name='LOD', type='DECIMATE')
+		decimate.ratio = lod_ratio ** level
+		lod_objs.append(lod_obj)
+
+	write_mesh(obj, name)
+	for level, lod_obj in enumerate(lod_objs, start=1):
+		write_mesh(lod_obj, name + ".LOD" + str(level))
+
 data = b''.join(data)
 
 #check that code created as much data as anticipated:
@@ -57,6 +57,9 @@ else:
 # msh0 len < uint uint uint > [hierarchy point + mesh name]
 # cam0 len < uint params > [heirarchy point + camera params]
 # lig0 len < uint params > [hierarchy point + light params]
+# acl0 len < uint uint float uint uint > [clip name + duration + track range] (only if any objects have actions)
+# atr0 len < uint uint uint uint > [hierarchy point + channel ('p','r','s') + key range]
+# akf0 len < float float*4 > [key time + value (xyz for position/scale, quaternion xyzw for rotation)]
 
 strings_data = b""
 xfh_data = b""
@@ -213,6 +216,82 @@ def write_objects(from_collection):
 
 write_objects(collection)
 
+#---------------------------------------------------------------------
+#Export animation:
+# each action becomes a clip; objects using the action get tracks sampled once per frame
+# (sampling, rather than copying f-curves, bakes in constraints, drivers, and interpolation modes)
+
+clip_data = b""
+track_data = b""
+key_data = b""
+track_count = 0
+key_count = 0
+
+def write_clips():
+	global clip_data, track_data, key_data, track_count, key_count
+	scene = bpy.context.scene
+	fps = scene.render.fps / scene.render.fps_base
+	old_frame = scene.frame_current
+
+	#group hierarchy entries by the action animating them:
+	users = dict()
+	for par_obj, ref in obj_to_xfh.items():
+		obj = par_obj[-1]
+		if obj.animation_data == None or obj.animation_data.action == None: continue
+		action = obj.animation_data.action
+		if action not in users: users[action] = []
+		users[action].append((obj, ref))
+
+	for action, objs in users.items():
+		first = int(math.floor(action.frame_range[0]))
+		last = int(math.ceil(action.frame_range[1]))
+		frames = list(range(first, last+1))
+
+		#sample parent-relative transforms (as in write_xfh) at every frame:
+		samples = dict()
+		for frame in frames:
+			scene.frame_set(frame)
+			for (obj, ref) in objs:
+				if obj.parent == None:
+					world_to_parent = mathutils.Matrix()
+				else:
+					world_to_parent = obj.parent.matrix_world.copy()
+					world_to_parent.invert()
+				samples.setdefault(ref, []).append((world_to_parent @ obj.matrix_world).decompose())
+
+		track_begin = track_count
+		for (obj, ref) in objs:
+			for channel, index in [(b'p', 0), (b'r', 1), (b's', 2)]:
+				values = [s[index] for s in samples[ref]]
+				if channel == b'r':
+					#keep consecutive rotations in the same hemisphere:
+					for i in range(1, len(values)):
+						if values[i].dot(values[i-1]) < 0.0: values[i] = -values[i]
+				#skip channels that don't change:
+				if all((v - values[0]).magnitude < 1e-6 for v in values): continue
+
+				key_begin = key_count
+				for frame, v in zip(frames, values):
+					key_data += struct.pack('f', (frame - first) / fps)
+					if channel == b'r':
+						key_data += struct.pack('4f', v.x, v.y, v.z, v.w)
+					else:
+						key_data += struct.pack('4f', v.x, v.y, v.z, 0.0)
+					key_count += 1
+				track_data += ref #hierarchy reference
+				track_data += struct.pack('I', ord(channel))
+				track_data += struct.pack('II', key_begin, key_count)
+				track_count += 1
+
+		print("clip: " + action.name + " (" + str(len(frames)) + " frames, " + str(track_count - track_begin) + " tracks)")
+		clip_data += write_string(action.name)
+		clip_data += struct.pack('f', (last - first) / fps)
+		clip_data += struct.pack('II', track_begin, track_count)
+
+	scene.frame_set(old_frame)
+
+write_clips()
+
 #write the strings chunk and scene chunk to an output blob:
 blob = open(outfile, 'wb')
 def write_chunk(magic, data):
@@ -225,6 +304,10 @@ write_chunk(b'xfh0', xfh_data)
 write_chunk(b'msh0', mesh_data)
 write_chunk(b'cam0', camera_data)
 write_chunk(b'lmp0', lamp_data)
+if len(clip_data) > 0:
+	write_chunk(b'acl0', clip_data)
+	write_chunk(b'atr0', track_data)
+	write_chunk(b'akf0', key_data)
 
 print("Wrote " + str(blob.tell()) + " bytes to '" + outfile + "'")
 blob.close()
@@ -4,6 +4,7 @@
 #include "GL.hpp"
 #include "load_save_png.hpp"
 #include "ShowSceneProgram.hpp"
+#include "GeometryArena.hpp"
 
 #include <SDL.h>
 
@@ -82,44 +83,65 @@ int main(int argc, char **argv) {
 	//------------ create game mode + make current --------------
 	bool usage = false;
 	std::string scene_file;
-	std::string meshes_file;
-	if (argc == 2) {
+	std::vector< std::string > meshes_files;
+	if (argc >= 2) {
 		scene_file = argv[1];
-	} else if (argc == 3) {
-		scene_file = argv[1];
-		meshes_file = argv[2];
+		for (int arg = 2; arg < argc; ++arg) {
+			meshes_files.emplace_back(argv[arg]);
+		}
 	} else {
 		usage = true;
 	}
-	MeshBuffer *buffer = nullptr;
-	GLuint buffer_vao = 0;
-	if (meshes_file != "") {
+	//mesh files share buffers (and, if they have the same vertex format, a vertex array):
+	// (like the scene, the arena is kept until exit)
+	GeometryArena *arena = new GeometryArena();
+	std::vector< MeshBuffer const * > buffers;
+	for (auto const &meshes_file : meshes_files) {
 		try {
-			buffer = new MeshBuffer(meshes_file);
-			buffer_vao = buffer->make_vao_for_program(show_scene_program->program);
+			buffers.emplace_back(&arena->load(meshes_file));
 		} catch (std::exception &e) {
 			std::cerr << "ERROR loading mesh buffer '" << meshes_file << "': " << e.what() << std::endl;
 			usage = true;
-			buffer = nullptr;
 		}
 	}
 	Scene *scene = nullptr;
-	if (scene_file != "") {
+	if (scene_file != "" && !usage) {
 		try {
 			scene = new Scene();
-			scene->load(scene_file, [&buffer,&buffer_vao](Scene &scene, Scene::Transform *transform, std::string const &mesh_name){
-				if (!buffer_vao) return;
-				Mesh const &mesh = buffer->lookup(mesh_name);
+			scene->load(scene_file, [&buffers](Scene &scene, Scene::Transform *transform, std::string const &mesh_name){
+				if (buffers.empty()) return;
+				//meshes come from the first file that has them:
+				MeshBuffer const *buffer = nullptr;
+				MeshBuffer::Handle handle;
+				for (MeshBuffer const *b : buffers) {
+					handle = b->find(mesh_name);
+					if (handle) {
+						buffer = b;
+						break;
+					}
+				}
+				if (!buffer) throw std::runtime_error("Looking up mesh '" + mesh_name + "' that doesn't exist.");
+				Mesh const &mesh = (*buffer)[handle];
 
 				scene.drawables.emplace_back(transform);
 				Scene::Drawable &drawable = scene.drawables.back();
 
+				drawable.min = mesh.min;
+				drawable.max = mesh.max;
+
 				drawable.pipeline = show_scene_program_pipeline;
 
-				drawable.pipeline.vao = buffer_vao;
+				drawable.pipeline.vao = buffer->make_vao_for_program(show_scene_program->program); //(cached)
 				drawable.pipeline.type = mesh.type;
 				drawable.pipeline.start = mesh.start;
 				drawable.pipeline.count = mesh.count;
+				drawable.pipeline.index_type = mesh.index_type;
+				drawable.pipeline.position_dequantize = mesh.dequantize;
+				drawable.pipeline.normal_octahedral = buffer->quantized;
+
+				for (Mesh const &lod : buffer->lookup_lods(handle)) {
+					drawable.lods.emplace_back(Scene::Drawable::LOD{lod.type, lod.start, lod.count});
+				}
 
 			});
 		} catch (std::exception &e) {
@@ -132,12 +154,16 @@ int main(int argc, char **argv) {
 		usage = true;
 	}
 	if (usage) {
-		std::cerr << "Usage:\n\t" << argv[0] << " <path/to/scene.scene> [path/to/meshes.pnct]" << std::endl;
+		std::cerr << "Usage:\n\t" << argv[0] << " <path/to/scene.scene> [path/to/meshes.pnct ...]" << std::endl;
 		return 1;
 	}
 	std::cout << "Showing scene from '" << scene_file << "' with";
-	if (meshes_file != "") {
-		std::cout << " meshes from '" << meshes_file << "'" << std::endl;
+	if (!meshes_files.empty()) {
+		std::cout << " meshes from";
+		for (auto const &meshes_file : meshes_files) {
+			std::cout << " '" << meshes_file << "'";
+		}
+		std::cout << std::endl;
 	} else {
 		std::cout << " no meshes -- consider passing a '.pnct' file as the second argument." << std::endl;
 	}